@@ -12,6 +12,7 @@ __BEGIN_DECLS
 
 #include <stdint.h>
 #include <kos/blockdev.h>
+#include <kos/bcache.h>
 
 /** \file   ext2/fs_ext2.h
     \brief  VFS interface for an ext2 filesystem.
@@ -132,5 +133,35 @@ int fs_ext2_unmount(const char *mp);
 */
 int fs_ext2_sync(const char *mp);
 
+/** \brief  Set how far ahead to read for files read sequentially.
+
+    When a file on the filesystem is being read from start to end, the blocks
+    after the one being read are brought into the block cache ahead of time, a
+    run of them at once. The number of blocks read ahead starts small and grows
+    while the file keeps being read in order, up to the limit set here. The
+    limit is also never more than half of the block cache.
+
+    \param  mp          The mount point of the filesystem.
+    \param  blocks      The most blocks to read ahead at once, or 0 to turn
+                        read-ahead off. The default is BCACHE_RA_DEFAULT.
+    \retval 0           On success.
+    \retval -1          On error (errno will be ENOENT if nothing is mounted
+                        at mp).
+*/
+int fs_ext2_set_readahead(const char *mp, size_t blocks);
+
+/** \brief  Retrieve the block cache statistics for an ext2 filesystem.
+
+    Among other things, this reports how many blocks have been read ahead and
+    how many of them were then actually used.
+
+    \param  mp          The mount point of the filesystem.
+    \param  stats       Storage for the statistics.
+    \retval 0           On success.
+    \retval -1          On error (errno will be ENOENT if nothing is mounted
+                        at mp).
+*/
+int fs_ext2_cache_stats(const char *mp, bcache_stats_t *stats);
+
 __END_DECLS
 #endif /* !__EXT2_FS_EXT2_H */
@@ -12,6 +12,7 @@ __BEGIN_DECLS
 
 #include <stdint.h>
 #include <kos/blockdev.h>
+#include <kos/bcache.h>
 
 /** \file   fat/fs_fat.h
     \brief  VFS interface for a FAT filesystem.
@@ -115,5 +116,35 @@ int fs_fat_unmount(const char *mp);
 */
 int fs_fat_sync(const char *mp);
 
+/** \brief  Set how far ahead to read for files read sequentially.
+
+    When a file on the filesystem is being read from start to end, the clusters
+    after the one being read are brought into the cluster cache ahead of time,
+    a run of them at once. The number of clusters read ahead starts small and
+    grows while the file keeps being read in order, up to the limit set here.
+    The limit is also never more than half of the cluster cache.
+
+    \param  mp          The mount point of the filesystem.
+    \param  clusters    The most clusters to read ahead at once, or 0 to turn
+                        read-ahead off. The default is BCACHE_RA_DEFAULT.
+    \retval 0           On success.
+    \retval -1          On error (errno will be ENOENT if nothing is mounted
+                        at mp).
+*/
+int fs_fat_set_readahead(const char *mp, size_t clusters);
+
+/** \brief  Retrieve the cluster cache statistics for a FAT filesystem.
+
+    Among other things, this reports how many clusters have been read ahead
+    and how many of them were then actually used.
+
+    \param  mp          The mount point of the filesystem.
+    \param  stats       Storage for the statistics.
+    \retval 0           On success.
+    \retval -1          On error (errno will be ENOENT if nothing is mounted
+                        at mp).
+*/
+int fs_fat_cache_stats(const char *mp, bcache_stats_t *stats);
+
 __END_DECLS
 #endif /* !__FAT_FS_FAT_H */
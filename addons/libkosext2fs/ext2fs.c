@@ -21,6 +21,45 @@
 
 static int initted = 0;
 
+#ifndef EXT2_NOT_IN_KOS
+static int ext2_bcache_read(void *d, uint64_t block, size_t count,
+                            void *buf) {
+    ext2_fs_t *fs = (ext2_fs_t *)d;
+    int fs_per_block = fs->sb.s_log_block_size - fs->dev->l_block_size + 10;
+
+    if(fs_per_block < 0 || fs->sb.s_blocks_count < block + count)
+        return -EINVAL;
+
+    if(fs->dev->read_blocks(fs->dev, block << fs_per_block,
+                            count << fs_per_block, buf))
+        return -EIO;
+
+    return 0;
+}
+
+static int ext2_bcache_write(void *d, uint64_t block, const void *buf) {
+    return ext2_block_write_nc((ext2_fs_t *)d, (uint32_t)block,
+                               (const uint8_t *)buf);
+}
+
+static const bcache_ops_t ext2_bcache_ops = {
+    ext2_bcache_read,
+    ext2_bcache_write
+};
+
+/* Released right away; the data is good until evicted (see kos/bcache.h). */
+uint8_t *ext2_block_read(ext2_fs_t *fs, uint32_t bl, int *err) {
+    bcache_buf_t *b;
+
+    if(!(b = bcache_read(fs->bcache, bl))) {
+        *err = errno;
+        return NULL;
+    }
+
+    bcache_release(fs->bcache, b);
+    return b->data;
+}
+#else
 /* This is basically the same as bgrad_cache from fs_iso9660 */
 static void make_mru(ext2_fs_t *fs, ext2_cache_t **cache, int block) {
     int i;
@@ -86,6 +125,7 @@ uint8_t *ext2_block_read(ext2_fs_t *fs, uint32_t bl, int *err) {
 out:
     return rv;
 }
+#endif /* EXT2_NOT_IN_KOS */
 
 int ext2_block_read_nc(ext2_fs_t *fs, uint32_t block_num, uint8_t *rv) {
     int fs_per_block = fs->sb.s_log_block_size - fs->dev->l_block_size + 10;
@@ -123,6 +163,49 @@ int ext2_block_write_nc(ext2_fs_t *fs, uint32_t block_num, const uint8_t *blk) {
     return 0;
 }
 
+#ifndef EXT2_NOT_IN_KOS
+int ext2_block_mark_dirty(ext2_fs_t *fs, uint32_t block_num) {
+    bcache_buf_t *b;
+
+    if(!(b = bcache_lookup(fs->bcache, block_num)))
+        return -EINVAL;
+
+    bcache_mark_dirty(fs->bcache, b);
+    bcache_release(fs->bcache, b);
+    return 0;
+}
+
+int ext2_block_cache_wb(ext2_fs_t *fs) {
+    /* Don't even bother if we're mounted read-only. */
+    if(!(fs->mnt_flags & EXT2FS_MNT_FLAG_RW))
+        return 0;
+
+    if(bcache_sync(fs->bcache))
+        return -EIO;
+
+    return 0;
+}
+
+int ext2_block_read_direct(ext2_fs_t *fs, uint32_t block_num, size_t count,
+                           uint8_t *buf) {
+    if(bcache_read_direct(fs->bcache, block_num, count, buf))
+        return -EIO;
+
+    return 0;
+}
+
+size_t ext2_fs_shrink_cache(ext2_fs_t *fs, size_t want) {
+    return bcache_shrink(fs->bcache, want);
+}
+
+void ext2_fs_set_readahead(ext2_fs_t *fs, size_t blocks) {
+    bcache_set_readahead(fs->bcache, blocks);
+}
+
+int ext2_fs_cache_stats(ext2_fs_t *fs, bcache_stats_t *stats) {
+    return bcache_get_stats(fs->bcache, stats);
+}
+#else
 int ext2_block_mark_dirty(ext2_fs_t *fs, uint32_t block_num) {
     int i;
     ext2_cache_t **cache = fs->bcache;
@@ -159,6 +242,7 @@ int ext2_block_cache_wb(ext2_fs_t *fs) {
     
     return 0;
 }
+#endif /* EXT2_NOT_IN_KOS */
 
 uint8_t *ext2_block_alloc(ext2_fs_t *fs, uint32_t bg, uint32_t *bn, int *err) {
     uint8_t *buf, *blk;
@@ -274,8 +358,10 @@ ext2_fs_t *ext2_fs_init(kos_blockdev_t *bd, uint32_t flags) {
 ext2_fs_t *ext2_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz) {
     ext2_fs_t *rv;
     uint32_t bc;
-    int j;
     int block_size;
+#ifdef EXT2_NOT_IN_KOS
+    int j;
+#endif
 
 #ifdef EXT2FS_DEBUG
     uint32_t tmp;
@@ -409,6 +495,17 @@ ext2_fs_t *ext2_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz) {
 #endif /* EXT2FS_DEBUG */
 
     /* Make space for the block cache. */
+#ifndef EXT2_NOT_IN_KOS
+    if(!(rv->bcache = bcache_create(bd, block_size, cache_sz, &ext2_bcache_ops,
+                                    rv))) {
+        free(rv->bg);
+        free(rv);
+        bd->shutdown(bd);
+        return NULL;
+    }
+
+    return rv;
+#else
     if(!(rv->bcache = (ext2_cache_t **)malloc(sizeof(ext2_cache_t *) *
                                               cache_sz))) {
         free(rv->bg);
@@ -449,6 +546,7 @@ out_cache:
     free(rv);
     bd->shutdown(bd);
     return NULL;
+#endif /* EXT2_NOT_IN_KOS */
 }
 
 int ext2_fs_sync(ext2_fs_t *fs) {
@@ -499,17 +597,23 @@ int ext2_fs_sync(ext2_fs_t *fs) {
 }
 
 void ext2_fs_shutdown(ext2_fs_t *fs) {
+#ifdef EXT2_NOT_IN_KOS
     int i;
+#endif
 
     /* Sync the filesystem back to the block device, if needed. */
     ext2_fs_sync(fs);
 
+#ifndef EXT2_NOT_IN_KOS
+    bcache_destroy(fs->bcache);
+#else
     for(i = 0; i < fs->cache_size; ++i) {
         free(fs->bcache[i]->data);
         free(fs->bcache[i]);
     }
 
     free(fs->bcache);
+#endif
     fs->dev->shutdown(fs->dev);
     free(fs->bg);
     free(fs);
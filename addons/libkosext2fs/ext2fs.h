@@ -14,6 +14,7 @@ __BEGIN_DECLS
 
 #ifndef EXT2_NOT_IN_KOS
 #include <kos/blockdev.h>
+#include <kos/bcache.h>
 #endif
 
 /* Tunable filesystem parameters. These must be set at compile time. */
@@ -44,6 +45,9 @@ __BEGIN_DECLS
    this to 32 should work well enough, but if you have more memory to spare,
    feel free to set it larger.
 
+   In KOS, buffers for the cache are only allocated as they are needed, and
+   clean ones are given back when memory runs low.
+
    Note that this is a default value for filesystems initialized/mounted with
    ext2_fs_init(). If you wish to specify your own value that differs from this
    one, you can do so with the ext2_fs_init_ex() function.
@@ -108,6 +112,22 @@ int ext2_block_mark_dirty(ext2_fs_t *fs, uint32_t block_num);
    call the corresponding inode function before this one. */
 int ext2_block_cache_wb(ext2_fs_t *fs);
 
+#ifndef EXT2_NOT_IN_KOS
+/* Read a run of consecutive blocks straight into buf, bypassing the cache (but
+   still seeing any dirty blocks in it). Returns 0 or a negative error code. */
+int ext2_block_read_direct(ext2_fs_t *fs, uint32_t block_num, size_t count,
+                           uint8_t *buf);
+
+/* Free clean, unused blocks from the filesystem's cache, least recently used
+   first. Returns the number of bytes freed. */
+size_t ext2_fs_shrink_cache(ext2_fs_t *fs, size_t want);
+
+/* Set the most blocks to read ahead when a file is read sequentially (0 turns
+   read-ahead off), and fetch the block cache's statistics. */
+void ext2_fs_set_readahead(ext2_fs_t *fs, size_t blocks);
+int ext2_fs_cache_stats(ext2_fs_t *fs, bcache_stats_t *stats);
+#endif
+
 uint8_t *ext2_block_alloc(ext2_fs_t *fs, uint32_t bg, uint32_t *bn, int *err);
 
 __END_DECLS
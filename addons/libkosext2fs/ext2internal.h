@@ -9,6 +9,7 @@
 
 #ifndef EXT2_NOT_IN_KOS
 #include <kos/blockdev.h>
+#include <kos/bcache.h>
 #else
 #include "ext2fs.h"
 #endif
@@ -16,6 +17,7 @@
 #ifndef __EXT2_EXT2INTERNAL_H
 #define __EXT2_EXT2INTERNAL_H
 
+#ifdef EXT2_NOT_IN_KOS
 #define EXT2_CACHE_FLAG_VALID   1
 #define EXT2_CACHE_FLAG_DIRTY   2
 
@@ -24,6 +26,7 @@ typedef struct ext2_cache {
     uint32_t block;
     uint8_t *data;
 } ext2_cache_t;
+#endif
 
 struct ext2fs_struct {
     kos_blockdev_t *dev;
@@ -33,8 +36,12 @@ struct ext2fs_struct {
     uint32_t bg_count;
     ext2_bg_desc_t *bg;
 
+#ifndef EXT2_NOT_IN_KOS
+    bcache_t *bcache;
+#else
     ext2_cache_t **bcache;
     int cache_size;
+#endif
 
     uint32_t flags;
     uint32_t mnt_flags;
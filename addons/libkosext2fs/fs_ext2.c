@@ -15,6 +15,8 @@
 
 #include <kos/fs.h>
 #include <kos/mutex.h>
+#include <kos/lockprof.h>
+#include <kos/shrinker.h>
 #include <kos/dbglog.h>
 
 #include <ext2/fs_ext2.h>
@@ -52,6 +54,7 @@ static struct {
     dirent_t dent;
     ext2_inode_t *inode;
     fs_ext2_fs_t *fs;
+    bcache_ra_t ra;
 } fh[MAX_EXT2_FILES];
 
 static int create_empty_file(fs_ext2_fs_t *fs, const char *fn,
@@ -220,6 +223,7 @@ created:
     fh[fd].mode = mode;
     fh[fd].ptr = 0;
     fh[fd].fs = mnt;
+    bcache_ra_init(&fh[fd].ra);
 
     mutex_unlock(&ext2_mutex);
 
@@ -244,7 +248,7 @@ static int fs_ext2_close(void *h) {
 static ssize_t fs_ext2_read(void *h, void *buf, size_t cnt) {
     file_t fd = ((file_t)h) - 1;
     ext2_fs_t *fs;
-    uint32_t bs, lbs, bo;
+    uint32_t bs, lbs, bo, bn, pb, nb, n;
     uint8_t *block;
     uint8_t *bbuf = (uint8_t *)buf;
     ssize_t rv;
@@ -288,6 +292,8 @@ static ssize_t fs_ext2_read(void *h, void *buf, size_t cnt) {
 
     /* Handle the first block specially if we are offset within it. */
     if(bo) {
+        ext2_inode_readahead(fs, fh[fd].inode, &fh[fd].ra, fh[fd].ptr >> lbs);
+
         if(!(block = ext2_inode_read_block(fs, fh[fd].inode, fh[fd].ptr >> lbs,
                                            NULL, &errno))) {
             mutex_unlock(&ext2_mutex);
@@ -309,6 +315,36 @@ static ssize_t fs_ext2_read(void *h, void *buf, size_t cnt) {
 
     /* While we still have more to read, do it. */
     while(cnt) {
+        bn = (uint32_t)(fh[fd].ptr >> lbs);
+
+        /* If there's a run of blocks that are next to each other on the device
+           and all wanted in full, read them straight into the caller's
+           buffer in one go, rather than a block at a time through the cache.
+           Holes in sparse files go through the normal path. */
+        if(cnt >= bs * 2 && !ext2_inode_block_num(fs, fh[fd].inode, bn, &pb) &&
+           pb) {
+            for(n = 1; n < (cnt >> lbs); ++n) {
+                if(ext2_inode_block_num(fs, fh[fd].inode, bn + n, &nb) ||
+                   nb != pb + n)
+                    break;
+            }
+
+            if(n > 1) {
+                if((mode = ext2_block_read_direct(fs, pb, n, bbuf))) {
+                    mutex_unlock(&ext2_mutex);
+                    errno = -mode;
+                    return -1;
+                }
+
+                fh[fd].ptr += (uint64_t)n << lbs;
+                cnt -= (size_t)n << lbs;
+                bbuf += (size_t)n << lbs;
+                continue;
+            }
+        }
+
+        ext2_inode_readahead(fs, fh[fd].inode, &fh[fd].ra, fh[fd].ptr >> lbs);
+
         if(!(block = ext2_inode_read_block(fs, fh[fd].inode, fh[fd].ptr >> lbs,
                                            NULL, &errno))) {
             mutex_unlock(&ext2_mutex);
@@ -2030,16 +2066,89 @@ int fs_ext2_sync(const char *mp) {
     return rv;
 }
 
+static fs_ext2_fs_t *fs_ext2_find(const char *mp) {
+    fs_ext2_fs_t *i;
+
+    LIST_FOREACH(i, &ext2_fses, entry) {
+        if(!strcmp(mp, i->vfsh->nmmgr.pathname))
+            return i;
+    }
+
+    errno = ENOENT;
+    return NULL;
+}
+
+int fs_ext2_set_readahead(const char *mp, size_t blocks) {
+    fs_ext2_fs_t *i;
+
+    mutex_lock(&ext2_mutex);
+
+    if(!(i = fs_ext2_find(mp))) {
+        mutex_unlock(&ext2_mutex);
+        return -1;
+    }
+
+    ext2_fs_set_readahead(i->fs, blocks);
+    mutex_unlock(&ext2_mutex);
+    return 0;
+}
+
+int fs_ext2_cache_stats(const char *mp, bcache_stats_t *stats) {
+    fs_ext2_fs_t *i;
+
+    mutex_lock(&ext2_mutex);
+
+    if(!(i = fs_ext2_find(mp))) {
+        mutex_unlock(&ext2_mutex);
+        return -1;
+    }
+
+    ext2_fs_cache_stats(i->fs, stats);
+    mutex_unlock(&ext2_mutex);
+    return 0;
+}
+
+/* Give back clean blocks from the mounted filesystems' caches. */
+static size_t ext2_shrink(size_t want, void *data) {
+    fs_ext2_fs_t *i;
+    size_t rv = 0;
+
+    (void)data;
+
+    if(mutex_trylock(&ext2_mutex))
+        return 0;
+
+    LIST_FOREACH(i, &ext2_fses, entry) {
+        rv += ext2_fs_shrink_cache(i->fs, want - rv);
+
+        if(rv >= want)
+            break;
+    }
+
+    mutex_unlock(&ext2_mutex);
+
+    return rv;
+}
+
+static shrinker_t ext2_shrinker = {
+    .name = "ext2",
+    .priority = SHRINKER_PRIO_CACHE,
+    .shrink = ext2_shrink
+};
+
 int fs_ext2_init(void) {
     if(initted)
         return 0;
 
     LIST_INIT(&ext2_fses);
     mutex_init(&ext2_mutex, MUTEX_TYPE_NORMAL);
+    lockprof_set_name(&ext2_mutex, "ext2_mutex");
     initted = 1;
 
     memset(fh, 0, sizeof(fh));
 
+    shrinker_register(&ext2_shrinker);
+
     return 0;
 }
 
@@ -2049,6 +2158,8 @@ int fs_ext2_shutdown(void) {
     if(!initted)
         return 0;
 
+    shrinker_unregister(&ext2_shrinker);
+
     /* Clean up the mounted filesystems */
     i = LIST_FIRST(&ext2_fses);
     while(i) {
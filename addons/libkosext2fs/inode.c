@@ -1275,12 +1275,12 @@ next_token:
     return 0;
 }
 
-uint8_t *ext2_inode_read_block(ext2_fs_t *fs, const ext2_inode_t *inode,
-                               uint32_t block_num, uint32_t *r_block,
-                               int *err) {
+int ext2_inode_block_num(ext2_fs_t *fs, const ext2_inode_t *inode,
+                         uint32_t block_num, uint32_t *r_block) {
     uint32_t blks_per_ind, ibn;
     uint32_t *iblock;
     int shift = 1 + fs->sb.s_log_block_size;
+    int err;
     uint64_t sz;
 
     /* Grab the size */
@@ -1290,17 +1290,13 @@ uint8_t *ext2_inode_read_block(ext2_fs_t *fs, const ext2_inode_t *inode,
         sz = (uint64_t)inode->i_size;
 
     /* Check to be sure we're not being asked to do something stupid... */
-    if((block_num << (shift + 9)) >= sz) {
-        *err = EINVAL;
-        return NULL;
-    }
+    if(((uint64_t)block_num << (shift + 9)) >= sz)
+        return -EINVAL;
 
     /* If we're reading a direct block, this is easy. */
     if(block_num < 12) {
-        if(r_block)
-            *r_block = inode->i_block[block_num];
-
-        return ext2_block_read(fs, inode->i_block[block_num], err);
+        *r_block = inode->i_block[block_num];
+        return 0;
     }
 
     blks_per_ind = fs->block_size >> 2;
@@ -1308,64 +1304,102 @@ uint8_t *ext2_inode_read_block(ext2_fs_t *fs, const ext2_inode_t *inode,
 
     /* Are we looking at the singly-indirect block? */
     if(block_num < blks_per_ind) {
-        if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[12], err)))
-            return NULL;
-
-        if(r_block)
-            *r_block = iblock[block_num];
+        if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[12], &err)))
+            return -err;
 
-        return ext2_block_read(fs, iblock[block_num], err);
+        *r_block = iblock[block_num];
+        return 0;
     }
 
     /* Ok, we're looking at at least a doubly-indirect block... */
     block_num -= blks_per_ind;
     if(block_num < (blks_per_ind * blks_per_ind)) {
-        if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[13], err)))
-            return NULL;
+        if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[13], &err)))
+            return -err;
 
         /* Figure out what entry we want in here... */
         ibn = block_num / blks_per_ind;
         block_num %= blks_per_ind;
 
-        if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], err)))
-            return NULL;
+        if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], &err)))
+            return -err;
 
         /* Ok... Now we should be good to go. */
-        if(r_block)
-            *r_block = iblock[block_num];
-
-        return ext2_block_read(fs, iblock[block_num], err);
+        *r_block = iblock[block_num];
+        return 0;
     }
 
     /* Ugh... You're going to make me look at a triply-indirect block now? */
     block_num -= blks_per_ind * blks_per_ind;
-    if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[14], err)))
-        return NULL;
+    if(!(iblock = (uint32_t *)ext2_block_read(fs, inode->i_block[14], &err)))
+        return -err;
 
     /* Figure out what entry we want in here... */
     ibn = block_num / blks_per_ind;
     block_num %= blks_per_ind;
 
-    if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], err)))
-        return NULL;
+    if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], &err)))
+        return -err;
 
     /* And in this one too... */
     ibn = block_num / blks_per_ind;
     block_num %= blks_per_ind;
 
-    if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], err)))
-        return NULL;
+    if(!(iblock = (uint32_t *)ext2_block_read(fs, iblock[ibn], &err)))
+        return -err;
 
     /* Ok... Now we should be good to go. Finally. */
     if(block_num < blks_per_ind) {
-        if(r_block)
-            *r_block = iblock[block_num];
-
-        return ext2_block_read(fs, iblock[block_num], err);
+        *r_block = iblock[block_num];
+        return 0;
     }
-    else {
-        /* This really shouldn't happen... */
-        *err = EIO;
+
+    /* This really shouldn't happen... */
+    return -EIO;
+}
+
+uint8_t *ext2_inode_read_block(ext2_fs_t *fs, const ext2_inode_t *inode,
+                               uint32_t block_num, uint32_t *r_block,
+                               int *err) {
+    uint32_t bn;
+    int rv;
+
+    if((rv = ext2_inode_block_num(fs, inode, block_num, &bn))) {
+        *err = -rv;
         return NULL;
     }
+
+    if(r_block)
+        *r_block = bn;
+
+    return ext2_block_read(fs, bn, err);
+}
+
+#ifndef EXT2_NOT_IN_KOS
+typedef struct ra_map {
+    ext2_fs_t *fs;
+    const ext2_inode_t *inode;
+} ra_map_t;
+
+static int ra_map(void *d, uint64_t fblock, uint64_t *block) {
+    ra_map_t *m = (ra_map_t *)d;
+    uint32_t bn;
+
+    /* Don't read ahead into holes in sparse files. */
+    if(ext2_inode_block_num(m->fs, m->inode, (uint32_t)fblock, &bn) || !bn)
+        return -1;
+
+    *block = bn;
+    return 0;
+}
+
+void ext2_inode_readahead(ext2_fs_t *fs, const ext2_inode_t *inode,
+                          bcache_ra_t *ra, uint32_t block_num) {
+    ra_map_t m = { fs, inode };
+    uint64_t nblocks;
+
+    nblocks = (ext2_inode_size(inode) + fs->block_size - 1) >>
+        (fs->sb.s_log_block_size + 10);
+    bcache_readahead(fs->bcache, ra, block_num, nblocks, ra_map, &m);
 }
+#endif /* EXT2_NOT_IN_KOS */
@@ -158,6 +158,18 @@ uint8_t *ext2_inode_read_block(ext2_fs_t *fs, const ext2_inode_t *inode,
                                uint32_t block_num, uint32_t *r_block,
                                int *err);
 
+/* Look up which filesystem block holds a given block of an inode, without
+   reading it. Returns 0 on success or a negative error code. */
+int ext2_inode_block_num(ext2_fs_t *fs, const ext2_inode_t *inode,
+                         uint32_t block_num, uint32_t *r_block);
+
+#ifndef EXT2_NOT_IN_KOS
+/* Read ahead in the block cache if the inode's data is being read in order.
+   Call this before reading each block with ext2_inode_read_block(). */
+void ext2_inode_readahead(ext2_fs_t *fs, const ext2_inode_t *inode,
+                          bcache_ra_t *ra, uint32_t block_num);
+#endif
+
 /* In symlink.c */
 int ext2_resolve_symlink(ext2_fs_t *fs, ext2_inode_t *inode, char *rv,
                          size_t *rv_len);
@@ -14,26 +14,6 @@
 #include "fatfs.h"
 #include "fatinternal.h"
 
-/* This is basically the same as bgrad_cache from fs_iso9660 */
-static void make_mru(fat_fs_t *fs, fat_cache_t **cache, int block) {
-    int i;
-    fat_cache_t *tmp;
-
-    /* Don't try it with the end block */
-    if(block < 0 || block >= fs->cache_size - 1)
-        return;
-
-    /* Make a copy and scoot everything down */
-    tmp = cache[block];
-
-    for(i = block; i < fs->cache_size - 1; ++i) {
-        cache[i] = cache[i + 1];
-    }
-
-    cache[fs->cache_size - 1] = tmp;
-}
-
-
 static int fat_fatblock_read_nc(fat_fs_t *fs, uint32_t bn, uint8_t *rv) {
     if(fs->sb.fat_size <= bn)
         return -EINVAL;
@@ -55,86 +35,63 @@ static int fat_fatblock_write_nc(fat_fs_t *fs, uint32_t bn,
     return 0;
 }
 
-static uint8_t *fat_read_fatblock(fat_fs_t *fs, uint32_t block, int *err) {
-    int i;
-    uint8_t *rv;
-    fat_cache_t **cache = fs->fcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->fcache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == block && cache[i]->flags) {
-            rv = cache[i]->data;
-            make_mru(fs, cache, i);
-            goto out;
-        }
-    }
+static int fat_fatblock_read(void *d, uint64_t block, size_t count,
+                             void *buf) {
+    fat_fs_t *fs = (fat_fs_t *)d;
 
-    /* If we didn't get anything, did we end up with an invalid entry or do we
-       need to boot someone out? */
-    if(i < 0) {
-        i = 0;
-
-        /* Make sure that if the block is dirty, we write it back out. */
-        if(cache[0]->flags & FAT_CACHE_FLAG_DIRTY) {
-            if(fat_fatblock_write_nc(fs, cache[0]->block, cache[0]->data)) {
-                /* XXXX: Uh oh... */
-                *err = EIO;
-                return NULL;
-            }
-        }
-    }
+    if(count == 1)
+        return fat_fatblock_read_nc(fs, (uint32_t)block, (uint8_t *)buf);
+
+    if(fs->sb.fat_size < block + count)
+        return -EINVAL;
+
+    if(fs->dev->read_blocks(fs->dev, block, count, buf))
+        return -EIO;
+
+    return 0;
+}
+
+static int fat_fatblock_write(void *d, uint64_t block, const void *buf) {
+    return fat_fatblock_write_nc((fat_fs_t *)d, (uint32_t)block,
+                                 (const uint8_t *)buf);
+}
+
+const bcache_ops_t fat_fatblock_ops = {
+    fat_fatblock_read,
+    fat_fatblock_write
+};
 
-    /* Try to read the block in question. */
-    if(fat_fatblock_read_nc(fs, block, cache[i]->data)) {
-        *err = EIO;
-        cache[i]->flags = 0;            /* Mark it as invalid... */
+/* Released right away; the data is good until evicted (see kos/bcache.h). */
+static uint8_t *fat_read_fatblock(fat_fs_t *fs, uint32_t block, int *err) {
+    bcache_buf_t *b;
+
+    if(!(b = bcache_read(fs->fcache, block))) {
+        *err = errno;
         return NULL;
     }
 
-    cache[i]->block = block;
-    cache[i]->flags = FAT_CACHE_FLAG_VALID;
-    rv = cache[i]->data;
-    make_mru(fs, cache, i);
-
-out:
-    return rv;
+    bcache_release(fs->fcache, b);
+    return b->data;
 }
 
 static int fat_fatblock_mark_dirty(fat_fs_t *fs, uint32_t bn) {
-    int i;
-    fat_cache_t **cache = fs->fcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->fcache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == bn && cache[i]->flags) {
-            cache[i]->flags |= FAT_CACHE_FLAG_DIRTY;
-            make_mru(fs, cache, i);
-            return 0;
-        }
-    }
+    bcache_buf_t *b;
 
-    return -EINVAL;
+    if(!(b = bcache_lookup(fs->fcache, bn)))
+        return -EINVAL;
+
+    bcache_mark_dirty(fs->fcache, b);
+    bcache_release(fs->fcache, b);
+    return 0;
 }
 
 int fat_fatblock_cache_wb(fat_fs_t *fs) {
-    int i, err;
-    fat_cache_t **cache = fs->fcache;
-
     /* Don't even bother if we're mounted read-only. */
     if(!(fs->mnt_flags & FAT_MNT_FLAG_RW))
         return 0;
 
-    for(i = fs->fcache_size - 1; i >= 0; --i) {
-        if(cache[i]->flags & FAT_CACHE_FLAG_DIRTY) {
-            if((err = fat_fatblock_write_nc(fs, cache[i]->block,
-                                            cache[i]->data)))
-                return err;
-
-            cache[i]->flags &= ~FAT_CACHE_FLAG_DIRTY;
-        }
-    }
+    if(bcache_sync(fs->fcache))
+        return -EIO;
 
     return 0;
 }
@@ -15,112 +15,78 @@
 #include "bpb.h"
 #include "fatinternal.h"
 
-/* This is basically the same as bgrad_cache from fs_iso9660 */
-static void make_mru(fat_fs_t *fs, fat_cache_t **cache, int block) {
-    int i;
-    fat_cache_t *tmp;
+static int fat_cluster_bread(void *d, uint64_t block, size_t count,
+                             void *buf) {
+    fat_fs_t *fs = (fat_fs_t *)d;
+    uint32_t cl = (uint32_t)block;
+    uint32_t fs_per_block = fs->sb.sectors_per_cluster;
+    uint8_t *bbuf = (uint8_t *)buf;
+    size_t i;
+    int rv;
+
+    /* Raw blocks from the FAT12/FAT16 root directory are only one sector each,
+       so they can't be read in as one run of clusters. */
+    if(count == 1 || (cl & 0x80000000 && fs->sb.fs_type != FAT_FS_FAT32)) {
+        for(i = 0; i < count; ++i) {
+            if((rv = fat_cluster_read_nc(fs, cl + i, bbuf)))
+                return rv;
+
+            bbuf += fs->sb.bytes_per_sector * fs_per_block;
+        }
 
-    /* Don't try it with the end block */
-    if(block < 0 || block >= fs->cache_size - 1)
-        return;
+        return 0;
+    }
 
-    /* Make a copy and scoot everything down */
-    tmp = cache[block];
+    if(fs->sb.num_clusters + 2 < cl + count || cl < 2)
+        return -EINVAL;
 
-    for(i = block; i < fs->cache_size - 1; ++i) {
-        cache[i] = cache[i + 1];
-    }
+    if(fs->dev->read_blocks(fs->dev, (cl - 2) * fs_per_block +
+                            fs->sb.first_data_block, count * fs_per_block,
+                            buf))
+        return -EIO;
 
-    cache[fs->cache_size - 1] = tmp;
+    return 0;
 }
 
-/* XXXX: This needs locking! */
-uint8_t *fat_cluster_read(fat_fs_t *fs, uint32_t cl, int *err) {
-    int i;
-    uint8_t *rv;
-    fat_cache_t **cache = fs->bcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == cl && cache[i]->flags) {
-            rv = cache[i]->data;
-            make_mru(fs, cache, i);
-            goto out;
-        }
-    }
+static int fat_cluster_bwrite(void *d, uint64_t block, const void *buf) {
+    return fat_cluster_write_nc((fat_fs_t *)d, (uint32_t)block,
+                                (const uint8_t *)buf);
+}
 
-    /* If we didn't get anything, did we end up with an invalid entry or do we
-       need to boot someone out? */
-    if(i < 0) {
-        i = 0;
-
-        /* Make sure that if the block is dirty, we write it back out. */
-        if(cache[0]->flags & FAT_CACHE_FLAG_DIRTY) {
-            if(fat_cluster_write_nc(fs, cache[0]->block, cache[0]->data)) {
-                /* XXXX: Uh oh... */
-                *err = EIO;
-                return NULL;
-            }
-        }
-    }
+/* Clusters go through these rather than straight to the device, since the
+   FAT12/FAT16 root directory is read a raw block at a time. */
+static const bcache_ops_t fat_cluster_ops = {
+    fat_cluster_bread,
+    fat_cluster_bwrite
+};
 
-    /* Try to read the block in question. */
-    if(fat_cluster_read_nc(fs, cl, cache[i]->data)) {
-        *err = EIO;
-        cache[i]->flags = 0;            /* Mark it as invalid... */
+/* Released right away; the data is good until evicted (see kos/bcache.h). */
+uint8_t *fat_cluster_read(fat_fs_t *fs, uint32_t cl, int *err) {
+    bcache_buf_t *b;
+
+    if(!(b = bcache_read(fs->bcache, cl))) {
+        *err = errno;
         return NULL;
     }
 
-    cache[i]->block = cl;
-    cache[i]->flags = FAT_CACHE_FLAG_VALID;
-    rv = cache[i]->data;
-    make_mru(fs, cache, i);
-
-out:
-    return rv;
+    bcache_release(fs->bcache, b);
+    return b->data;
 }
 
 uint8_t *fat_cluster_clear(fat_fs_t *fs, uint32_t cl, int *err) {
-    int i;
-    uint8_t *rv;
-    fat_cache_t **cache = fs->bcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == cl && cache[i]->flags) {
-            rv = cache[i]->data;
-            make_mru(fs, cache, i);
-            goto out;
-        }
-    }
-
-    /* If we didn't get anything, did we end up with an invalid entry or do we
-       need to boot someone out? */
-    if(i < 0) {
-        i = 0;
-
-        /* Make sure that if the block is dirty, we write it back out. */
-        if(cache[0]->flags & FAT_CACHE_FLAG_DIRTY) {
-            if(fat_cluster_write_nc(fs, cache[0]->block, cache[0]->data)) {
-                /* XXXX: Uh oh... */
-                *err = EIO;
-                return NULL;
-            }
-        }
-    }
+    bcache_buf_t *b;
 
     /* Don't bother reading the cluster from disk, since we're erasing it
        anyway... */
-    cache[i]->block = cl;
-    cache[i]->flags = FAT_CACHE_FLAG_VALID | FAT_CACHE_FLAG_DIRTY;
-    rv = cache[i]->data;
-    make_mru(fs, cache, i);
+    if(!(b = bcache_get(fs->bcache, cl))) {
+        *err = errno;
+        return NULL;
+    }
 
-out:
-    memset(rv, 0, fs->sb.bytes_per_sector * fs->sb.sectors_per_cluster);
-    return rv;
+    memset(b->data, 0, fs->sb.bytes_per_sector * fs->sb.sectors_per_cluster);
+    bcache_mark_dirty(fs->bcache, b);
+    bcache_release(fs->bcache, b);
+    return b->data;
 }
 
 int fat_cluster_read_nc(fat_fs_t *fs, uint32_t cluster, uint8_t *rv) {
@@ -180,43 +146,92 @@ int fat_cluster_write_nc(fat_fs_t *fs, uint32_t cluster, const uint8_t *blk) {
 }
 
 int fat_cluster_mark_dirty(fat_fs_t *fs, uint32_t cluster) {
-    int i;
-    fat_cache_t **cache = fs->bcache;
-
-    /* Look through the cache from the most recently used to the least recently
-       used entry. */
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->block == cluster && cache[i]->flags) {
-            cache[i]->flags |= FAT_CACHE_FLAG_DIRTY;
-            make_mru(fs, cache, i);
-            return 0;
-        }
-    }
+    bcache_buf_t *b;
 
-    return -EINVAL;
+    if(!(b = bcache_lookup(fs->bcache, cluster)))
+        return -EINVAL;
+
+    bcache_mark_dirty(fs->bcache, b);
+    bcache_release(fs->bcache, b);
+    return 0;
 }
 
 int fat_cluster_cache_wb(fat_fs_t *fs) {
-    int i, err;
-    fat_cache_t **cache = fs->bcache;
-
     /* Don't even bother if we're mounted read-only. */
     if(!(fs->mnt_flags & FAT_MNT_FLAG_RW))
         return 0;
 
-    for(i = fs->cache_size - 1; i >= 0; --i) {
-        if(cache[i]->flags & FAT_CACHE_FLAG_DIRTY) {
-            if((err = fat_cluster_write_nc(fs, cache[i]->block,
-                                           cache[i]->data)))
-                return err;
+    if(bcache_sync(fs->bcache))
+        return -EIO;
 
-            cache[i]->flags &= ~FAT_CACHE_FLAG_DIRTY;
-        }
+    return 0;
+}
+
+typedef struct ra_map {
+    fat_fs_t *fs;
+    uint32_t order;
+    uint32_t cluster;
+} ra_map_t;
+
+/* bcache_readahead() asks for clusters in increasing order, so this only ever
+   has to walk forward along the chain from the last one it found. */
+static int ra_map(void *d, uint64_t fblock, uint64_t *block) {
+    ra_map_t *m = (ra_map_t *)d;
+    uint32_t cl;
+    int err;
+
+    if(fblock < m->order)
+        return -1;
+
+    while(m->order < fblock) {
+        cl = fat_read_fat(m->fs, m->cluster, &err);
+
+        if(cl == FAT_INVALID_CLUSTER || fat_is_eof(m->fs, cl))
+            return -1;
+
+        m->cluster = cl;
+        ++m->order;
     }
 
+    *block = m->cluster;
     return 0;
 }
 
+void fat_cluster_readahead(fat_fs_t *fs, bcache_ra_t *ra, uint32_t order,
+                           uint32_t cluster, uint32_t nclusters) {
+    ra_map_t m = { fs, order, cluster };
+
+    bcache_readahead(fs->bcache, ra, order, nclusters, ra_map, &m);
+}
+
+int fat_cluster_read_direct(fat_fs_t *fs, uint32_t cl, size_t count,
+                            uint8_t *buf) {
+    if(bcache_read_direct(fs->bcache, cl, count, buf))
+        return -EIO;
+
+    return 0;
+}
+
+void fat_fs_set_readahead(fat_fs_t *fs, size_t clusters) {
+    bcache_set_readahead(fs->bcache, clusters);
+}
+
+int fat_fs_cache_stats(fat_fs_t *fs, bcache_stats_t *stats) {
+    return bcache_get_stats(fs->bcache, stats);
+}
+
+size_t fat_fs_shrink_cache(fat_fs_t *fs, size_t want) {
+    size_t rv;
+
+    /* Clusters are bigger and cheaper to get back than FAT blocks. */
+    rv = bcache_shrink(fs->bcache, want);
+
+    if(rv < want)
+        rv += bcache_shrink(fs->fcache, want - rv);
+
+    return rv;
+}
+
 static inline uint32_t ilog2(uint32_t i) {
     i |= (i >> 1);
     i |= (i >> 2);
@@ -264,7 +279,6 @@ fat_fs_t *fat_fs_init(kos_blockdev_t *bd, uint32_t flags) {
 fat_fs_t *fat_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz,
                          int fcache_sz) {
     fat_fs_t *rv;
-    int j;
     int block_size, cluster_size;
 
     if(bd->init(bd)) {
@@ -301,81 +315,23 @@ fat_fs_t *fat_fs_init_ex(kos_blockdev_t *bd, uint32_t flags, int cache_sz,
     cluster_size = rv->sb.bytes_per_sector * rv->sb.sectors_per_cluster;
 
     /* Make space for the block cache. */
-    if(!(rv->bcache = (fat_cache_t **)malloc(sizeof(fat_cache_t *) *
-                                             cache_sz))) {
+    if(!(rv->bcache = bcache_create(bd, cluster_size, cache_sz,
+                                    &fat_cluster_ops, rv))) {
         free(rv);
         bd->shutdown(bd);
         return NULL;
     }
 
-    for(j = 0; j < cache_sz; ++j) {
-        if(!(rv->bcache[j] = (fat_cache_t *)malloc(sizeof(fat_cache_t)))) {
-            goto out_cache;
-        }
-    }
-
-    for(j = 0; j < cache_sz; ++j) {
-        if(!(rv->bcache[j]->data = (uint8_t *)malloc(cluster_size))) {
-            goto out_bcache;
-        }
-
-        rv->bcache[j]->flags = 0;
-    }
-
-    rv->cache_size = cache_sz;
-
     /* Make space for the FAT block cache. */
-    if(!(rv->fcache = (fat_cache_t **)malloc(sizeof(fat_cache_t *) *
-                                             fcache_sz))) {
-        goto out_bcache;
-    }
-
-    for(j = 0; j < fcache_sz; ++j) {
-        if(!(rv->fcache[j] = (fat_cache_t *)malloc(sizeof(fat_cache_t)))) {
-            goto out_fcache;
-        }
-    }
-
-    for(j = 0; j < fcache_sz; ++j) {
-        if(!(rv->fcache[j]->data = (uint8_t *)malloc(block_size))) {
-            goto out_fcache2;
-        }
-
-        rv->fcache[j]->flags = 0;
+    if(!(rv->fcache = bcache_create(bd, block_size, fcache_sz,
+                                    &fat_fatblock_ops, rv))) {
+        bcache_destroy(rv->bcache);
+        free(rv);
+        bd->shutdown(bd);
+        return NULL;
     }
 
-    rv->fcache_size = fcache_sz;
     return rv;
-
-out_fcache2:
-    for(; j >= 0; --j) {
-        free(rv->fcache[j]->data);
-    }
-
-    j = fcache_sz - 1;
-
-out_fcache:
-    for(; j >= 0; --j) {
-        free(rv->fcache[j]);
-    }
-
-    free(rv->fcache);
-
-out_bcache:
-    for(; j >= 0; --j) {
-        free(rv->bcache[j]->data);
-    }
-
-    j = cache_sz - 1;
-out_cache:
-    for(; j >= 0; --j) {
-        free(rv->bcache[j]);
-    }
-
-    free(rv->bcache);
-    free(rv);
-    bd->shutdown(bd);
-    return NULL;
 }
 
 int fat_fs_sync(fat_fs_t *fs) {
@@ -414,22 +370,11 @@ int fat_fs_sync(fat_fs_t *fs) {
 }
 
 void fat_fs_shutdown(fat_fs_t *fs) {
-    int i;
-
     /* Sync the filesystem back to the block device, if needed. */
     fat_fs_sync(fs);
 
-    for(i = 0; i < fs->cache_size; ++i) {
-        free(fs->bcache[i]->data);
-        free(fs->bcache[i]);
-    }
-
-    free(fs->bcache);
-
-    for(i = 0; i < fs->fcache_size; ++i) {
-        free(fs->fcache[i]->data);
-        free(fs->fcache[i]);
-    }
+    bcache_destroy(fs->bcache);
+    bcache_destroy(fs->fcache);
 
     fs->dev->shutdown(fs->dev);
     free(fs);
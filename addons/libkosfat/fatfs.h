@@ -14,6 +14,7 @@ __BEGIN_DECLS
 
 #ifndef FAT_NOT_IN_KOS
 #include <kos/blockdev.h>
+#include <kos/bcache.h>
 #endif
 
 /* Tunable filesystem parameters. These must be set at compile time. */
@@ -27,7 +28,8 @@ __BEGIN_DECLS
    this to 8 should work well enough, but if you have more memory to spare,
    feel free to set it larger (just keep in mind your target cluster size!).
    For reference, a 16-cluster cache at 64k clusters would give a cache size
-   of 1MiB (plus some overhead).
+   of 1MiB (plus some overhead). Clusters are only allocated as they are
+   needed, and clean ones are given back when memory runs low.
 
    Note that this is a default value for filesystems initialized/mounted with
    fat_fs_init(). If you wish to specify your own value that differs from this
@@ -110,6 +112,27 @@ int fat_fs_type(const fat_fs_t *fs);
 int fat_cluster_cache_wb(fat_fs_t *fs);
 int fat_fatblock_cache_wb(fat_fs_t *fs);
 
+/* Free clean, unused clusters and FAT blocks from the filesystem's caches,
+   least recently used first. Returns the number of bytes freed. */
+size_t fat_fs_shrink_cache(fat_fs_t *fs, size_t want);
+
+/* Set the most clusters to read ahead when a file is read sequentially (0
+   turns read-ahead off), and fetch the cluster cache's statistics. */
+void fat_fs_set_readahead(fat_fs_t *fs, size_t clusters);
+int fat_fs_cache_stats(fat_fs_t *fs, bcache_stats_t *stats);
+
+/* Read a run of consecutive clusters straight into buf, bypassing the cache
+   (but still seeing any dirty clusters in it). Returns 0 or a negative error
+   code. */
+int fat_cluster_read_direct(fat_fs_t *fs, uint32_t cl, size_t count,
+                            uint8_t *buf);
+
+/* Read ahead in the cluster cache if a file is being read in order. Call this
+   before reading each cluster of the file, giving its position in the chain,
+   the cluster itself, and the number of clusters in the file. */
+void fat_cluster_readahead(fat_fs_t *fs, bcache_ra_t *ra, uint32_t order,
+                           uint32_t cluster, uint32_t nclusters);
+
 #define FAT_FREE_CLUSTER    0x00000000
 #define FAT_INVALID_CLUSTER 0xFFFFFFFF
 
@@ -10,26 +10,17 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#include "bpb.h"
-
-#define FAT_CACHE_FLAG_VALID    1
-#define FAT_CACHE_FLAG_DIRTY    2
+#include <kos/bcache.h>
 
-typedef struct fat_cache {
-    uint32_t flags;
-    uint32_t block;
-    uint8_t *data;
-} fat_cache_t;
+#include "bpb.h"
 
 struct fatfs_struct {
     kos_blockdev_t *dev;
     fat_superblock_t sb;
 
-    fat_cache_t **bcache;
-    int cache_size;
-
-    fat_cache_t **fcache;
-    int fcache_size;
+    /* Cluster cache and FAT block cache. */
+    bcache_t *bcache;
+    bcache_t *fcache;
 
     uint32_t flags;
     uint32_t mnt_flags;
@@ -38,6 +29,9 @@ struct fatfs_struct {
 /* The BPB/FSinfo blocks need to be written back to the block device... */
 #define FAT_FS_FLAG_SB_DIRTY   1
 
+/* Block I/O for the FAT block cache (in fat.c). */
+extern const bcache_ops_t fat_fatblock_ops;
+
 #ifdef FAT_NOT_IN_KOS
 #include <stdio.h>
 #define DBG_DEBUG 0
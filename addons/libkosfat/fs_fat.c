@@ -16,6 +16,7 @@
 
 #include <kos/fs.h>
 #include <kos/mutex.h>
+#include <kos/shrinker.h>
 #include <kos/dbglog.h>
 
 #include <fat/fs_fat.h>
@@ -60,6 +61,7 @@ static struct {
     uint32_t ptr;
     dirent_t dent;
     fs_fat_fs_t *fs;
+    bcache_ra_t ra;
 } fh[MAX_FAT_FILES];
 
 static uint16_t longname_buf[256];
@@ -342,6 +344,7 @@ created:
         (fh[fd].dentry.cluster_high << 16);
     fh[fd].cluster_order = 0;
     fh[fd].opened = 1;
+    bcache_ra_init(&fh[fd].ra);
 
     mutex_unlock(&fat_mutex);
     return (void *)(fd + 1);
@@ -370,7 +373,7 @@ static int fs_fat_close(void *h) {
 static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
     file_t fd = ((file_t)h) - 1;
     fat_fs_t *fs;
-    uint32_t bs, bo;
+    uint32_t bs, bo, n, next;
     uint8_t *block;
     uint8_t *bbuf = (uint8_t *)buf;
     ssize_t rv;
@@ -436,6 +439,9 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
 
     /* Handle the first block specially if we are offset within it. */
     if(bo) {
+        fat_cluster_readahead(fs, &fh[fd].ra, fh[fd].cluster_order,
+                              fh[fd].cluster, (sz + bs - 1) / bs);
+
         if(!(block = fat_cluster_read(fs, fh[fd].cluster, &errno))) {
             mutex_unlock(&fat_mutex);
             return -1;
@@ -485,6 +491,50 @@ static ssize_t fs_fat_read(void *h, void *buf, size_t cnt) {
 
     /* While we still have more to read, do it. */
     while(cnt) {
+        /* If the next few clusters of the file are next to each other on the
+           device and all wanted in full, read them straight into the caller's
+           buffer in one go, rather than a cluster at a time through the
+           cache. */
+        if(cnt >= bs * 2) {
+            for(n = 1, cl = fh[fd].cluster; ; ++n, cl = next) {
+                next = fat_read_fat(fs, (uint32_t)cl, &errno);
+
+                if(next == FAT_INVALID_CLUSTER) {
+                    mutex_unlock(&fat_mutex);
+                    return -1;
+                }
+
+                if(next != cl + 1 || n == cnt / bs)
+                    break;
+            }
+
+            if(n > 1) {
+                if((mode = fat_cluster_read_direct(fs, fh[fd].cluster, n,
+                                                   bbuf))) {
+                    mutex_unlock(&fat_mutex);
+                    errno = -mode;
+                    return -1;
+                }
+
+                fh[fd].ptr += n * bs;
+                cnt -= n * bs;
+                bbuf += n * bs;
+                fh[fd].cluster = next;
+                fh[fd].cluster_order += n;
+
+                if(cnt && fat_is_eof(fs, next)) {
+                    mutex_unlock(&fat_mutex);
+                    errno = EIO;
+                    return -1;
+                }
+
+                continue;
+            }
+        }
+
+        fat_cluster_readahead(fs, &fh[fd].ra, fh[fd].cluster_order,
+                              fh[fd].cluster, (sz + bs - 1) / bs);
+
         if(!(block = fat_cluster_read(fs, fh[fd].cluster, &errno))) {
             mutex_unlock(&fat_mutex);
             return -1;
@@ -1459,6 +1509,76 @@ int fs_fat_sync(const char *mp) {
     return rv;
 }
 
+static fs_fat_fs_t *fs_fat_find(const char *mp) {
+    fs_fat_fs_t *i;
+
+    LIST_FOREACH(i, &fat_fses, entry) {
+        if(!strcmp(mp, i->vfsh->nmmgr.pathname))
+            return i;
+    }
+
+    errno = ENOENT;
+    return NULL;
+}
+
+int fs_fat_set_readahead(const char *mp, size_t clusters) {
+    fs_fat_fs_t *i;
+
+    mutex_lock(&fat_mutex);
+
+    if(!(i = fs_fat_find(mp))) {
+        mutex_unlock(&fat_mutex);
+        return -1;
+    }
+
+    fat_fs_set_readahead(i->fs, clusters);
+    mutex_unlock(&fat_mutex);
+    return 0;
+}
+
+int fs_fat_cache_stats(const char *mp, bcache_stats_t *stats) {
+    fs_fat_fs_t *i;
+
+    mutex_lock(&fat_mutex);
+
+    if(!(i = fs_fat_find(mp))) {
+        mutex_unlock(&fat_mutex);
+        return -1;
+    }
+
+    fat_fs_cache_stats(i->fs, stats);
+    mutex_unlock(&fat_mutex);
+    return 0;
+}
+
+/* Give back clean blocks from the mounted filesystems' caches. */
+static size_t fat_shrink(size_t want, void *data) {
+    fs_fat_fs_t *i;
+    size_t rv = 0;
+
+    (void)data;
+
+    if(mutex_trylock(&fat_mutex))
+        return 0;
+
+    LIST_FOREACH(i, &fat_fses, entry) {
+        rv += fat_fs_shrink_cache(i->fs, want - rv);
+
+        if(rv >= want)
+            break;
+    }
+
+    mutex_unlock(&fat_mutex);
+
+    return rv;
+}
+
+static shrinker_t fat_shrinker = {
+    .name = "fat",
+    .priority = SHRINKER_PRIO_CACHE,
+    .shrink = fat_shrink
+};
+
 int fs_fat_init(void) {
     if(initted)
         return 0;
@@ -1469,6 +1589,8 @@ int fs_fat_init(void) {
 
     memset(fh, 0, sizeof(fh));
 
+    shrinker_register(&fat_shrinker);
+
     return 0;
 }
 
@@ -1478,6 +1600,8 @@ int fs_fat_shutdown(void) {
     if(!initted)
         return 0;
 
+    shrinker_unregister(&fat_shrinker);
+
     /* Clean up the mounted filesystems */
     i = LIST_FIRST(&fat_fses);
     while(i) {
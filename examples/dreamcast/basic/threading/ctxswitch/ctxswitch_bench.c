@@ -0,0 +1,89 @@
+/* KallistiOS ##version##
+
+   ctxswitch_bench.c
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/* This program measures the cost of a voluntary context switch with a varying
+   number of runnable threads. Each worker thread simply calls thd_pass() in a
+   loop, so nearly all of the time spent is in the scheduler and the context
+   switch code itself. With the run queue being constant time, the cost per
+   switch should stay roughly flat as the number of threads goes up. */
+
+#include <stdio.h>
+#include <kos/thread.h>
+#include <kos/sem.h>
+
+#include <arch/arch.h>
+#include <arch/timer.h>
+#include <dc/maple.h>
+#include <dc/maple/controller.h>
+
+#define UNUSED __attribute__((unused))
+#define MAX_THREADS 64
+#define ITERATIONS  2000
+
+static semaphore_t start_sem;
+
+static void *thd_func(void *param UNUSED) {
+    int i;
+
+    /* Wait until everyone has been created so we don't time that. */
+    sem_wait(&start_sem);
+
+    for(i = 0; i < ITERATIONS; ++i) {
+        thd_pass();
+    }
+
+    return NULL;
+}
+
+static void run_bench(int count) {
+    kthread_t *thds[MAX_THREADS];
+    uint64 start, end;
+    int i;
+
+    for(i = 0; i < count; ++i) {
+        thds[i] = thd_create(0, &thd_func, NULL);
+    }
+
+    start = timer_us_gettime64();
+
+    for(i = 0; i < count; ++i) {
+        sem_signal(&start_sem);
+    }
+
+    for(i = 0; i < count; ++i) {
+        thd_join(thds[i], NULL);
+    }
+
+    end = timer_us_gettime64();
+
+    printf("%2d threads: %8lu us total, %lu ns per switch\n", count,
+           (uint32)(end - start),
+           (uint32)(((end - start) * 1000) / (count * ITERATIONS)));
+}
+
+KOS_INIT_FLAGS(INIT_DEFAULT);
+
+int main(int argc, char *argv[]) {
+    int count;
+
+    cont_btn_callback(0, CONT_START | CONT_A | CONT_B | CONT_X | CONT_Y,
+                      (cont_btn_callback_t)arch_exit);
+
+    printf("KallistiOS context switch benchmark\n");
+
+    sem_init(&start_sem, 0);
+
+    for(count = 1; count <= MAX_THREADS; count *= 2) {
+        run_bench(count);
+    }
+
+    sem_destroy(&start_sem);
+
+    printf("Test finished\n");
+
+    return 0;
+}
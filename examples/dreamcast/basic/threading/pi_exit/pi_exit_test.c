@@ -0,0 +1,120 @@
+/* KallistiOS ##version##
+
+   pi_exit_test.c
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/* This program checks what happens when a thread exits while it still holds a
+   priority inheritance mutex that another thread is waiting on. The mutex
+   should be handed to the waiter, and nothing should be left pointing at the
+   dead thread, whose thread structure will be reused for the next thread to
+   be created. */
+
+#include <stdio.h>
+
+#include <kos/thread.h>
+#include <kos/mutex.h>
+
+#include <arch/arch.h>
+#include <dc/maple.h>
+#include <dc/maple/controller.h>
+
+#define UNUSED __attribute__((unused))
+
+#define LOW_PRIO    15
+#define HIGH_PRIO   5
+
+static mutex_t m = PI_MUTEX_INITIALIZER;
+static volatile int got_lock = 0;
+static volatile prio_t low_boosted = 0;
+
+/* Takes the lock, waits for the high priority thread to queue up on it, then
+   exits without unlocking. */
+static void *low_thd(void *param UNUSED) {
+    mutex_lock(&m);
+    thd_sleep(100);
+
+    low_boosted = thd_current->prio;
+    printf("Low: exiting at priority %d, still holding the lock\n",
+           (int)low_boosted);
+    return NULL;
+}
+
+static void *high_thd(void *param UNUSED) {
+    printf("High: waiting on the lock\n");
+
+    if(mutex_lock(&m)) {
+        printf("High: mutex_lock failed\n");
+        return NULL;
+    }
+
+    got_lock = (m.holder == thd_current);
+    printf("High: got the lock\n");
+    mutex_unlock(&m);
+
+    return NULL;
+}
+
+static void *idle_thd(void *param UNUSED) {
+    return NULL;
+}
+
+KOS_INIT_FLAGS(INIT_DEFAULT);
+
+int main(int argc UNUSED, char *argv[] UNUSED) {
+    kthread_t *lo, *hi, *t;
+    int ok = 1;
+
+    /* Exit if the user presses all buttons at once. */
+    cont_btn_callback(0, CONT_START | CONT_A | CONT_B | CONT_X | CONT_Y,
+                      (cont_btn_callback_t)arch_exit);
+
+    printf("KallistiOS priority inheritance mutex exit test\n");
+
+    lo = thd_create(0, low_thd, NULL);
+    thd_set_prio(lo, LOW_PRIO);
+    thd_sleep(20);
+
+    hi = thd_create(0, high_thd, NULL);
+    thd_set_prio(hi, HIGH_PRIO);
+
+    thd_join(lo, NULL);
+    thd_join(hi, NULL);
+
+    if(low_boosted != HIGH_PRIO) {
+        printf("Low thread was not boosted (priority %d)\n", (int)low_boosted);
+        ok = 0;
+    }
+
+    if(!got_lock) {
+        printf("High thread never got the lock\n");
+        ok = 0;
+    }
+
+    if(mutex_is_locked(&m)) {
+        printf("Lock is still locked!\n");
+        ok = 0;
+    }
+
+    /* This will most likely reuse the low priority thread's structure. Its
+       priority shouldn't be disturbed by anything left over from before. */
+    t = thd_create(0, idle_thd, NULL);
+
+    if(t->prio != PRIO_DEFAULT) {
+        printf("New thread has priority %d, not %d\n", (int)t->prio,
+               PRIO_DEFAULT);
+        ok = 0;
+    }
+
+    thd_join(t, NULL);
+    mutex_destroy(&m);
+
+    if(!ok) {
+        printf("Priority inheritance mutex exit test FAILED\n");
+        return 1;
+    }
+
+    printf("Priority inheritance mutex exit test completed successfully!\n");
+    return 0;
+}
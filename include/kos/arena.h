@@ -0,0 +1,225 @@
+/* KallistiOS ##version##
+
+   include/kos/arena.h
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/** \file   kos/arena.h
+    \brief  Arena (region) allocators.
+
+    An arena hands out memory by bumping a pointer through large chunks, and
+    frees all of it at once. This is a good fit for memory that is only needed
+    for a well-defined period of time, like the work done for a single frame or
+    a single request: rather than freeing each allocation separately (and
+    chopping up the heap in the process), the whole arena is reset when that
+    period is over. Resetting an arena takes constant time, and keeps its
+    chunks around to be reused.
+
+    arena_mark() and arena_rewind() allow a function to free just what it has
+    allocated from an arena, leaving anything allocated before it alone.
+
+    Arenas are not thread-safe. Each thread can have an arena of its own set
+    with arena_set_thread(), for code that needs scratch memory without having
+    an arena passed to it.
+
+    In C++, objects can be created in an arena with placement new, for instance
+    <tt>new(arena) Foo()</tt>. Their destructors are never run automatically.
+
+    \author The KallistiOS Team
+*/
+
+#ifndef __KOS_ARENA_H
+#define __KOS_ARENA_H
+
+#include <kos/cdefs.h>
+
+__BEGIN_DECLS
+
+#include <stddef.h>
+
+/* \cond */
+struct arena_chunk;
+/* \endcond */
+
+/** \brief  Arena structure.
+
+    All members of this structure should be considered to be private.
+
+    \headerfile kos/arena.h
+*/
+typedef struct arena {
+    /* \cond */
+    struct arena_chunk *head;       /* Newest chunk, allocated from */
+    struct arena_chunk *first;      /* Oldest chunk in use */
+    struct arena_chunk *spare;      /* Chunks available for reuse */
+    size_t chunk_size;              /* Minimum size of new chunks */
+    int fixed;                      /* Using a caller-supplied buffer? */
+    /* \endcond */
+} arena_t;
+
+/** \brief  A position in an arena, to rewind to later.
+    \headerfile kos/arena.h
+    \see    arena_mark()
+*/
+typedef struct arena_mark {
+    /* \cond */
+    struct arena_chunk *chunk;
+    size_t used;
+    /* \endcond */
+} arena_mark_t;
+
+/** \brief  Default size of each chunk of an arena. */
+#define ARENA_DEFAULT_CHUNK 16384
+
+/** \brief  Initialize an arena.
+
+    The arena doesn't allocate anything until it is first used.
+
+    \param  a               The arena to initialize.
+    \param  chunk_size      The minimum size of each chunk the arena gets from
+                            malloc(), or 0 for ARENA_DEFAULT_CHUNK.
+    \retval 0               On success (no error conditions currently defined).
+*/
+int arena_init(arena_t *a, size_t chunk_size);
+
+/** \brief  Initialize an arena that allocates from a fixed buffer.
+
+    An arena set up this way never calls malloc(), and fails allocations once
+    the buffer is full.
+
+    \param  a               The arena to initialize.
+    \param  buf             The buffer to allocate from.
+    \param  size            The size of the buffer, in bytes.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - the buffer is too small to be useful
+*/
+int arena_init_buffer(arena_t *a, void *buf, size_t size);
+
+/** \brief  Free all memory held by an arena.
+    \param  a               The arena to destroy.
+*/
+void arena_destroy(arena_t *a);
+
+/** \brief  Allocate memory from an arena, with a given alignment.
+
+    \param  a               The arena to allocate from.
+    \param  size            The number of bytes to allocate.
+    \param  align           The alignment required (a power of two).
+    \return                 The memory, or NULL on error (errno will be set as
+                            appropriate).
+
+    \par    Error Conditions:
+    \em     ENOMEM - out of memory \n
+    \em     EINVAL - align is not a power of two
+*/
+void *arena_alloc_aligned(arena_t *a, size_t size, size_t align);
+
+/** \brief  Allocate memory from an arena.
+
+    The memory is aligned the same as memory from malloc().
+
+    \param  a               The arena to allocate from.
+    \param  size            The number of bytes to allocate.
+    \return                 The memory, or NULL if out of memory.
+*/
+void *arena_alloc(arena_t *a, size_t size);
+
+/** \brief  Copy part of a string into an arena.
+
+    \param  a               The arena to allocate from.
+    \param  s               The string to copy.
+    \param  n               The maximum number of characters to copy.
+    \return                 The NUL-terminated copy, or NULL if out of memory.
+*/
+char *arena_strndup(arena_t *a, const char *s, size_t n);
+
+/** \brief  Copy a string into an arena.
+
+    \param  a               The arena to allocate from.
+    \param  s               The string to copy.
+    \return                 The copy, or NULL if out of memory.
+*/
+char *arena_strdup(arena_t *a, const char *s);
+
+/** \brief  Remember the current position in an arena.
+
+    \param  a               The arena to look at.
+    \return                 A mark that can be passed to arena_rewind().
+*/
+arena_mark_t arena_mark(arena_t *a);
+
+/** \brief  Free everything allocated from an arena since a mark was taken.
+
+    The mark must have been taken since the last time the arena was reset, and
+    not before any mark that has already been rewound to.
+
+    \param  a               The arena to rewind.
+    \param  mark            The mark to rewind to.
+*/
+void arena_rewind(arena_t *a, arena_mark_t mark);
+
+/** \brief  Free everything allocated from an arena.
+
+    This takes constant time. The arena's chunks are kept to be reused.
+
+    \param  a               The arena to reset.
+*/
+void arena_reset(arena_t *a);
+
+/** \brief  Give an arena's unused chunks back to malloc().
+
+    \param  a               The arena to trim.
+    \return                 The number of bytes freed.
+*/
+size_t arena_trim(arena_t *a);
+
+/** \brief  Set the current thread's arena.
+
+    \param  a               The arena to use, or NULL for none.
+    \return                 The thread's previous arena.
+*/
+arena_t *arena_set_thread(arena_t *a);
+
+/** \brief  Retrieve the current thread's arena.
+    \return                 The arena set by arena_set_thread(), or NULL.
+*/
+arena_t *arena_get_thread(void);
+
+__END_DECLS
+
+#ifdef __cplusplus
+/* \cond */
+#if __cplusplus >= 201103L
+#define __ARENA_NOTHROW noexcept
+#else
+#define __ARENA_NOTHROW throw()
+#endif
+
+inline void *operator new(size_t size, arena_t *a) __ARENA_NOTHROW {
+    return arena_alloc(a, size);
+}
+
+inline void *operator new[](size_t size, arena_t *a) __ARENA_NOTHROW {
+    return arena_alloc(a, size);
+}
+
+/* Only called if a constructor throws; the memory goes when the arena does. */
+inline void operator delete(void *p, arena_t *a) __ARENA_NOTHROW {
+    (void)p;
+    (void)a;
+}
+
+inline void operator delete[](void *p, arena_t *a) __ARENA_NOTHROW {
+    (void)p;
+    (void)a;
+}
+
+#undef __ARENA_NOTHROW
+/* \endcond */
+#endif
+
+#endif  /* __KOS_ARENA_H */
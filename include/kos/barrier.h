@@ -0,0 +1,205 @@
+/* KallistiOS ##version##
+
+   include/kos/barrier.h
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/** \file   kos/barrier.h
+    \brief  Thread barriers and countdown latches.
+
+    A barrier makes a fixed number of threads wait for each other: each thread
+    that calls barrier_wait() blocks until the last one arrives, at which point
+    all of them are released at once. The barrier then resets itself, so it can
+    be used over and over (for instance, once per frame).
+
+    A latch is a one-shot version of the same idea, where the threads that wait
+    aren't necessarily the ones doing the work. The latch starts out with a
+    count, which is decremented by latch_count_down(), and anyone waiting on
+    the latch is released once the count hits zero. Counting down may be done
+    from an interrupt.
+
+    Both of these wake all of their waiters in a single pass, rather than
+    having each waiter wake the next like one built from a mutex and a
+    condition variable would.
+
+    \author The KallistiOS Team
+*/
+
+#ifndef __KOS_BARRIER_H
+#define __KOS_BARRIER_H
+
+#include <kos/cdefs.h>
+
+__BEGIN_DECLS
+
+/** \brief  Thread barrier structure.
+
+    All members of this structure should be considered to be private, it is not
+    safe to change anything in here yourself.
+
+    \headerfile kos/barrier.h
+*/
+typedef struct barrier {
+    /** \brief  Are we initialized? */
+    int initialized;
+
+    /** \brief  The number of threads that must arrive to release the barrier. */
+    unsigned int count;
+
+    /** \brief  The number of threads that have arrived so far. */
+    unsigned int waiting;
+
+    /** \brief  Incremented every time the barrier is released. */
+    unsigned int generation;
+} barrier_t;
+
+/** \brief  Initializer for a barrier for count threads. */
+#define BARRIER_INITIALIZER(count)  { 1, (count), 0, 0 }
+
+/** \brief  Value returned by barrier_wait() to exactly one of the threads
+            released each time. */
+#define BARRIER_SERIAL_THREAD   1
+
+/** \brief  Initialize a barrier.
+
+    \param  b               The barrier to initialize.
+    \param  count           The number of threads that must call barrier_wait()
+                            before any of them are released.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - count is 0
+*/
+int barrier_init(barrier_t *b, unsigned int count);
+
+/** \brief  Destroy a barrier.
+
+    \param  b               The barrier to destroy.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EBUSY - threads are waiting on the barrier
+*/
+int barrier_destroy(barrier_t *b);
+
+/** \brief  Wait at a barrier.
+
+    This function blocks the calling thread until the number of threads given
+    when the barrier was initialized have all called it. This function may not
+    be called inside an interrupt.
+
+    \param  b               The barrier to wait at.
+    \retval BARRIER_SERIAL_THREAD   In one of the released threads.
+    \retval 0               In all the other released threads.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt \n
+    \em     EINVAL - the barrier is not initialized
+*/
+int barrier_wait(barrier_t *b);
+
+/** \brief  Countdown latch structure.
+
+    All members of this structure should be considered to be private, it is not
+    safe to change anything in here yourself.
+
+    \headerfile kos/barrier.h
+*/
+typedef struct latch {
+    /** \brief  Are we initialized? */
+    int initialized;
+
+    /** \brief  The count remaining before the latch is released. */
+    unsigned int count;
+
+    /** \brief  The number of threads waiting on the latch. */
+    unsigned int waiting;
+} latch_t;
+
+/** \brief  Initializer for a latch with the given count. */
+#define LATCH_INITIALIZER(count)    { 1, (count), 0 }
+
+/** \brief  Initialize a latch.
+
+    \param  l               The latch to initialize.
+    \param  count           The number of times latch_count_down() must be
+                            called before waiters are released.
+    \retval 0               On success (no error conditions currently defined).
+*/
+int latch_init(latch_t *l, unsigned int count);
+
+/** \brief  Destroy a latch.
+
+    \param  l               The latch to destroy.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EBUSY - threads are waiting on the latch
+*/
+int latch_destroy(latch_t *l);
+
+/** \brief  Count down a latch.
+
+    This function decrements the count on the latch, and releases everyone
+    waiting on it if the count reaches zero. Counting down a latch that has
+    already been released does nothing. This function is safe to call inside
+    an interrupt.
+
+    \param  l               The latch to count down.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - the latch is not initialized
+*/
+int latch_count_down(latch_t *l);
+
+/** \brief  Wait for a latch to be released, with a timeout.
+
+    This function blocks until the count on the latch reaches zero, returning
+    immediately if it already has. This function may not be called inside an
+    interrupt.
+
+    \param  l               The latch to wait on.
+    \param  timeout         The maximum time to wait (in milliseconds), or 0 to
+                            wait forever.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt \n
+    \em     EINVAL - the latch is not initialized, or timeout is negative \n
+    \em     ETIMEDOUT - timed out
+*/
+int latch_wait_timed(latch_t *l, int timeout);
+
+/** \brief  Wait for a latch to be released.
+
+    This function is the same as latch_wait_timed() with no timeout.
+
+    \param  l               The latch to wait on.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt \n
+    \em     EINVAL - the latch is not initialized
+*/
+int latch_wait(latch_t *l);
+
+/** \brief  Check whether a latch has been released, without blocking.
+
+    \param  l               The latch to check.
+    \retval 0               If the latch has been released.
+    \retval -1              If not (errno will be set to EAGAIN).
+*/
+int latch_try_wait(latch_t *l);
+
+__END_DECLS
+
+#endif  /* __KOS_BARRIER_H */
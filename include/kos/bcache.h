@@ -0,0 +1,358 @@
+/* KallistiOS ##version##
+
+   include/kos/bcache.h
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/** \file   kos/bcache.h
+    \brief  Block buffer cache.
+
+    This file defines a cache of fixed-size blocks read from a block device,
+    for use by filesystems. Cached blocks are found through a hash table and
+    kept in least-recently-used order on an intrusive list, so looking up,
+    touching, and replacing a block all take constant time no matter how big
+    the cache is. Buffers are only allocated as they are needed, up to the
+    size given when the cache is created, so a large cache costs nothing until
+    it actually fills up.
+
+    A buffer obtained from the cache is referenced, and will not be reused for
+    another block until it has been released with bcache_release(). Buffers
+    that have been changed should be marked dirty; dirty buffers are written
+    back when they are evicted, or all at once (in block order) by
+    bcache_sync().
+
+    By default, each cache block is read from and written to the consecutive
+    device blocks that it covers. A filesystem that numbers its blocks some
+    other way can supply its own read and write functions instead.
+
+    The cache can also read ahead for files being read sequentially. Each open
+    file keeps a bcache_ra_t, which bcache_readahead() uses to notice when the
+    file is being read in order. When it is, the next several blocks of the
+    file are brought into the cache with as few device reads as possible, and
+    the number of blocks read ahead grows with each hit, up to the limit set
+    with bcache_set_readahead().
+
+    The cache does no locking of its own. The filesystem using it must make
+    sure that only one thread uses a given cache at a time. A filesystem that
+    does all of its work under a single lock, which its shrinker also takes,
+    can release a buffer as soon as it has been read and keep using the data
+    until it drops the lock: nothing can evict the block before then, except
+    the filesystem itself reading so many other blocks that this one falls out
+    of the cache.
+
+    \author The KallistiOS Team
+*/
+
+#ifndef __KOS_BCACHE_H
+#define __KOS_BCACHE_H
+
+#include <sys/cdefs.h>
+__BEGIN_DECLS
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/queue.h>
+
+#include <kos/blockdev.h>
+
+/** \brief  Opaque type for a block cache. */
+typedef struct bcache bcache_t;
+
+/** \brief  A buffer holding one cached block.
+
+    Only the block and data members may be used outside of the cache, and
+    neither should be changed.
+
+    \headerfile kos/bcache.h
+*/
+typedef struct bcache_buf {
+    /** \brief  The block number held in this buffer. */
+    uint64_t block;
+
+    /** \brief  The block's data (aligned to 32 bytes). */
+    uint8_t *data;
+
+    /* \cond */
+    TAILQ_ENTRY(bcache_buf) lru;
+    LIST_ENTRY(bcache_buf) hash;
+    uint32_t flags;
+    uint32_t refcnt;
+    /* \endcond */
+} bcache_buf_t;
+
+/** \brief  Block I/O functions for a cache.
+
+    These are used in place of the block device's own functions, for caches
+    that don't map their blocks directly onto device blocks.
+
+    \headerfile kos/bcache.h
+*/
+typedef struct bcache_ops {
+    /** \brief  Read one or more consecutive cache blocks.
+        \param  data        The data pointer given to bcache_create().
+        \param  block       The first block to read.
+        \param  count       The number of blocks to read.
+        \param  buf         Where to put the blocks, one after another.
+        \return             0 on success, nonzero on error.
+    */
+    int (*read)(void *data, uint64_t block, size_t count, void *buf);
+
+    /** \brief  Write one cache block.
+
+        This may be NULL for a cache that is only read from, as long as no
+        buffer is ever marked dirty.
+
+        \param  data        The data pointer given to bcache_create().
+        \param  block       The block to write.
+        \param  buf         The block's contents.
+        \return             0 on success, nonzero on error.
+    */
+    int (*write)(void *data, uint64_t block, const void *buf);
+} bcache_ops_t;
+
+/** \brief  Block cache statistics.
+
+    \headerfile kos/bcache.h
+    \see    bcache_get_stats()
+*/
+typedef struct bcache_stats {
+    size_t block_size;          /**< \brief Size of each block, in bytes */
+    uint32_t max_bufs;          /**< \brief Most buffers the cache can have */
+    uint32_t bufs;              /**< \brief Buffers currently allocated */
+    uint32_t dirty;             /**< \brief Buffers waiting to be written */
+    uint32_t hits;              /**< \brief Lookups found in the cache */
+    uint32_t misses;            /**< \brief Lookups not found in the cache */
+    uint32_t writebacks;        /**< \brief Dirty buffers written out */
+    uint32_t ra_max;            /**< \brief Most blocks to read ahead */
+    uint32_t ra_blocks;         /**< \brief Blocks read ahead */
+    uint32_t ra_hits;           /**< \brief Blocks read ahead, then used */
+} bcache_stats_t;
+
+/** \brief  Default read-ahead limit, in blocks.
+
+    The limit is also never more than half the size of the cache, so that
+    reading ahead can't push everything else out of it.
+*/
+#define BCACHE_RA_DEFAULT       8
+
+/** \brief  Read-ahead state for one open file.
+
+    Initialize this with bcache_ra_init() when the file is opened.
+
+    \headerfile kos/bcache.h
+*/
+typedef struct bcache_ra {
+    /* \cond */
+    uint64_t next;              /* File block expected to be read next */
+    uint64_t end;               /* File block after the last one read ahead */
+    uint32_t window;            /* Blocks to read ahead next time */
+    /* \endcond */
+} bcache_ra_t;
+
+/** \brief  Map a block of a file to a cache block.
+    \param  data            The data pointer given to bcache_readahead().
+    \param  fblock          The block within the file.
+    \param  block           Where to put the cache block number.
+    \return                 0 on success, nonzero if the block can't be mapped
+                            (read ahead stops there).
+*/
+typedef int (*bcache_map_t)(void *data, uint64_t fblock, uint64_t *block);
+
+/** \brief  Create a block cache.
+
+    \param  dev             The block device to cache. May be NULL if ops is
+                            given.
+    \param  block_size      The size of each cache block, in bytes. Without
+                            ops, this must be a power of two multiple of the
+                            device's block size.
+    \param  max_bufs        The largest number of blocks to cache at once.
+    \param  ops             Functions to read and write blocks, or NULL to read
+                            and write the device directly.
+    \param  data            Data to pass to the ops functions.
+    \return                 The new cache, or NULL on error (errno will be set
+                            as appropriate).
+
+    \par    Error Conditions:
+    \em     EINVAL - the block size or number of buffers is invalid \n
+    \em     ENOMEM - out of memory
+*/
+bcache_t *bcache_create(kos_blockdev_t *dev, size_t block_size,
+                        size_t max_bufs, const bcache_ops_t *ops, void *data);
+
+/** \brief  Destroy a block cache.
+
+    Dirty buffers are thrown away, so call bcache_sync() first if they should
+    be kept.
+
+    \param  c               The cache to destroy.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EBUSY - a buffer has not been released
+*/
+int bcache_destroy(bcache_t *c);
+
+/** \brief  Get a block, reading it in if it isn't cached.
+
+    \param  c               The cache to use.
+    \param  block           The block to get.
+    \return                 The referenced buffer, or NULL on error (errno will
+                            be set as appropriate).
+
+    \par    Error Conditions:
+    \em     EIO - the block could not be read, or a dirty block could not be
+                  written back to make room for it \n
+    \em     EBUSY - every buffer is referenced and none can be allocated
+*/
+bcache_buf_t *bcache_read(bcache_t *c, uint64_t block);
+
+/** \brief  Get a block without reading it.
+
+    This is for blocks that are about to be overwritten completely. If the
+    block isn't already cached, the buffer's contents are undefined.
+
+    \param  c               The cache to use.
+    \param  block           The block to get.
+    \return                 The referenced buffer, or NULL on error (errno will
+                            be set as appropriate).
+
+    \par    Error Conditions:
+    \em     EIO - a dirty block could not be written back to make room \n
+    \em     EBUSY - every buffer is referenced and none can be allocated
+*/
+bcache_buf_t *bcache_get(bcache_t *c, uint64_t block);
+
+/** \brief  Get a block only if it is already cached.
+
+    \param  c               The cache to use.
+    \param  block           The block to look for.
+    \return                 The referenced buffer, or NULL if the block is not
+                            in the cache.
+*/
+bcache_buf_t *bcache_lookup(bcache_t *c, uint64_t block);
+
+/** \brief  Release a buffer.
+
+    The buffer's data may not be used after this, unless the caller can be sure
+    that the block has not been evicted from the cache since.
+
+    \param  c               The cache the buffer came from.
+    \param  b               The buffer to release.
+*/
+void bcache_release(bcache_t *c, bcache_buf_t *b);
+
+/** \brief  Mark a buffer as needing to be written back.
+    \param  c               The cache the buffer came from.
+    \param  b               The buffer that has been changed.
+*/
+void bcache_mark_dirty(bcache_t *c, bcache_buf_t *b);
+
+/** \brief  Throw away everything in a cache.
+
+    Every buffer that isn't referenced is emptied, including dirty ones, whose
+    changes are lost. The memory is kept for reuse. This is for when the
+    underlying media has changed.
+
+    \param  c               The cache to empty.
+*/
+void bcache_invalidate(bcache_t *c);
+
+/** \brief  Write back all dirty buffers, in block order.
+
+    \param  c               The cache to write back.
+    \retval 0               On success.
+    \retval -1              If any block could not be written (errno will be
+                            set to EIO). The rest are still written.
+*/
+int bcache_sync(bcache_t *c);
+
+/** \brief  Free clean buffers that aren't in use.
+
+    Buffers are freed starting with the least recently used one. This is meant
+    to be called from a memory pressure callback (see kos/shrinker.h).
+
+    \param  c               The cache to shrink.
+    \param  want            The number of bytes to try to free.
+    \return                 The number of bytes freed.
+*/
+size_t bcache_shrink(bcache_t *c, size_t want);
+
+/** \brief  Read a run of blocks straight into a buffer.
+
+    This is for large reads, where copying every block through the cache would
+    only cost time and push everything else out of it. The whole run is read
+    with a single call to the device (or the read function given to
+    bcache_create()), then any of the blocks that are dirty in the cache are
+    copied over what was read, so the caller sees the same data it would have
+    gotten through bcache_read(). The cache itself is not changed.
+
+    \param  c               The cache to use.
+    \param  block           The first block to read.
+    \param  count           The number of blocks to read.
+    \param  buf             Where to put the blocks. Aligning this to 32 bytes
+                            lets devices that can do DMA use it.
+    \retval 0               On success.
+    \retval -1              On error (errno will be set to EIO).
+*/
+int bcache_read_direct(bcache_t *c, uint64_t block, size_t count, void *buf);
+
+/** \brief  Read a run of blocks into the cache.
+
+    Blocks at the start of the run that are already cached are skipped, and the
+    run is cut short at the next cached block after that. Whatever is left is
+    read with a single call to the device (or the read function given to
+    bcache_create()). Failing to read ahead is not an error, so this function
+    does not set errno.
+
+    \param  c               The cache to use.
+    \param  block           The first block to read.
+    \param  count           The number of blocks to read.
+    \return                 The number of blocks read into the cache.
+*/
+size_t bcache_prefetch(bcache_t *c, uint64_t block, size_t count);
+
+/** \brief  Reset a file's read-ahead state.
+    \param  ra              The read-ahead state to reset.
+*/
+void bcache_ra_init(bcache_ra_t *ra);
+
+/** \brief  Read ahead for a file, if it is being read sequentially.
+
+    Call this before reading each block of a file. If the block follows the one
+    read before it, and the blocks that have already been read ahead are about
+    to run out, the next window of blocks is mapped and read into the cache
+    with bcache_prefetch(), one call for each physically contiguous run. The
+    window starts small and doubles each time, up to the cache's read-ahead
+    limit. Reading out of order shrinks it back down.
+
+    \param  c               The cache to use.
+    \param  ra              The file's read-ahead state.
+    \param  fblock          The block of the file about to be read.
+    \param  nblocks         The number of blocks in the file.
+    \param  map             Function to map blocks of the file to cache blocks.
+    \param  data            Data to pass to the map function.
+    \return                 The number of blocks read into the cache.
+*/
+size_t bcache_readahead(bcache_t *c, bcache_ra_t *ra, uint64_t fblock,
+                        uint64_t nblocks, bcache_map_t map, void *data);
+
+/** \brief  Set the read-ahead limit for a cache.
+    \param  c               The cache to change.
+    \param  blocks          The most blocks to read ahead at once, or 0 to
+                            turn read-ahead off. The default is
+                            BCACHE_RA_DEFAULT.
+*/
+void bcache_set_readahead(bcache_t *c, size_t blocks);
+
+/** \brief  Retrieve statistics for a cache.
+    \param  c               The cache to look at.
+    \param  stats           Storage for the statistics.
+    \retval 0               On success.
+*/
+int bcache_get_stats(bcache_t *c, bcache_stats_t *stats);
+
+__END_DECLS
+
+#endif  /* __KOS_BCACHE_H */
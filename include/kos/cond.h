@@ -61,10 +61,12 @@ __BEGIN_DECLS
 typedef struct condvar {
     int initialized;
     int dynamic;
+    mutex_t *mutex;
+    int waiters;
 } condvar_t;
 
 /** \brief  Initializer for a transient condvar. */
-#define COND_INITIALIZER    { 1, 0 }
+#define COND_INITIALIZER    { 1, 0, NULL, 0 }
 
 /** \brief  Allocate a new condition variable.
 
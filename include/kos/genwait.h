@@ -47,6 +47,35 @@ __BEGIN_DECLS
 */
 int genwait_wait(void * obj, const char * mesg, int timeout, void (*callback)(void *));
 
+/** \brief  Maximum number of objects genwait_wait_multi() can sleep on. */
+#define GENWAIT_MULTI_MAX   16
+
+/** \brief  Sleep on several objects at once.
+
+    This function sleeps on all of the specified objects at once, until any one
+    of them is woken up (with any of the genwait_wake functions) or the timeout
+    expires. Waking up the thread takes it off of all of the objects' sleep
+    queues. You are not allowed to call this function inside an interrupt.
+
+    Note that a thread sleeping this way is woken up by a genwait_requeue() on
+    any of the objects, rather than moved.
+
+    \param  objs            The objects to sleep on
+    \param  cnt             The number of objects in objs (at most
+                            GENWAIT_MULTI_MAX)
+    \param  mesg            A message to show in the status
+    \param  timeout         If not woken before this many milliseconds have
+                            passed, wake up anyway (0 for no timeout)
+    \return                 The index in objs of the object that was woken up,
+                            or -1 on error or timeout
+
+    \par    Error Conditions:
+    \em     EAGAIN - on timeout \n
+    \em     EINVAL - cnt is out of range \n
+    \em     EPERM - called inside an interrupt
+*/
+int genwait_wait_multi(void **objs, int cnt, const char *mesg, int timeout);
+
 /* Wake up N threads waiting on the given object. If cnt is <=0, then we
    wake all threads. Returns the number of threads actually woken. */
 /** \brief  Wake up a number of threads sleeping on an object.
@@ -124,6 +153,40 @@ void genwait_wake_one_err(void *obj, int err);
 */
 int genwait_wake_thd(void *obj, kthread_t *thd, int err);
 
+/** \brief  Find the highest priority thread sleeping on an object.
+
+    This function looks through the threads sleeping on the given object and
+    returns the one with the highest priority (that is, the lowest priority
+    value). If more than one thread has that priority, the one that has been
+    waiting the longest is returned.
+
+    \param  obj             The object to look for sleeping threads on
+    \return                 The highest priority thread sleeping on the object,
+                            or NULL if there are none
+*/
+kthread_t *genwait_top_waiter(void *obj);
+
+/** \brief  Move threads sleeping on one object to another object.
+
+    This function moves up to cnt threads that are sleeping on obj over to
+    sleep on new_obj instead, without waking them up. The threads keep their
+    place in line relative to each other, and are put at the end of the line
+    for new_obj. Any timeout they had is cancelled, since whatever they were
+    waiting for on obj has happened.
+
+    This is used to implement wait morphing for condition variables: when a
+    condition variable is signalled while its mutex is held, the waiters are
+    moved straight over to the mutex rather than being woken just to block
+    again on the mutex.
+
+    \param  obj             The object the threads are sleeping on
+    \param  new_obj         The object to move them to
+    \param  cnt             The maximum number of threads to move, or <= 0 for
+                            all of them
+    \return                 The number of threads moved
+*/
+int genwait_requeue(void *obj, void *new_obj, int cnt);
+
 /** \brief  Look for timed out genwait_wait() calls.
 
     There should be no reason you need to call this function, it is called
@@ -0,0 +1,181 @@
+/* KallistiOS ##version##
+
+   include/kos/heapprof.h
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/** \file   kos/heapprof.h
+    \brief  Sampling heap profiler.
+
+    This file defines an interface for finding out where the memory in the
+    heap is going. While the profiler is running, one out of every N calls to
+    malloc(), calloc(), realloc(), and memalign() is sampled: the block is
+    charged to the function that asked for it and to a size bucket, and is
+    tracked until it is freed. Unlike KM_DBG (see kos/opts.h), this is cheap
+    enough to leave running in a release build, and when the profiler is
+    stopped it costs the allocator a single test per call.
+
+    The numbers reported are for the sampled blocks only. Multiply them by the
+    sampling rate to get an estimate for the whole heap.
+
+    heapprof_dump() prints its results in a fixed format, sorted by caller
+    address, so that the output from two points in time can be compared with
+    diff to see which callers are holding on to more memory than before (a
+    leak), and whether the heap is breaking up into more free pieces (growing
+    fragmentation).
+
+    Callers are identified by the return address of the allocation function.
+    Memory allocated by C library functions (strdup(), for instance) or by C++
+    operator new is therefore charged to those functions rather than to their
+    callers.
+
+    \author The KallistiOS Team
+*/
+
+#ifndef __KOS_HEAPPROF_H
+#define __KOS_HEAPPROF_H
+
+#include <kos/cdefs.h>
+
+__BEGIN_DECLS
+
+#include <arch/types.h>
+
+/** \brief  Maximum number of distinct callers that can be profiled. */
+#define HEAPPROF_MAX_SITES  256
+
+/** \brief  Maximum number of sampled blocks that can be live at once. */
+#define HEAPPROF_MAX_LIVE   2048
+
+/** \brief  Number of size buckets.
+
+    Bucket 0 holds blocks of up to 16 bytes, and each bucket after that holds
+    blocks up to twice the size of the one before it. The last bucket holds
+    everything bigger than that.
+*/
+#define HEAPPROF_BUCKETS    16
+
+/** \brief  Largest block size counted in a size bucket.
+    \param  i               The bucket number.
+*/
+#define HEAPPROF_BUCKET_MAX(i)  (16UL << (i))
+
+/** \brief  Sampled allocations from one caller.
+
+    \headerfile kos/heapprof.h
+*/
+typedef struct heapprof_site {
+    /** \brief  The return address of the allocation function. */
+    uint32 caller;
+
+    /** \brief  Number of sampled allocations. */
+    uint32 allocs;
+
+    /** \brief  Number of sampled allocations that have since been freed. */
+    uint32 frees;
+
+    /** \brief  Total size of the sampled blocks still allocated. */
+    uint32 live_bytes;
+} heapprof_site_t;
+
+/** \brief  Sampled allocations in one size bucket.
+
+    \headerfile kos/heapprof.h
+*/
+typedef struct heapprof_bucket {
+    /** \brief  Number of sampled allocations. */
+    uint32 allocs;
+
+    /** \brief  Number of sampled allocations that have since been freed. */
+    uint32 frees;
+
+    /** \brief  Total size of the sampled blocks still allocated. */
+    uint32 live_bytes;
+} heapprof_bucket_t;
+
+/** \brief  Overall heap profiler statistics.
+
+    \headerfile kos/heapprof.h
+    \see    heapprof_get_stats()
+*/
+typedef struct heapprof_stats {
+    /** \brief  The sampling rate, or 0 if the profiler is stopped. */
+    uint32 rate;
+
+    /** \brief  Number of allocations sampled. */
+    uint32 samples;
+
+    /** \brief  Number of samples thrown away because a table was full. */
+    uint32 dropped;
+
+    /** \brief  Number of sampled blocks still allocated. */
+    uint32 live;
+
+    /** \brief  Sampled allocations by size.
+        \see    HEAPPROF_BUCKET_MAX */
+    heapprof_bucket_t sizes[HEAPPROF_BUCKETS];
+} heapprof_stats_t;
+
+/** \brief  Start sampling allocations.
+
+    The first time this is called, the profiler's tables are allocated from
+    the heap. If the profiler is already running, this just changes the
+    sampling rate.
+
+    \param  rate            Sample one out of every rate allocations. A rate of
+                            1 samples every allocation.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - rate is 0 \n
+    \em     ENOMEM - out of memory
+*/
+int heapprof_start(uint32 rate);
+
+/** \brief  Stop sampling allocations.
+
+    Blocks that have already been sampled are still tracked until they are
+    freed, so the live totals stay accurate.
+*/
+void heapprof_stop(void);
+
+/** \brief  Forget everything recorded so far.
+
+    If the profiler is stopped, its tables are also given back to the heap.
+*/
+void heapprof_reset(void);
+
+/** \brief  Retrieve the overall profiler statistics.
+
+    \param  stats           Storage for the statistics.
+    \retval 0               On success.
+*/
+int heapprof_get_stats(heapprof_stats_t *stats);
+
+/** \brief  Retrieve per-caller statistics, sorted by live bytes.
+
+    This function fills in the given array with the callers that are holding
+    on to the most sampled memory.
+
+    \param  sites           Storage for the statistics.
+    \param  count           The number of entries in the sites array.
+    \return                 The number of entries filled in.
+*/
+int heapprof_get_sites(heapprof_site_t *sites, int count);
+
+/** \brief  Print the heap profile.
+
+    The output includes the malloc() arena totals, the size histogram, and
+    every caller seen, sorted by address.
+
+    \param  pf              The printf-like function to print with.
+    \return                 0 on success, -1 if the profile could not be
+                            gathered.
+*/
+int heapprof_dump(int (*pf)(const char *fmt, ...));
+
+__END_DECLS
+
+#endif  /* __KOS_HEAPPROF_H */
@@ -0,0 +1,131 @@
+/* KallistiOS ##version##
+
+   include/kos/lockprof.h
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/** \file   kos/lockprof.h
+    \brief  Lock contention profiling.
+
+    This file defines an interface for finding out which locks threads spend
+    their time waiting on. When KOS is built with KOS_LOCK_PROFILE defined (see
+    kos/opts.h), every mutex, semaphore, reader/writer semaphore, and condition
+    variable records how many times it was acquired, how many of those times
+    the caller had to block, and how long it spent blocked.
+
+    Locks are tracked by their address, in a fixed-size table. Locks that live
+    on the stack may therefore share an entry with whatever used that address
+    before them. Use lockprof_set_name() to give important locks a name that
+    will show up in the output of lockprof_dump().
+
+    When lock profiling is not enabled, all of these functions are still
+    available, but do nothing.
+
+    \author The KallistiOS Team
+*/
+
+#ifndef __KOS_LOCKPROF_H
+#define __KOS_LOCKPROF_H
+
+#include <kos/cdefs.h>
+
+__BEGIN_DECLS
+
+#include <kos/opts.h>
+#include <arch/types.h>
+
+/** \defgroup lockprof_types        Lock types
+
+    These are the types of locks that are profiled.
+
+    @{
+*/
+#define LOCKPROF_MUTEX      0   /**< \brief mutex_t */
+#define LOCKPROF_SEMAPHORE  1   /**< \brief semaphore_t */
+#define LOCKPROF_RWSEM      2   /**< \brief rw_semaphore_t */
+#define LOCKPROF_CONDVAR    3   /**< \brief condvar_t */
+/** @} */
+
+/** \brief  Maximum number of locks that can be profiled at once. */
+#define LOCKPROF_MAX_LOCKS  512
+
+/** \brief  Contention statistics for one lock.
+
+    \headerfile kos/lockprof.h
+*/
+typedef struct lockprof_stats {
+    /** \brief  The address of the lock. */
+    const void *lock;
+
+    /** \brief  The name given to the lock, or NULL. */
+    const char *name;
+
+    /** \brief  The type of lock.
+        \see    lockprof_types */
+    int type;
+
+    /** \brief  Number of times the lock was acquired. For a condition
+                variable, this is the number of waits on it. */
+    uint32 acquired;
+
+    /** \brief  Number of times a caller had to block on the lock. */
+    uint32 contended;
+
+    /** \brief  Total time spent blocked on the lock, in microseconds. */
+    uint64 wait_total;
+
+    /** \brief  Longest single time spent blocked, in microseconds. */
+    uint64 wait_max;
+} lockprof_stats_t;
+
+/** \brief  Give a lock a name for profiling output.
+
+    \param  lock            The lock to name.
+    \param  name            The name to use. This string is not copied, so it
+                            must remain valid.
+*/
+void lockprof_set_name(const void *lock, const char *name);
+
+/** \brief  Retrieve lock statistics, sorted by total wait time.
+
+    This function fills in the given array with the statistics of the locks
+    that have been waited on the longest in total.
+
+    \param  stats           Storage for the statistics.
+    \param  count           The number of entries in the stats array.
+    \return                 The number of entries filled in.
+*/
+int lockprof_get(lockprof_stats_t *stats, int count);
+
+/** \brief  Print lock statistics, sorted by total wait time.
+
+    \param  pf              The printf-like function to print with.
+    \return                 0 on success, -1 if the statistics could not be
+                            gathered.
+*/
+int lockprof_dump(int (*pf)(const char *fmt, ...));
+
+/** \brief  Forget all lock statistics collected so far. */
+void lockprof_reset(void);
+
+/* \cond */
+#ifdef KOS_LOCK_PROFILE
+#include <arch/timer.h>
+
+void lockprof_record(const void *lock, int type, uint64 start, int acquired);
+
+#define LOCKPROF_DECL(v)    uint64 v = 0
+#define LOCKPROF_START(v)   ((v) = timer_us_gettime64())
+#define LOCKPROF_RECORD(lock, type, start, acquired) \
+    lockprof_record((lock), (type), (start), (acquired))
+#else
+#define LOCKPROF_DECL(v)
+#define LOCKPROF_START(v)   ((void)0)
+#define LOCKPROF_RECORD(lock, type, start, acquired) ((void)0)
+#endif
+/* \endcond */
+
+__END_DECLS
+
+#endif  /* __KOS_LOCKPROF_H */
@@ -41,7 +41,18 @@
     recursive_lock_t type that was available in KallistiOS for a while (before
     it was basically merged back into a normal mutex).
 
-    There is a fourth type of mutex defined (MUTEX_TYPE_DEFAULT), which maps to
+    A priority inheritance mutex (MUTEX_TYPE_PI) has the same rules as an
+    error-checking mutex, but when a thread blocks on it, the thread holding the
+    lock is temporarily boosted to the blocked thread's priority (if that is
+    higher). This also carries through chains of priority inheritance mutexes
+    (if the holder is itself blocked on another one, that holder is boosted as
+    well). The boost is dropped again when the lock is released, and the lock
+    is handed directly to the highest priority waiter. This prevents a low
+    priority thread holding a lock from indefinitely delaying a high priority
+    thread that needs it. Priority inheritance mutexes should not be locked
+    inside of an interrupt.
+
+    There is another type of mutex defined (MUTEX_TYPE_DEFAULT), which maps to
     the MUTEX_TYPE_NORMAL type. This is simply for alignment with POSIX.
 
     \author Lawrence Sebald
@@ -69,6 +80,7 @@ typedef struct kos_mutex {
     int dynamic;
     kthread_t *holder;
     int count;
+    LIST_ENTRY(kos_mutex) pi_list;
 } mutex_t;
 
 /** \defgroup mutex_types               Mutex types
@@ -81,19 +93,27 @@ typedef struct kos_mutex {
 #define MUTEX_TYPE_NORMAL       1   /**< \brief Normal mutex type */
 #define MUTEX_TYPE_ERRORCHECK   2   /**< \brief Error-checking mutex type */
 #define MUTEX_TYPE_RECURSIVE    3   /**< \brief Recursive mutex type */
+#define MUTEX_TYPE_PI           4   /**< \brief Priority inheritance type */
 
 /** \brief Default mutex type */
 #define MUTEX_TYPE_DEFAULT      MUTEX_TYPE_NORMAL
 /** @} */
 
 /** \brief  Initializer for a transient mutex. */
-#define MUTEX_INITIALIZER               { MUTEX_TYPE_NORMAL, 0, NULL, 0 }
+#define MUTEX_INITIALIZER \
+    { MUTEX_TYPE_NORMAL, 0, NULL, 0, { NULL, NULL } }
 
 /** \brief  Initializer for a transient error-checking mutex. */
-#define ERRORCHECK_MUTEX_INITIALIZER    { MUTEX_TYPE_ERRORCHECK, 0, NULL, 0 }
+#define ERRORCHECK_MUTEX_INITIALIZER \
+    { MUTEX_TYPE_ERRORCHECK, 0, NULL, 0, { NULL, NULL } }
 
 /** \brief  Initializer for a transient recursive mutex. */
-#define RECURSIVE_MUTEX_INITIALIZER     { MUTEX_TYPE_RECURSIVE, 0, NULL, 0 }
+#define RECURSIVE_MUTEX_INITIALIZER \
+    { MUTEX_TYPE_RECURSIVE, 0, NULL, 0, { NULL, NULL } }
+
+/** \brief  Initializer for a transient priority inheritance mutex. */
+#define PI_MUTEX_INITIALIZER \
+    { MUTEX_TYPE_PI, 0, NULL, 0, { NULL, NULL } }
 
 /** \brief  Allocate a new mutex.
 
@@ -250,6 +270,18 @@ int mutex_unlock(mutex_t *m);
 */
 int mutex_unlock_as_thread(mutex_t *m, kthread_t *thd);
 
+/** \cond */
+/* Recompute the priority of a thread (and anything down the chain of priority
+   inheritance mutexes it is blocked on) after something has changed. This is
+   for internal use only! */
+void mutex_pi_update(kthread_t *thd);
+
+/* Unlock every priority inheritance mutex that a thread holds, as it exits or
+   is destroyed, so that nothing is left pointing at it. This is for internal
+   use only! */
+void mutex_pi_release_all(kthread_t *thd);
+/** \endcond */
+
 __END_DECLS
 
 #endif  /* __KOS_MUTEX_H */
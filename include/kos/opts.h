@@ -52,7 +52,8 @@ __BEGIN_DECLS
 
 /* Enable this define if you want costly malloc debugging (buffer sentinel
    checking, block leak checking, etc). Recommended during debugging phases, but
-   you should probably take it out before you start your final testing. */
+   you should probably take it out before you start your final testing. For a
+   cheaper way to track down leaks, see the heap profiler in kos/heapprof.h. */
 /* #define KM_DBG 1 */
 
 /* Enable this define if you want REALLY verbose malloc debugging (print every
@@ -68,6 +69,13 @@ __BEGIN_DECLS
 /* #define PVR_KM_DBG_VERBOSE 1 */
 
 
+/* Enable this define if you want to profile lock contention. This records how
+   often each mutex, semaphore, reader/writer semaphore, and condition variable
+   is waited on and for how long. See kos/lockprof.h for how to get at the
+   results. */
+/* #define KOS_LOCK_PROFILE 1 */
+
+
 /* Aggregate debugging levels. It's probably best to enable these with your
    KOS_CFLAGS when compiling KOS itself, but they're all documented here and
    can be enabled here, if you really want to. */
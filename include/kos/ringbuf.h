@@ -0,0 +1,299 @@
+/* KallistiOS ##version##
+
+   include/kos/ringbuf.h
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/** \file   kos/ringbuf.h
+    \brief  Lock-free ring buffers.
+
+    This file defines a simple ring buffer of fixed-size elements that is safe
+    to share between an interrupt handler and a thread without disabling
+    interrupts. The producer only ever changes the head of the buffer and the
+    consumer only ever changes the tail, so as long as there is only one of
+    each, neither one needs to lock anything.
+
+    If there is more than one producer (for instance, several threads, or a
+    thread and an interrupt), use ringbuf_put_mp(), which briefly disables
+    interrupts to keep the producers from stepping on each other. Likewise,
+    ringbuf_get_wait() may be used by any number of consumer threads, as it
+    disables interrupts while it works.
+
+    The storage for the buffer is provided by the caller, and the number of
+    elements it holds must be a power of two. All of the functions here are
+    inline, so using a ring buffer doesn't cost a function call on the fast
+    path.
+
+    \author The KallistiOS Team
+*/
+
+#ifndef __KOS_RINGBUF_H
+#define __KOS_RINGBUF_H
+
+#include <kos/cdefs.h>
+
+__BEGIN_DECLS
+
+#include <string.h>
+#include <errno.h>
+#include <arch/types.h>
+#include <arch/irq.h>
+#include <kos/genwait.h>
+
+/** \brief  Ring buffer structure.
+
+    All members of this structure should be considered to be private.
+
+    \headerfile kos/ringbuf.h
+*/
+typedef struct ringbuf {
+    /* \cond */
+    uint8 *buf;                 /* Storage for the elements */
+    size_t elem_size;           /* Size of one element, in bytes */
+    uint32 mask;                /* Number of elements - 1 */
+    volatile uint32 head;       /* Free-running producer index */
+    volatile uint32 tail;       /* Free-running consumer index */
+    volatile int waiting;       /* Is a consumer sleeping on us? */
+    /* \endcond */
+} ringbuf_t;
+
+/** \brief  Initializer for a ring buffer.
+    \param  buf             Storage for the buffer.
+    \param  esize           The size of each element, in bytes.
+    \param  count           The number of elements (a power of two).
+*/
+#define RINGBUF_INITIALIZER(buf, esize, count) \
+    { (uint8 *)(buf), (esize), (count) - 1, 0, 0, 0 }
+
+/* \cond */
+#define __ringbuf_barrier() __asm__ __volatile__("" : : : "memory")
+/* \endcond */
+
+/** \brief  Initialize a ring buffer.
+
+    \param  rb              The ring buffer to initialize.
+    \param  buf             Storage for the buffer. This must be at least
+                            esize * count bytes.
+    \param  esize           The size of each element, in bytes.
+    \param  count           The number of elements the buffer can hold. This
+                            must be a power of two.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - count is not a power of two, or esize is 0
+*/
+static inline int ringbuf_init(ringbuf_t *rb, void *buf, size_t esize,
+                               uint32 count) {
+    if(!esize || !count || (count & (count - 1))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rb->buf = (uint8 *)buf;
+    rb->elem_size = esize;
+    rb->mask = count - 1;
+    rb->head = rb->tail = 0;
+    rb->waiting = 0;
+
+    return 0;
+}
+
+/** \brief  Throw away everything in a ring buffer.
+
+    This is not safe to call while a producer or consumer might be using the
+    buffer.
+
+    \param  rb              The ring buffer to empty.
+*/
+static inline void ringbuf_reset(ringbuf_t *rb) {
+    rb->head = rb->tail = 0;
+}
+
+/** \brief  Retrieve the number of elements in a ring buffer.
+    \param  rb              The ring buffer to look at.
+    \return                 The number of elements that can be read.
+*/
+static inline uint32 ringbuf_count(const ringbuf_t *rb) {
+    return rb->head - rb->tail;
+}
+
+/** \brief  Retrieve the amount of free space in a ring buffer.
+    \param  rb              The ring buffer to look at.
+    \return                 The number of elements that can be written.
+*/
+static inline uint32 ringbuf_space(const ringbuf_t *rb) {
+    return rb->mask + 1 - (rb->head - rb->tail);
+}
+
+/* \cond */
+/* Copy n elements in or out of the buffer, starting at index idx, dealing
+   with wrapping around the end. */
+static inline void __ringbuf_copy_in(ringbuf_t *rb, uint32 idx,
+                                     const void *src, uint32 n) {
+    uint32 pos = idx & rb->mask;
+    uint32 first = rb->mask + 1 - pos;
+
+    if(first > n)
+        first = n;
+
+    memcpy(rb->buf + pos * rb->elem_size, src, first * rb->elem_size);
+
+    if(n > first)
+        memcpy(rb->buf, (const uint8 *)src + first * rb->elem_size,
+               (n - first) * rb->elem_size);
+}
+
+static inline void __ringbuf_copy_out(ringbuf_t *rb, uint32 idx, void *dst,
+                                      uint32 n) {
+    uint32 pos = idx & rb->mask;
+    uint32 first = rb->mask + 1 - pos;
+
+    if(first > n)
+        first = n;
+
+    memcpy(dst, rb->buf + pos * rb->elem_size, first * rb->elem_size);
+
+    if(n > first)
+        memcpy((uint8 *)dst + first * rb->elem_size, rb->buf,
+               (n - first) * rb->elem_size);
+}
+/* \endcond */
+
+/** \brief  Add elements to a ring buffer (single producer).
+
+    This function copies as many of the given elements into the buffer as will
+    fit. It is safe to call from an interrupt, but only one producer may use
+    this function on a given buffer. Any consumer sleeping in
+    ringbuf_get_wait() is woken up.
+
+    \param  rb              The ring buffer to add to.
+    \param  elems           The elements to add.
+    \param  n               The number of elements to add.
+    \return                 The number of elements actually added.
+*/
+static inline uint32 ringbuf_put(ringbuf_t *rb, const void *elems, uint32 n) {
+    uint32 head = rb->head;
+    uint32 space = rb->mask + 1 - (head - rb->tail);
+
+    if(n > space)
+        n = space;
+
+    if(!n)
+        return 0;
+
+    __ringbuf_copy_in(rb, head, elems, n);
+
+    /* Make sure the data is there before the consumer can see it. */
+    __ringbuf_barrier();
+    rb->head = head + n;
+    __ringbuf_barrier();
+
+    if(rb->waiting) {
+        rb->waiting = 0;
+        genwait_wake_all(rb);
+    }
+
+    return n;
+}
+
+/** \brief  Add elements to a ring buffer (multiple producers).
+
+    This function works just like ringbuf_put(), but may be used by any number
+    of producers at once, in threads or interrupts.
+
+    \param  rb              The ring buffer to add to.
+    \param  elems           The elements to add.
+    \param  n               The number of elements to add.
+    \return                 The number of elements actually added.
+*/
+static inline uint32 ringbuf_put_mp(ringbuf_t *rb, const void *elems,
+                                    uint32 n) {
+    int old = irq_disable();
+
+    n = ringbuf_put(rb, elems, n);
+    irq_restore(old);
+
+    return n;
+}
+
+/** \brief  Remove elements from a ring buffer (single consumer).
+
+    This function copies up to n elements out of the buffer, without blocking.
+    It is safe to call from an interrupt, but only one consumer may use this
+    function on a given buffer.
+
+    \param  rb              The ring buffer to read from.
+    \param  elems           Storage for the elements.
+    \param  n               The maximum number of elements to read.
+    \return                 The number of elements actually read.
+*/
+static inline uint32 ringbuf_get(ringbuf_t *rb, void *elems, uint32 n) {
+    uint32 tail = rb->tail;
+    uint32 cnt = rb->head - tail;
+
+    if(n > cnt)
+        n = cnt;
+
+    if(!n)
+        return 0;
+
+    __ringbuf_barrier();
+    __ringbuf_copy_out(rb, tail, elems, n);
+
+    /* Don't let the producer reuse the space until we're done with it. */
+    __ringbuf_barrier();
+    rb->tail = tail + n;
+
+    return n;
+}
+
+/** \brief  Remove elements from a ring buffer, blocking if it is empty.
+
+    This function waits until there is at least one element in the buffer (or
+    the timeout expires), and then copies out as many as are available, up to
+    n. Any number of threads may use this function on a buffer at once, but it
+    may not be called from an interrupt.
+
+    \param  rb              The ring buffer to read from.
+    \param  elems           Storage for the elements.
+    \param  n               The maximum number of elements to read.
+    \param  timeout         The maximum time to wait (in milliseconds), or 0 to
+                            wait forever.
+    \return                 The number of elements read, or -1 on error.
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt \n
+    \em     ETIMEDOUT - the timeout expired with nothing to read
+*/
+static inline int ringbuf_get_wait(ringbuf_t *rb, void *elems, uint32 n,
+                                   int timeout) {
+    int old, rv;
+
+    if(irq_inside_int()) {
+        errno = EPERM;
+        return -1;
+    }
+
+    old = irq_disable();
+
+    while(rb->head == rb->tail) {
+        rb->waiting = 1;
+
+        if(genwait_wait(rb, "ringbuf_get_wait", timeout, NULL) < 0) {
+            irq_restore(old);
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+
+    rv = (int)ringbuf_get(rb, elems, n);
+    irq_restore(old);
+
+    return rv;
+}
+
+__END_DECLS
+
+#endif  /* __KOS_RINGBUF_H */
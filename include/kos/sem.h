@@ -131,6 +131,32 @@ int sem_wait(semaphore_t *sem);
  */
 int sem_wait_timed(semaphore_t *sem, int timeout);
 
+/** \brief  Wait on any one of several semaphores (with a timeout).
+
+    This function will decrement the count of the first semaphore in the list
+    that has resources available and return which one it was. If none of them
+    have resources available, the function will block until one of them does
+    or the timeout expires.
+
+    This function is not safe to call in an interrupt.
+
+    \param  sems            The semaphores to wait on
+    \param  cnt             The number of semaphores in sems (at most
+                            GENWAIT_MULTI_MAX)
+    \param  timeout         The maximum number of milliseconds to block (a value
+                            of 0 here will block indefinitely)
+    \return                 The index in sems of the semaphore that was
+                            acquired, or -1 on error (sets errno as appropriate)
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt \n
+    \em     EINVAL - one of the semaphores was not initialized \n
+    \em     EINVAL - the timeout value was invalid (less than 0) \n
+    \em     EINVAL - cnt was out of range \n
+    \em     ETIMEDOUT - timed out while blocking
+ */
+int sem_wait_any(semaphore_t **sems, int cnt, int timeout);
+
 /** \brief  "Wait" on a semaphore without blocking.
 
     This function will decrement the semaphore's count and return, if resources
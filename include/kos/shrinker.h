@@ -0,0 +1,147 @@
+/* KallistiOS ##version##
+
+   include/kos/shrinker.h
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/** \file   kos/shrinker.h
+    \brief  Memory pressure callbacks.
+
+    Many parts of KOS hold on to memory they don't strictly need, such as
+    cached disc sectors, spare slabs, and the slack at the end of files on the
+    ramdisk. A subsystem like that can register a shrinker, which is a
+    function that gives some of that memory back on request.
+
+    When malloc() can't satisfy a request, it runs the shrinkers, in priority
+    order, until enough memory has been freed, then tries again. The shrinkers
+    are also run when the amount of memory the heap can still grow into drops
+    below a watermark set with shrinker_set_watermark(), so that memory can be
+    freed before anything actually fails. Neither happens inside an interrupt
+    or with interrupts disabled.
+
+    A shrinker may be called from inside any allocation in any thread,
+    including one made by the subsystem that registered it while it holds its
+    own lock. Shrinkers should therefore use mutex_trylock() (or similar) and
+    simply return 0 if they can't get the lock. A shrinker may allocate memory,
+    but it will not cause any shrinkers to be run again.
+
+    \author The KallistiOS Team
+*/
+
+#ifndef __KOS_SHRINKER_H
+#define __KOS_SHRINKER_H
+
+#include <kos/cdefs.h>
+
+__BEGIN_DECLS
+
+#include <stddef.h>
+#include <sys/queue.h>
+
+/** \defgroup shrinker_prios        Shrinker priorities
+
+    Shrinkers are run from the lowest priority value to the highest, so the
+    ones that can give up memory most cheaply should have the lowest values.
+    Any value can be used; these are just suggestions.
+
+    @{
+*/
+#define SHRINKER_PRIO_SPARE     0   /**< \brief Memory not in use at all */
+#define SHRINKER_PRIO_CACHE     10  /**< \brief Clean data that can be reread */
+#define SHRINKER_PRIO_BUFFER    20  /**< \brief Memory whose loss hurts speed */
+/** @} */
+
+/** \brief  A memory pressure callback.
+
+    Fill in everything but the list entry and pass this to shrinker_register().
+    The structure must remain valid until it is unregistered.
+
+    \headerfile kos/shrinker.h
+*/
+typedef struct shrinker {
+    /* \cond */
+    TAILQ_ENTRY(shrinker) list;
+    /* \endcond */
+
+    /** \brief  A name for the shrinker, for debugging. */
+    const char *name;
+
+    /** \brief  The shrinker's priority.
+        \see    shrinker_prios */
+    int priority;
+
+    /** \brief  Free up memory.
+
+        \param  want        The number of bytes that the caller would like to
+                            have freed. Freeing more or less is fine.
+        \param  data        The data member of this structure.
+        \return             The number of bytes actually freed.
+    */
+    size_t (*shrink)(size_t want, void *data);
+
+    /** \brief  Data to pass to the shrink function. */
+    void *data;
+} shrinker_t;
+
+/** \brief  Register a shrinker.
+
+    This may be called before threads are initialized.
+
+    \param  s               The shrinker to register.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - no shrink function was given
+*/
+int shrinker_register(shrinker_t *s);
+
+/** \brief  Unregister a shrinker.
+
+    If the shrinkers are being run by another thread, this waits for them to
+    finish. It must not be called from a shrink function.
+
+    \param  s               The shrinker to unregister.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt or from a shrink function
+*/
+int shrinker_unregister(shrinker_t *s);
+
+/** \brief  Run the shrinkers.
+
+    Shrinkers are run in priority order until the requested amount of memory
+    has been freed, or until they have all been run. This is done
+    automatically by malloc(), but may also be called directly, for instance
+    before loading something large.
+
+    \param  want            The number of bytes to try to free.
+    \return                 The number of bytes freed. This is always 0 inside
+                            an interrupt, with interrupts disabled, before
+                            threads are initialized, while another thread is
+                            running the shrinkers, or when called from a shrink
+                            function.
+*/
+size_t shrinker_run(size_t want);
+
+/** \brief  Set the low memory watermark.
+
+    When the heap has to grow and is left with less than this much room to
+    grow into, the shrinkers are run to bring it back up to the watermark.
+
+    \param  bytes           The watermark, in bytes, or 0 to only run the
+                            shrinkers when an allocation fails (the default).
+*/
+void shrinker_set_watermark(size_t bytes);
+
+/** \brief  Retrieve the low memory watermark.
+    \return                 The watermark, in bytes.
+*/
+size_t shrinker_get_watermark(void);
+
+__END_DECLS
+
+#endif  /* __KOS_SHRINKER_H */
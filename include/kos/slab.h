@@ -0,0 +1,171 @@
+/* KallistiOS ##version##
+
+   include/kos/slab.h
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/** \file   kos/slab.h
+    \brief  Fixed-size object caches.
+
+    This file defines a slab allocator for small objects that are allocated
+    and freed over and over, such as file handles, sockets, and threads. Each
+    type of object gets its own cache, which carves objects out of larger
+    blocks (slabs) obtained from malloc(). Since all the objects in a slab are
+    the same size, handing them out and taking them back is very cheap, and
+    since they are packed together, long-running programs don't chop up the
+    heap with lots of little holes the way they would with plain malloc() and
+    free().
+
+    A cache may have a constructor, which is called on each object once, when
+    its slab is first allocated, rather than on every slab_alloc(). Objects
+    should therefore be returned to the cache in their constructed state.
+
+    slab_alloc() and slab_free() may be called inside an interrupt. Inside an
+    interrupt, slab_alloc() can only grow the cache if malloc() is not in use
+    at the time, so a cache that needs to work from an interrupt should be
+    primed ahead of time with slab_cache_reserve().
+
+    \author The KallistiOS Team
+*/
+
+#ifndef __KOS_SLAB_H
+#define __KOS_SLAB_H
+
+#include <kos/cdefs.h>
+
+__BEGIN_DECLS
+
+#include <stddef.h>
+#include <arch/types.h>
+
+/** \brief  Opaque type for an object cache. */
+typedef struct slab_cache slab_cache_t;
+
+/** \brief  Object cache statistics.
+
+    \headerfile kos/slab.h
+    \see    slab_cache_get_stats()
+*/
+typedef struct slab_stats {
+    /** \brief  The name of the cache. */
+    const char *name;
+
+    /** \brief  Size of each object, in bytes. */
+    size_t obj_size;
+
+    /** \brief  Size of each slab, in bytes. */
+    size_t slab_size;
+
+    /** \brief  Number of objects that fit in a slab. */
+    uint32 objs_per_slab;
+
+    /** \brief  Number of slabs currently allocated. */
+    uint32 slabs;
+
+    /** \brief  Number of objects currently allocated. */
+    uint32 in_use;
+
+    /** \brief  Largest number of objects that have been allocated at once. */
+    uint32 peak;
+
+    /** \brief  Total number of calls to slab_alloc() that succeeded. */
+    uint32 allocs;
+
+    /** \brief  Total number of calls to slab_free(). */
+    uint32 frees;
+
+    /** \brief  Total number of calls to slab_alloc() that failed. */
+    uint32 failures;
+} slab_stats_t;
+
+/** \brief  Create an object cache.
+
+    \param  name            A name for the cache, for statistics. This string
+                            is not copied, so it must remain valid.
+    \param  size            The size of each object, in bytes.
+    \param  align           The required alignment of each object (a power of
+                            two), or 0 for the same alignment as malloc().
+    \param  ctor            A function to set up each object when its slab is
+                            allocated, or NULL.
+    \return                 The new cache, or NULL on error (errno will be set
+                            as appropriate).
+
+    \par    Error Conditions:
+    \em     EINVAL - size is 0, or align is not a power of two \n
+    \em     ENOMEM - out of memory
+*/
+slab_cache_t *slab_cache_create(const char *name, size_t size, size_t align,
+                                void (*ctor)(void *obj));
+
+/** \brief  Destroy an object cache.
+
+    All objects allocated from the cache must have been freed.
+
+    \param  cache           The cache to destroy.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EBUSY - objects from the cache are still in use
+*/
+int slab_cache_destroy(slab_cache_t *cache);
+
+/** \brief  Allocate an object from a cache.
+
+    \param  cache           The cache to allocate from.
+    \return                 The object, or NULL if out of memory (errno will
+                            be set to ENOMEM).
+*/
+void *slab_alloc(slab_cache_t *cache);
+
+/** \brief  Return an object to its cache.
+
+    \param  cache           The cache the object was allocated from.
+    \param  obj             The object to free. NULL is ignored.
+*/
+void slab_free(slab_cache_t *cache, void *obj);
+
+/** \brief  Make sure a cache has some objects ready to go.
+
+    This function allocates enough slabs so that the given number of objects
+    can be allocated without going back to malloc(), which is useful for
+    caches that are used inside interrupts. It may not be called inside an
+    interrupt.
+
+    \param  cache           The cache to fill up.
+    \param  count           The number of free objects to have ready.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt \n
+    \em     ENOMEM - out of memory
+*/
+int slab_cache_reserve(slab_cache_t *cache, uint32 count);
+
+/** \brief  Give a cache's unused slabs back to malloc().
+
+    \param  cache           The cache to shrink.
+    \return                 The number of bytes freed.
+*/
+size_t slab_cache_shrink(slab_cache_t *cache);
+
+/** \brief  Retrieve the statistics for a cache.
+
+    \param  cache           The cache to look at.
+    \param  stats           Storage for the statistics.
+    \retval 0               On success.
+*/
+int slab_cache_get_stats(slab_cache_t *cache, slab_stats_t *stats);
+
+/** \brief  Print statistics for all object caches.
+
+    \param  pf              The printf-like function to print with.
+    \retval 0               On success.
+*/
+int slab_dump(int (*pf)(const char *fmt, ...));
+
+__END_DECLS
+
+#endif  /* __KOS_SLAB_H */
@@ -0,0 +1,85 @@
+/* KallistiOS ##version##
+
+   include/kos/tasklet.h
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/** \file   kos/tasklet.h
+    \brief  Deferred interrupt work (tasklets).
+
+    This file defines a facility for pushing work out of interrupt handlers.
+    An interrupt handler can call tasklet_schedule() to queue up a function to
+    be called later in a normal thread context, where it is safe to block on
+    mutexes and the like. This keeps the time spent with interrupts disabled
+    short.
+
+    Tasklets are run in order by a single kernel thread at the highest
+    priority in the system. If threads are pre-emptive, that thread is switched
+    to as soon as the interrupt that scheduled the tasklet returns, so there is
+    normally very little delay before a tasklet runs. Since all tasklets share
+    one thread, a tasklet should not block for long.
+
+    \author The KallistiOS Team
+*/
+
+#ifndef __KOS_TASKLET_H
+#define __KOS_TASKLET_H
+
+#include <kos/cdefs.h>
+
+__BEGIN_DECLS
+
+#include <kos/thread.h>
+
+/** \brief  Number of tasklets that can be queued at once.
+
+    This must be a power of two.
+*/
+#define TASKLET_QUEUE_SIZE  256
+
+/** \brief  Priority of the thread that runs tasklets. */
+#define TASKLET_PRIO        0
+
+/** \brief  Tasklet function type.
+    \param  data            The data pointer passed to tasklet_schedule().
+*/
+typedef void (*tasklet_func_t)(void *data);
+
+/** \brief  Queue up a function to be run outside of interrupt context.
+
+    This function adds a function call to the tasklet queue. It is safe (and
+    intended) to call this from within an interrupt. If called outside of an
+    interrupt, the function is still run by the tasklet thread, rather than by
+    the caller.
+
+    \param  func            The function to call.
+    \param  data            Data to pass to the function.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EAGAIN - the tasklet queue is full
+*/
+int tasklet_schedule(tasklet_func_t func, void *data);
+
+/** \brief  Retrieve the number of tasklets dropped because the queue was
+            full.
+
+    \return                 The number of tasklets that could not be queued.
+*/
+uint32 tasklet_dropped(void);
+
+/* \cond */
+/* Called by the interrupt code just before returning from an interrupt, to
+   switch to the tasklet thread if there is work for it to do. */
+void tasklet_irq_exit(void);
+
+/* Init/shutdown, called by the threading system. */
+int tasklet_init(void);
+void tasklet_shutdown(void);
+/* \endcond */
+
+__END_DECLS
+
+#endif  /* __KOS_TASKLET_H */
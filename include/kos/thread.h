@@ -73,12 +73,112 @@ __BEGIN_DECLS
 
 /* Pre-define list/queue types */
 struct kthread;
+struct kos_mutex;
+struct genwait_multi;
 
 /* \cond */
 TAILQ_HEAD(ktqueue, kthread);
 LIST_HEAD(ktlist, kthread);
+LIST_HEAD(kthread_pi_list, kos_mutex);
 /* \endcond */
 
+/** \brief  Per-thread scheduler statistics.
+
+    This structure holds the accounting information that the scheduler keeps
+    for each thread. All times are in microseconds. Use thd_get_stats() to
+    retrieve a consistent snapshot of these for a thread.
+
+    \headerfile kos/thread.h
+*/
+typedef struct kthread_stats {
+    /** \brief  Total time spent running on the CPU. */
+    uint64 run_time;
+
+    /** \brief  Total time spent ready to run, but waiting for the CPU. */
+    uint64 ready_time;
+
+    /** \brief  Total time spent blocked in genwait_wait(). */
+    uint64 wait_time;
+
+    /** \brief  Number of times the thread gave up the CPU itself (by
+                blocking, sleeping, exiting, or calling thd_pass()). */
+    uint32 switches_vol;
+
+    /** \brief  Number of times the thread was preempted. */
+    uint32 switches_invol;
+
+    /** \brief  Number of times a periodic thread has been released.
+        \see    thd_wait_period()  */
+    uint32 releases;
+
+    /** \brief  Number of releases of a periodic thread that finished after
+                their deadline or were skipped entirely. */
+    uint32 deadline_misses;
+} kthread_stats_t;
+
+/** \brief  Periodic thread parameters.
+
+    A periodic thread is one that does a bit of work at a fixed rate, such as
+    once per frame. Rather than sleeping for some amount of time after each
+    bit of work (which drifts by however long the work took, plus however late
+    the thread was woken), a periodic thread calls thd_wait_period() when it is
+    done, and is woken at the start of the next period, measured from when the
+    last one was supposed to start.
+
+    A thread may either be released every period microseconds, or every so
+    many vertical blanks. The latter wakes the thread straight from the
+    vertical blank interrupt, so it's the one to use for anything that needs to
+    keep in step with the display. Timed releases are only as accurate as the
+    scheduler's timer, so they will be up to 1000 / HZ milliseconds late unless
+    the threading system is in tickless mode.
+
+    \headerfile kos/thread.h
+    \see    thd_set_periodic()
+*/
+typedef struct kthread_periodic {
+    /** \brief  Time between releases, in microseconds. */
+    uint32 period;
+
+    /** \brief  Time after each release by which the thread should have called
+                thd_wait_period(), in microseconds. If this is 0, the deadline
+                is the next release. */
+    uint32 deadline;
+
+    /** \brief  If non-zero, release the thread every this many vertical
+                blanks rather than every period microseconds. */
+    uint32 vblank;
+} kthread_periodic_t;
+
+/** \brief  Thread object cache statistics.
+
+    When threads are destroyed, their kthread_t structures (and stacks, if the
+    kernel allocated them) are kept around in a small cache so that later calls
+    to thd_create_ex() can reuse them rather than going back to malloc(). This
+    structure reports how well that cache is doing.
+
+    \headerfile kos/thread.h
+    \see    thd_cache_get_stats()
+*/
+typedef struct kthread_cache_stats {
+    /** \brief  Number of thread creations satisfied from the cache. */
+    uint32 hits;
+
+    /** \brief  Number of thread creations that had to allocate memory. */
+    uint32 misses;
+
+    /** \brief  Number of threads currently held in the cache. */
+    uint32 count;
+
+    /** \brief  Total size of the stacks currently held in the cache. */
+    uint32 stack_bytes;
+} kthread_cache_stats_t;
+
+/** \brief  Default number of dead threads kept around for reuse. */
+#define THD_CACHE_DEFAULT_COUNT 8
+
+/** \brief  Default size of the largest stack that will be cached. */
+#define THD_CACHE_DEFAULT_STACK (THD_STACK_SIZE * 2)
+
 /** \brief  Structure describing one running thread.
 
     Each thread has one of this structure assigned to it, which hold all the
@@ -94,15 +194,28 @@ typedef struct kthread {
     /** \brief  Run/Wait queue handle. Once again, not a function. */
     TAILQ_ENTRY(kthread) thdq;
 
-    /** \brief  Timer queue handle (if applicable). Also not a function. */
-    TAILQ_ENTRY(kthread) timerq;
+    /** \brief  Timer queue handle (if applicable). Also not a function.
+
+        The timer queue is a pairing heap keyed on wait_timeout. These point to
+        the first child of this node, its next sibling, and either its previous
+        sibling or its parent (if it is the first child). */
+    struct {
+        struct kthread *child;
+        struct kthread *next;
+        struct kthread *prev;
+    } timerq;
 
     /** \brief  Kernel thread id. */
     tid_t tid;
 
-    /** \brief  Static priority: 0..PRIO_MAX (higher means lower priority). */
+    /** \brief  Dynamic priority: 0..PRIO_MAX (higher means lower priority).
+        This is the priority that the scheduler actually uses, which may be
+        boosted above real_prio by priority inheritance. */
     prio_t prio;
 
+    /** \brief  Static priority, as set by thd_set_prio(). */
+    prio_t real_prio;
+
     /** \brief  Thread flags.
         \see    thd_flags   */
     uint32 flags;
@@ -128,6 +241,10 @@ typedef struct kthread {
     */
     void (*wait_callback)(void * obj);
 
+    /** \brief  Objects being waited on, if waiting on more than one.
+        \see    genwait_wait_multi()  */
+    struct genwait_multi *wait_multi;
+
     /** \brief  Next scheduled time.
         This value is used for sleep and timed block operations. This value is
         in milliseconds since the start of timer_ms_gettime(). This should be
@@ -159,11 +276,38 @@ typedef struct kthread {
 
     /** \brief  Thread-local storage.
         \see    kos/tls.h   */
-    struct kthread_tls_kv_list tls_list;
+    kthread_tls_t tls;
 
     /** \brief  Return value of the thread function.
         This is only used in joinable threads.  */
     void *rv;
+
+    /** \brief  Priority inheritance mutex this thread is blocked on, if any.
+        \see    kos/mutex.h    */
+    struct kos_mutex *pi_wait;
+
+    /** \brief  Priority inheritance mutexes currently held by this thread.
+        \see    kos/mutex.h    */
+    struct kthread_pi_list pi_held;
+
+    /** \brief  Scheduler statistics.
+        \see    thd_get_stats()   */
+    kthread_stats_t stats;
+
+    /** \brief  Time of the last state change, in microseconds. This is used
+                to update the statistics above. */
+    uint64 stats_stamp;
+
+    /** \brief  Periodic release parameters, if this is a periodic thread.
+        \see    thd_set_periodic()  */
+    kthread_periodic_t periodic;
+
+    /** \brief  Time of the current periodic release, in microseconds. */
+    uint64 period_release;
+
+    /** \brief  Vertical blank count at which the next release is due, for
+                threads released by the vertical blank. */
+    uint32 period_vblank;
 } kthread_t;
 
 /** \defgroup thd_flags             Thread flag values
@@ -177,6 +321,7 @@ typedef struct kthread {
 #define THD_USER        1       /**< \brief Thread runs in user mode */
 #define THD_QUEUED      2       /**< \brief Thread is in the run queue */
 #define THD_DETACHED    4       /**< \brief Thread is detached */
+#define THD_OWN_STACK   8       /**< \brief Stack was allocated by the kernel */
 /** @} */
 
 /** \defgroup thd_states            Thread states
@@ -212,6 +357,10 @@ typedef struct kthread_attr {
     uint32 stack_size;
 
     /** \brief  Pre-allocate a stack for the thread.
+
+        The stack must come from malloc() (or similar). The thread takes
+        ownership of it, and it is freed when the thread is destroyed.
+
         \note   If you use this attribute, you must also set stack_size. */
     void *stack_ptr;
 
@@ -228,11 +377,21 @@ typedef struct kthread_attr {
     represents the type of scheduling done by the system (or the special case of
     threads not having been initialized yet).
 
+    Tickless mode is a variant of preemptive mode where the timer interrupt is
+    only requested when the scheduler actually needs to run. That is, at the end
+    of a timeslice if another thread of the same (or better) priority is waiting
+    to run, or when the next timed genwait_wait() (including thd_sleep()) is due
+    to expire. In a mostly idle system, this avoids taking HZ interrupts per
+    second for no reason. Scheduling is strictly by priority in both modes; the
+    only difference is that there is no periodic tick, so threads of the same
+    priority are rotated only when the next timer or wakeup event comes in.
+
     @{
 */
 #define THD_MODE_NONE       -1  /**< \brief Threads not running */
 #define THD_MODE_COOP       0   /**< \brief Cooperative threading mode */
 #define THD_MODE_PREEMPT    1   /**< \brief Preemptive threading mode */
+#define THD_MODE_TICKLESS   2   /**< \brief Tickless preemptive mode */
 /** @} */
 
 /** \brief  The currently executing thread.
@@ -272,6 +431,12 @@ int thd_block_now(irq_context_t * mycxt);
 irq_context_t * thd_choose_new();
 
 /** \brief  Given a thread ID, locates the thread structure.
+
+    Thread IDs may be reused after a thread has been destroyed, but each reuse
+    gets a new generation count, so an old thread ID will not look up a newer
+    thread that happens to have taken its place until at least 16 million
+    more threads have been created. At most 4095 threads can exist at once.
+
     \param  tid             The thread ID to retrieve.
 
     \return                 The thread on success, NULL on failure.
@@ -382,6 +547,12 @@ void thd_schedule(int front_of_line, uint64 now);
 */
 void thd_schedule_next(kthread_t *thd);
 
+/* \cond */
+/* Release periodic threads bound to the vertical blank. Called from the
+   vertical blank interrupt. */
+void thd_periodic_vblank(void);
+/* \endcond */
+
 /** \brief  Throw away the current thread's timeslice.
 
     This function manually yields the current thread's timeslice to the system,
@@ -405,7 +576,9 @@ void thd_sleep(int ms);
 
     This function is used to change the priority value of a thread. If the
     thread is scheduled already, it will be rescheduled with the new priority
-    value.
+    value. If the thread holds any priority inheritance mutexes, it will keep
+    running at the priority of its highest priority waiter, if that is higher
+    than the new value.
 
     \param  thd             The thread to change the priority of.
     \param  prio            The priority value to assign to the thread.
@@ -530,6 +703,88 @@ int thd_join(kthread_t * thd, void **value_ptr);
 */
 int thd_detach(kthread_t *thd);
 
+/** \brief  Retrieve scheduler statistics for a thread.
+
+    This function retrieves a snapshot of the time accounting and context
+    switch counts for the given thread. If the thread is currently running, the
+    time it has been running in its current timeslice is included.
+
+    \param  thd             The thread to retrieve statistics for, or NULL for
+                            the current thread.
+    \param  stats           Storage for the statistics.
+
+    \retval 0               On success.
+    \retval -1              On error (invalid parameters).
+*/
+int thd_get_stats(kthread_t *thd, kthread_stats_t *stats);
+
+/** \brief  Make a thread periodic (or not).
+
+    This function sets the release parameters for a thread, with its current
+    release considered to start now. Threads are never periodic unless this is
+    called, so a thread that should start out periodic can call it on itself
+    (passing NULL for \p thd) as the first thing it does.
+
+    \param  thd             The thread to modify, or NULL for the current
+                            thread.
+    \param  params          The new parameters, or NULL to make the thread
+                            no longer periodic.
+
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - the parameters have neither a period nor a vblank count
+*/
+int thd_set_periodic(kthread_t *thd, const kthread_periodic_t *params);
+
+/** \brief  Wait for the next release of the current periodic thread.
+
+    A periodic thread should call this function each time it finishes its
+    work. If the thread has fallen so far behind that whole releases have
+    passed while it was busy, those releases are skipped (and counted as
+    deadline misses in the thread's statistics), rather than running the
+    thread back-to-back to catch up.
+
+    \return                 The number of releases skipped, or -1 on error.
+
+    \par    Error Conditions:
+    \em     EINVAL - the current thread is not periodic \n
+    \em     EPERM - called inside an interrupt
+*/
+int thd_wait_period(void);
+
+/** \brief  Set the limits on the thread object cache.
+
+    This function sets how many dead threads may be kept around to be reused by
+    thd_create_ex(), and how large a stack may be for it to be kept. Stacks are
+    only reused for threads asking for exactly the same stack size. Any threads
+    already in the cache that fall outside of the new limits are freed.
+
+    \param  count           The maximum number of threads to cache. Use 0 to
+                            disable the cache entirely.
+    \param  max_stack       The largest stack size (in bytes) to cache.
+
+    \retval 0               On success (no error conditions defined).
+*/
+int thd_cache_set_limits(size_t count, size_t max_stack);
+
+/** \brief  Retrieve statistics about the thread object cache.
+
+    \param  stats           Storage for the statistics.
+
+    \retval 0               On success.
+    \retval -1              On error (invalid parameters).
+*/
+int thd_cache_get_stats(kthread_cache_stats_t *stats);
+
+/** \brief  Free everything held in the thread object cache.
+
+    This function releases all of the memory that is being held for reuse by
+    future threads. The hit and miss counters are not reset.
+*/
+void thd_cache_flush(void);
+
 /** \brief Iterate all threads and call the passed callback for each
 
     \param cb               The callback to call for each thread
@@ -26,32 +26,32 @@ __BEGIN_DECLS
 /** \brief  Thread-local storage key type. */
 typedef int kthread_key_t;
 
-/** \brief  Thread-local storage key-value pair.
+/** \brief  Number of thread-local storage values stored inline per thread.
 
-    This is the structure that is actually used to store the specific value for
-    a thread for a single TLS key.
+    The values for the first this many keys are stored directly in each
+    thread's structure. Values for any keys beyond that are stored in a table
+    that is allocated as needed.
+*/
+#define KTHREAD_TLS_INLINE  8
+
+/** \brief  Per-thread thread-local storage values.
+
+    This is the structure that is actually used to store the specific values
+    for a thread. Both lookups and updates are simple array indexing.
 
     You will not end up using these directly at all in programs, as they are
     only used internally.
 */
-typedef struct kthread_tls_kv {
-    /** \brief  List handle -- NOT a function. */
-    LIST_ENTRY(kthread_tls_kv) kv_list;
-
-    /** \brief  The key associated with this data. */
-    kthread_key_t key;
+typedef struct kthread_tls {
+    /** \brief  Values for keys 1 through KTHREAD_TLS_INLINE. */
+    void *data[KTHREAD_TLS_INLINE];
 
-    /** \brief  The value of the data. */
-    void *data;
+    /** \brief  Values for any keys beyond KTHREAD_TLS_INLINE. */
+    void **overflow;
 
-    /** \brief  Optional destructor for the value (set per key). */
-    void (*destructor)(void *);
-} kthread_tls_kv_t;
-
-/** \cond */
-/* TLS Key-Value pair list type. */
-LIST_HEAD(kthread_tls_kv_list, kthread_tls_kv);
-/** \endcond */
+    /** \brief  Number of entries allocated in overflow. */
+    int overflow_size;
+} kthread_tls_t;
 
 /** \cond */
 /* Retrieve the next key value (i.e, what key the next kthread_key_create will
@@ -71,7 +71,10 @@ kthread_key_t kthread_key_next();
     \param  destructor  A destructor for use with this key. If it is non-NULL,
                         and a value associated with the key is non-NULL at
                         thread exit, then the destructor will be called with the
-                        value as its argument.
+                        value as its argument. It is never called for a NULL
+                        value, even one set explicitly with
+                        kthread_setspecific() (older versions of KOS called it
+                        for any key the thread had set).
     \retval -1      On failure, and sets errno to one of the following: EPERM if
                     called inside an interrupt and another call is in progress,
                     ENOMEM if out of memory.
@@ -110,16 +113,17 @@ int kthread_setspecific(kthread_key_t key, const void *value);
     key. This function <em>does not</em> cause any destructors to be called.
 
     \param  key     The key to delete.
-    \retval -1      On failure, and sets errno to one of the following: EINVAL
-                    if the key is invalid, EPERM if unsafe to call free.
+    \retval -1      On failure, and sets errno to EINVAL if the key is
+                    invalid.
     \retval 0       On success.
 */
 int kthread_key_delete(kthread_key_t key);
 
 /** \cond */
-/* Delete the destructor for a given key. This function is for internal use
-   only! */
-void kthread_key_delete_destructor(kthread_key_t key);
+/* Call destructors for and free a thread's TLS data. This function is for
+   internal use only! */
+struct kthread;
+void kthread_tls_destroy(struct kthread *thd);
 
 /* Initialization and shutdown. Once again, internal use only. */
 int kthread_tls_init();
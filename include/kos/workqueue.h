@@ -0,0 +1,228 @@
+/* KallistiOS ##version##
+
+   include/kos/workqueue.h
+   Copyright (C) 2026 The KallistiOS Team
+
+*/
+
+/** \file   kos/workqueue.h
+    \brief  Kernel work queues.
+
+    This file defines a work queue facility. A work queue is a fixed pool of
+    worker threads (all running at the same priority) that run work items
+    submitted to the queue. This lets drivers and programs push work off to
+    the background without having to create a new thread for each job.
+
+    A work item is simply a function to call and a pointer to some data for it.
+    Work items are owned by the caller, and must stay valid until they have
+    either been run or cancelled. A work item can be submitted to run as soon
+    as possible, or after a delay. Once a work item has started running, it is
+    no longer considered to be pending, so the work function may resubmit (or
+    free) its own work item if it wants to.
+
+    \author The KallistiOS Team
+*/
+
+#ifndef __KOS_WORKQUEUE_H
+#define __KOS_WORKQUEUE_H
+
+#include <kos/cdefs.h>
+
+__BEGIN_DECLS
+
+#include <sys/queue.h>
+#include <kos/thread.h>
+
+struct kos_work;
+struct kos_workqueue;
+
+/** \brief  Work function type.
+    \param  work            The work item being run.
+*/
+typedef void (*kos_work_func_t)(struct kos_work *work);
+
+/** \brief  Work item structure.
+
+    Only the func and data members of this structure are meant to be touched
+    by users, and only while the work item is not pending. Use work_init() or
+    WORK_INITIALIZER to set one up.
+
+    \headerfile kos/workqueue.h
+*/
+typedef struct kos_work {
+    /** \brief  The function to call. */
+    kos_work_func_t func;
+
+    /** \brief  User data for the work function. */
+    void *data;
+
+    /* \cond */
+    TAILQ_ENTRY(kos_work) entry;
+    struct kos_workqueue *wq;       /* Only set while pending or delayed */
+    uint64 when;
+    int state;
+    /* \endcond */
+} kos_work_t;
+
+/** \brief  Initializer for a work item.
+    \param  func            The function to call.
+    \param  data            User data for the work function.
+*/
+#define WORK_INITIALIZER(func, data) { (func), (data), { NULL, NULL }, NULL, \
+                                       0, 0 }
+
+/* \cond */
+TAILQ_HEAD(kos_work_list, kos_work);
+/* \endcond */
+
+/** \brief  Work queue structure.
+
+    All members of this structure should be considered to be private. Use
+    workqueue_create() to make one.
+
+    \headerfile kos/workqueue.h
+*/
+typedef struct kos_workqueue {
+    /* \cond */
+    struct kos_work_list pending;
+    struct kos_work_list delayed;
+    int nthreads;
+    kthread_t **threads;
+    kos_work_t **current;
+    int shutdown;
+    LIST_ENTRY(kos_workqueue) list;
+    /* \endcond */
+} workqueue_t;
+
+/** \brief  Initialize a work item.
+
+    \param  work            The work item to initialize.
+    \param  func            The function to call.
+    \param  data            User data for the work function.
+*/
+void work_init(kos_work_t *work, kos_work_func_t func, void *data);
+
+/** \brief  Create a work queue.
+
+    This function creates a new work queue with the given number of worker
+    threads.
+
+    \param  label           A name for the queue. This is used to label the
+                            worker threads. May be NULL.
+    \param  threads         The number of worker threads to create.
+    \param  prio            The priority to run the worker threads at.
+    \return                 The new work queue, or NULL on failure.
+
+    \par    Error Conditions:
+    \em     EINVAL - threads was less than 1 \n
+    \em     EPERM - called inside an interrupt \n
+    \em     ENOMEM - out of memory
+*/
+workqueue_t *workqueue_create(const char *label, int threads, prio_t prio);
+
+/** \brief  Destroy a work queue.
+
+    This function shuts down a work queue. Any work that has already been
+    submitted for immediate execution is run first, but delayed work that is
+    not due yet is dropped. This function waits for all of the worker threads
+    to exit before freeing the queue.
+
+    \param  wq              The work queue to destroy.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt \n
+    \em     EDEADLK - called from one of the queue's own worker threads
+*/
+int workqueue_destroy(workqueue_t *wq);
+
+/** \brief  Submit a work item to run as soon as possible.
+
+    This function adds the work item to the end of the queue. It is safe to
+    call this function inside an interrupt.
+
+    \param  wq              The work queue to submit to.
+    \param  work            The work item to run.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EBUSY - the work item is already pending \n
+    \em     EINVAL - the work queue is being destroyed
+*/
+int workqueue_submit(workqueue_t *wq, kos_work_t *work);
+
+/** \brief  Submit a work item to run after a delay.
+
+    This function arranges for the work item to be added to the queue once the
+    given number of milliseconds have passed. It is safe to call this function
+    inside an interrupt.
+
+    \param  wq              The work queue to submit to.
+    \param  work            The work item to run.
+    \param  delay           How long to wait (in milliseconds) before running
+                            the work. 0 is the same as workqueue_submit().
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EBUSY - the work item is already pending \n
+    \em     EINVAL - the work queue is being destroyed, or delay is negative
+*/
+int workqueue_submit_delayed(workqueue_t *wq, kos_work_t *work, int delay);
+
+/** \brief  Cancel a pending work item.
+
+    This function removes a work item from its queue if it has not started
+    running yet. It does not wait for a work item that is already running; use
+    workqueue_wait() for that. It is safe to call this function inside an
+    interrupt.
+
+    \param  work            The work item to cancel.
+    \retval 0               On success (the work will not be run).
+    \retval -1              If the work item was not pending.
+
+    \par    Error Conditions:
+    \em     EALREADY - the work item is not pending (it is running, has
+                       already run, or was never submitted)
+*/
+int workqueue_cancel(kos_work_t *work);
+
+/** \brief  Wait for a work item to complete.
+
+    This function blocks until the work item is neither pending nor running.
+
+    \param  work            The work item to wait for.
+    \param  timeout         Maximum time to wait (in milliseconds), or 0 to
+                            wait forever.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt \n
+    \em     EDEADLK - called from the work function itself \n
+    \em     EINVAL - the timeout is negative \n
+    \em     ETIMEDOUT - the timeout expired
+*/
+int workqueue_wait(kos_work_t *work, int timeout);
+
+/** \brief  Wait for all submitted work in a queue to complete.
+
+    This function blocks until there is no work waiting to run and all of the
+    worker threads are idle. Delayed work that is not yet due is not waited
+    for.
+
+    \param  wq              The work queue to flush.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EPERM - called inside an interrupt \n
+    \em     EDEADLK - called from one of the queue's own worker threads
+*/
+int workqueue_flush(workqueue_t *wq);
+
+__END_DECLS
+
+#endif  /* __KOS_WORKQUEUE_H */
@@ -174,6 +174,12 @@ extern "C" {
 
     /* Mutex Initialization Scheduling Attributes, P1003.1c/Draft 10, p. 128 */
 
+#ifndef PTHREAD_PRIO_NONE
+#define PTHREAD_PRIO_NONE    0
+#define PTHREAD_PRIO_INHERIT 1
+#define PTHREAD_PRIO_PROTECT 2
+#endif
+
     int _EXFUN(pthread_mutexattr_setprotocol,
                (pthread_mutexattr_t *attr, int protocol));
     int _EXFUN(pthread_mutexattr_getprotocol,
@@ -289,6 +295,37 @@ extern "C" {
     void    _EXFUN(pthread_cleanup_push, (void (*routine)(void *), void *arg));
     void    _EXFUN(pthread_cleanup_pop, (int execute));
 
+#if defined(_POSIX_BARRIERS)
+
+    /* Barrier Initialization Attributes, P1003.1j/D10, p. 30 */
+
+#ifndef PTHREAD_PROCESS_PRIVATE
+#define PTHREAD_PROCESS_PRIVATE 0   /* visible within only the creating process */
+#define PTHREAD_PROCESS_SHARED  1   /* visible to all processes (unsupported) */
+#endif
+
+    int _EXFUN(pthread_barrierattr_init, (pthread_barrierattr_t *attr));
+    int _EXFUN(pthread_barrierattr_destroy, (pthread_barrierattr_t *attr));
+    int _EXFUN(pthread_barrierattr_getpshared,
+               (const pthread_barrierattr_t *attr, int *pshared));
+    int _EXFUN(pthread_barrierattr_setpshared,
+               (pthread_barrierattr_t *attr, int pshared));
+
+    /* Initializing and Destroying a Barrier, P1003.1j/D10, p. 33 */
+
+    int _EXFUN(pthread_barrier_init,
+               (pthread_barrier_t *barrier,
+                const pthread_barrierattr_t *attr, unsigned count));
+    int _EXFUN(pthread_barrier_destroy, (pthread_barrier_t *barrier));
+
+    /* Synchronizing at a Barrier, P1003.1j/D10, p. 36 */
+
+#define PTHREAD_BARRIER_SERIAL_THREAD -1
+
+    int _EXFUN(pthread_barrier_wait, (pthread_barrier_t *barrier));
+
+#endif /* defined(_POSIX_BARRIERS) */
+
 #if defined(_POSIX_THREAD_CPUTIME)
 
     /* Accessing a Thread CPU-time Clock, P1003.4b/D8, p. 58 */
@@ -17,4 +17,10 @@
 /** \brief  POSIX timers supported (not really) */
 #define _POSIX_TIMERS
 
+/** \brief  POSIX priority inheritance mutexes supported */
+#define _POSIX_THREAD_PRIO_INHERIT
+
+/** \brief  POSIX barriers supported */
+#define _POSIX_BARRIERS
+
 #endif  /* __SYS__PTHREAD_H */
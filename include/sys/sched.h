@@ -31,16 +31,17 @@ struct sched_param {
 #include <kos/mutex.h>
 #include <kos/tls.h>
 #include <kos/once.h>
+#include <kos/barrier.h>
 
 // Missing structs we don't care about in this impl.
 /** \brief  POSIX mutex attributes.
 
-    Not implemented in KOS.
+    Only the protocol attribute is implemented in KOS.
 
     \headerfile sys/sched.h
 */
 typedef struct {
-    // Empty
+    int protocol;               /**< \brief Locking protocol */
 } pthread_mutexattr_t;
 
 /** \brief  POSIX condition variable attributes.
@@ -63,6 +64,16 @@ typedef struct {
     // Empty
 } pthread_attr_t;
 
+/** \brief  POSIX barrier attributes.
+
+    Not implemented in KOS.
+
+    \headerfile sys/sched.h
+*/
+typedef struct {
+    // Empty
+} pthread_barrierattr_t;
+
 // Map over KOS types. The mutex/condvar maps have to be pointers
 // because we allow _INIT #defines to work.
 typedef kthread_t * pthread_t;      /**< \brief POSIX thread type */
@@ -72,6 +83,7 @@ typedef condvar_t pthread_cond_t;   /**< \brief POSIX condition type */
 // These, on the other hand, map right over.
 typedef kthread_once_t pthread_once_t;  /**< \brief POSIX once control */
 typedef kthread_key_t pthread_key_t;    /**< \brief POSIX thread data key */
+typedef barrier_t pthread_barrier_t;    /**< \brief POSIX barrier */
 
 __END_DECLS
 
@@ -32,9 +32,13 @@ ISO9660 systems, as these were used as references as well.
 #include <dc/cdrom.h>
 #include <dc/vblank.h>
 
+#include <arch/cache.h>
+
 #include <kos/thread.h>
 #include <kos/mutex.h>
 #include <kos/fs.h>
+#include <kos/bcache.h>
+#include <kos/shrinker.h>
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -186,126 +190,158 @@ static uint32 iso_733(const uint8 *from) {
 
 
 /********************************************************************************/
-/* Low-level block cacheing routines. This implements a simple queue-based
-   LRU/MRU cacheing system. Whenever a block is requested, it will be placed
-   on the MRU end of the queue. As more blocks are loaded than can fit in
-   the cache, blocks are deleted from the LRU end. */
-
-/* Holds the data for one cache block, and a pointer to the next one.
-   As sectors are read from the disc, they are added to the front of
-   this cache. As the cache fills up, sectors are removed from the end
-   of it. */
-typedef struct {
-    uint32  sector;         /* CD sector */
-    uint8   data[2048];     /* Sector data */
-} cache_block_t;
+/* Low-level block cacheing routines. Sectors are kept in two block caches
+   (see kos/bcache.h), one for directory sectors and one for file data, so that
+   reading through a big file doesn't push the directories out. */
 
-/* List of cache blocks (ordered least recently used to most recently) */
-#define NUM_CACHE_BLOCKS 16
-static cache_block_t *icache[NUM_CACHE_BLOCKS];     /* inode cache */
-static cache_block_t *dcache[NUM_CACHE_BLOCKS];     /* data cache */
+/* Directory ("inode") and file data caches, and the size of each. */
+static bcache_t *icache, *dcache;
+static size_t icache_size = ISO_CACHE_BLOCKS, dcache_size = ISO_CACHE_BLOCKS;
 
 /* Cache modification mutex */
 static mutex_t cache_mutex;
 
-/* Clears all cache blocks */
-static void bclear_cache(cache_block_t **cache) {
-    int i;
+static void iso_break_all();
+
+/* Read sectors from the disc, in PIO or DMA mode. DMA needs the buffer to be
+   32-byte aligned. */
+static int iso_read_sectors(void *buf, uint32 sector, int count, int mode) {
+    int rv;
+
+    if(mode == CDROM_READ_DMA)
+        dcache_inval_range((uint32)buf, count * 2048);
+
+    if((rv = cdrom_read_sectors_ex(buf, sector + 150, count, mode)) != ERR_OK) {
+        /* Don't reinitialize here, since the cache lock may be held. Break
+           the open files, and the next open will take care of the rest. */
+        if(rv == ERR_DISC_CHG || rv == ERR_NO_DISC) {
+            percd_done = 0;
+            iso_break_all();
+        }
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static int iso_bread(void *data, uint64_t sector, size_t count, void *buf) {
+    (void)data;
+
+    return iso_read_sectors(buf, (uint32)sector, (int)count, CDROM_READ_PIO);
+}
+
+static const bcache_ops_t iso_bcache_ops = {
+    iso_bread,
+    NULL
+};
+
+/* Pulls the requested sector into the cache and returns a pointer to its data.
+   The caller must hold cache_mutex. The data is good until the sector is
+   evicted, which can't happen before the mutex is released. */
+static uint8 *bread_cache(bcache_t *cache, uint32 sector) {
+    bcache_buf_t *b;
+
+    if(!(b = bcache_read(cache, sector)))
+        return NULL;
+
+    bcache_release(cache, b);
+    return b->data;
+}
+
+/* read inode block. The directory code holds on to pointers into these
+   sectors after the lock is released, which is also why the inode cache is
+   never shrunk. */
+static uint8 *biread(uint32 sector) {
+    uint8 *rv;
 
     mutex_lock(&cache_mutex);
+    rv = bread_cache(icache, sector);
+    mutex_unlock(&cache_mutex);
 
-    for(i = 0; i < NUM_CACHE_BLOCKS; i++)
-        cache[i]->sector = (uint32)-1;
+    return rv;
+}
 
+/* Clear both caches */
+static void bclear() {
+    mutex_lock(&cache_mutex);
+    bcache_invalidate(dcache);
+    bcache_invalidate(icache);
     mutex_unlock(&cache_mutex);
 }
 
-/* Graduate a block from its current position to the MRU end of the cache */
-static void bgrad_cache(cache_block_t **cache, int block) {
-    int     i;
-    cache_block_t   *tmp;
+/* Give back file data sectors when memory runs low. */
+static size_t iso_shrink(size_t want, void *data) {
+    size_t rv;
 
-    /* Don't try it with the end block */
-    if(block < 0 || block >= (NUM_CACHE_BLOCKS - 1)) return;
+    (void)data;
 
-    /* Make a copy and scoot everything down */
-    tmp = cache[block];
+    if(mutex_trylock(&cache_mutex))
+        return 0;
 
-    for(i = block; i < (NUM_CACHE_BLOCKS - 1); i++)
-        cache[i] = cache[i + 1];
+    rv = bcache_shrink(dcache, want);
+    mutex_unlock(&cache_mutex);
 
-    cache[NUM_CACHE_BLOCKS - 1] = tmp;
+    return rv;
 }
 
-/* Pulls the requested sector into a cache block and returns the cache
-   block index. Note that the sector in question may already be in the
-   cache, in which case it just returns the containing block. */
-static void iso_break_all();
-static int bread_cache(cache_block_t **cache, uint32 sector) {
-    int i, j, rv;
+static shrinker_t iso_shrinker = {
+    .name = "iso9660",
+    .priority = SHRINKER_PRIO_CACHE,
+    .shrink = iso_shrink
+};
 
-    rv = -1;
-    mutex_lock(&cache_mutex);
+int fs_iso9660_set_cache_size(size_t inode_blocks, size_t data_blocks) {
+    bcache_t *ic, *dc;
 
-    /* Look for a pre-existing cache block */
-    for(i = NUM_CACHE_BLOCKS - 1; i >= 0; i--) {
-        if(cache[i]->sector == sector) {
-            bgrad_cache(cache, i);
-            rv = NUM_CACHE_BLOCKS - 1;
-            goto bread_exit;
-        }
+    if(!inode_blocks || !data_blocks) {
+        errno = EINVAL;
+        return -1;
     }
 
-    /* If not, look for an open cache slot; if we find one, use it */
-    for(i = 0; i < NUM_CACHE_BLOCKS; i++) {
-        if(cache[i]->sector == (uint32)-1) break;
-    }
+    if(!(ic = bcache_create(NULL, 2048, inode_blocks, &iso_bcache_ops, NULL)))
+        return -1;
 
-    /* If we didn't find one, kick an LRU block out of cache */
-    if(i >= NUM_CACHE_BLOCKS) {
-        i = 0;
+    if(!(dc = bcache_create(NULL, 2048, data_blocks, &iso_bcache_ops, NULL))) {
+        bcache_destroy(ic);
+        return -1;
     }
 
-    /* Load the requested block */
-    j = cdrom_read_sectors(cache[i]->data, sector + 150, 1);
-
-    if(j < 0) {
-        //dbglog(DBG_ERROR, "fs_iso9660: can't read_sectors for %d: %d\n",
-        //  sector+150, j);
-        if(j == ERR_DISC_CHG || j == ERR_NO_DISC) {
-            init_percd();
-        }
+    mutex_lock(&cache_mutex);
 
-        rv = -1;
-        goto bread_exit;
+    if(icache) {
+        bcache_destroy(icache);
+        bcache_destroy(dcache);
     }
 
-    cache[i]->sector = sector;
-
-    /* Move it to the most-recently-used position */
-    bgrad_cache(cache, i);
-    rv = NUM_CACHE_BLOCKS - 1;
+    icache = ic;
+    dcache = dc;
+    icache_size = inode_blocks;
+    dcache_size = data_blocks;
 
-    /* Return the new cache block index */
-bread_exit:
     mutex_unlock(&cache_mutex);
-    return rv;
-}
 
-/* read data block */
-static int bdread(uint32 sector) {
-    return bread_cache(dcache, sector);
+    return 0;
 }
 
-/* read inode block */
-static int biread(uint32 sector) {
-    return bread_cache(icache, sector);
-}
+int fs_iso9660_cache_stats(bcache_stats_t *inode, bcache_stats_t *data) {
+    mutex_lock(&cache_mutex);
 
-/* Clear both caches */
-static void bclear() {
-    bclear_cache(dcache);
-    bclear_cache(icache);
+    if(!icache) {
+        mutex_unlock(&cache_mutex);
+        errno = ENXIO;
+        return -1;
+    }
+
+    if(inode)
+        bcache_get_stats(icache, inode);
+
+    if(data)
+        bcache_get_stats(dcache, data);
+
+    mutex_unlock(&cache_mutex);
+
+    return 0;
 }
 
 /********************************************************************************/
@@ -324,7 +360,8 @@ static iso_dirent_t root_dirent;
 /* Per-disc initialization; this is done every time it's discovered that
    a new CD has been inserted. */
 static int init_percd() {
-    int     i, blk;
+    int     i;
+    uint8       *blk;
     CDROM_TOC   toc;
 
     dbglog(DBG_NOTICE, "fs_iso9660: disc change detected\n");
@@ -350,10 +387,10 @@ static int init_percd() {
     for(i = 1; i <= 3; i++) {
         blk = biread(session_base + i + 16 - 150);
 
-        if(blk < 0) return blk;
+        if(!blk) return -1;
 
-        if(memcmp((char *)icache[blk]->data, "\02CD001", 6) == 0) {
-            joliet = isjoliet((char *)icache[blk]->data + 88);
+        if(memcmp((char *)blk, "\02CD001", 6) == 0) {
+            joliet = isjoliet((char *)blk + 88);
             dbglog(DBG_NOTICE, "  (joliet level %d extensions detected)\n", joliet);
 
             if(joliet) break;
@@ -365,16 +402,16 @@ static int init_percd() {
         /* Grab and check the volume descriptor */
         blk = biread(session_base + 16 - 150);
 
-        if(blk < 0) return i;
+        if(!blk) return -1;
 
-        if(memcmp((char*)icache[blk]->data, "\01CD001", 6)) {
+        if(memcmp((char*)blk, "\01CD001", 6)) {
             dbglog(DBG_ERROR, "fs_iso9660: disc is not iso9660\r\n");
             return -1;
         }
     }
 
     /* Locate the root directory */
-    memcpy(&root_dirent, icache[blk]->data + 156, sizeof(iso_dirent_t));
+    memcpy(&root_dirent, blk + 156, sizeof(iso_dirent_t));
     root_extent = iso_733(root_dirent.extent);
     root_size = iso_733(root_dirent.size);
 
@@ -423,7 +460,8 @@ static int fncompare(const char *isofn, int isosize, const char *normalfn) {
  */
 static iso_dirent_t *find_object(const char *fn, int dir,
                                  uint32 dir_extent, uint32 dir_size) {
-    int     i, c;
+    int     i;
+    uint8       *c;
     iso_dirent_t    *de;
 
     /* RockRidge */
@@ -446,11 +484,11 @@ static iso_dirent_t *find_object(const char *fn, int dir,
     while(size_left > 0) {
         c = biread(dir_extent);
 
-        if(c < 0) return NULL;
+        if(!c) return NULL;
 
         for(i = 0; i < 2048 && i < size_left;) {
             /* Locate the current dirent */
-            de = (iso_dirent_t *)(icache[c]->data + i);
+            de = (iso_dirent_t *)(c + i);
 
             if(!de->length) break;
 
@@ -654,8 +692,8 @@ static int iso_close(void * h) {
 
 /* Read from a file */
 static ssize_t iso_read(void * h, void *buf, size_t bytes) {
-    int rv, toread, thissect, c;
-    uint8 * outbuf;
+    int rv, toread, thissect;
+    uint8 * outbuf, * data;
     file_t fd = (file_t)h;
 
     /* Check that the fd is valid */
@@ -676,40 +714,37 @@ static ssize_t iso_read(void * h, void *buf, size_t bytes) {
         /* How much more can we read in the current sector? */
         thissect = 2048 - (fh[fd].ptr % 2048);
 
-        /* If we're on a sector boundary and we have more than one
-           full sector to read, then short-circuit the cache here
-           and use the multi-sector reads from the CD unit (this
-           should theoretically be a lot faster) */
-        /* XXX This code isn't actually faster, but I'm leaving it
-           here commented out in case we could find a better use
-           for it later than speed (i.e., preventing thread context
-           switches). */
-        /* if (thissect == 2048 && toread >= 2048) {
-            // Round it off to an even sector count
+        /* If we're on a sector boundary and there are at least two whole
+           sectors left to read, read them all at once straight into the
+           caller's buffer. Files are always a single extent on the disc, so
+           this is one command to the drive however big the read is. Nothing
+           in the cache is ever dirty, so there's nothing to reconcile. */
+        if(thissect == 2048 && toread >= 2 * 2048) {
             thissect = toread / 2048;
             toread = thissect * 2048;
 
-            printf("cdrom: short-circuit read for %d sectors\n",
-                thissect);
-
-            // Do the read
-            if (cdrom_read_sectors(outbuf,
-                fh[fd].first_extent + fh[fd].ptr/2048 + 150,
-                thissect) < 0)
-            {
-                // Something went wrong...
+            if(iso_read_sectors(outbuf,
+                                fh[fd].first_extent + fh[fd].ptr / 2048,
+                                thissect, ((uint32)outbuf & 31) ?
+                                CDROM_READ_PIO : CDROM_READ_DMA) < 0)
                 return -1;
-            }
-        } else { */
-        toread = (toread > thissect) ? thissect : toread;
+        }
+        else {
+            /* Partial sectors go through the cache. */
+            toread = (toread > thissect) ? thissect : toread;
 
-        /* Do the read */
-        c = bdread(fh[fd].first_extent + fh[fd].ptr / 2048);
+            mutex_lock(&cache_mutex);
+            data = bread_cache(dcache,
+                               fh[fd].first_extent + fh[fd].ptr / 2048);
 
-        if(c < 0) return -1;
+            if(!data) {
+                mutex_unlock(&cache_mutex);
+                return -1;
+            }
 
-        memcpy(outbuf, dcache[c]->data + (fh[fd].ptr % 2048), toread);
-        /* } */
+            memcpy(outbuf, data + (fh[fd].ptr % 2048), toread);
+            mutex_unlock(&cache_mutex);
+        }
 
         /* Adjust pointers */
         outbuf += toread;
@@ -811,7 +846,7 @@ static void fn_postprocess(char *fnin) {
 
 /* Read a directory entry */
 static dirent_t *iso_readdir(void * h) {
-    int     c;
+    uint8       *c;
     iso_dirent_t    *de;
 
     /* RockRidge */
@@ -828,16 +863,16 @@ static dirent_t *iso_readdir(void * h) {
 
     /* Scan forwards until we find the next valid entry, an
        end-of-entry mark, or run out of dir size. */
-    c = -1;
+    c = NULL;
     de = NULL;
 
     while(fh[fd].ptr < fh[fd].size) {
         /* Get the current dirent block */
         c = biread(fh[fd].first_extent + fh[fd].ptr / 2048);
 
-        if(c < 0) return NULL;
+        if(!c) return NULL;
 
-        de = (iso_dirent_t *)(icache[c]->data + (fh[fd].ptr % 2048));
+        de = (iso_dirent_t *)(c + (fh[fd].ptr % 2048));
 
         if(de->length) break;
 
@@ -850,9 +885,9 @@ static dirent_t *iso_readdir(void * h) {
     /* If we're at the first, skip the two blank entries */
     if(!de->name[0] && de->name_len == 1) {
         fh[fd].ptr += de->length;
-        de = (iso_dirent_t *)(icache[c]->data + (fh[fd].ptr % 2048));
+        de = (iso_dirent_t *)(c + (fh[fd].ptr % 2048));
         fh[fd].ptr += de->length;
-        de = (iso_dirent_t *)(icache[c]->data + (fh[fd].ptr % 2048));
+        de = (iso_dirent_t *)(c + (fh[fd].ptr % 2048));
 
         if(!de->length) return NULL;
     }
@@ -1052,8 +1087,6 @@ static vfs_handler_t vh = {
 
 /* Initialize the file system */
 int fs_iso9660_init() {
-    int i;
-
     /* Reset fd's */
     memset(fh, 0, sizeof(fh));
 
@@ -1064,13 +1097,11 @@ int fs_iso9660_init() {
     mutex_init(&cache_mutex, MUTEX_TYPE_NORMAL);
     mutex_init(&fh_mutex, MUTEX_TYPE_NORMAL);
 
-    /* Allocate cache block space */
-    for(i = 0; i < NUM_CACHE_BLOCKS; i++) {
-        icache[i] = malloc(sizeof(cache_block_t));
-        icache[i]->sector = -1;
-        dcache[i] = malloc(sizeof(cache_block_t));
-        dcache[i]->sector = -1;
-    }
+    /* Allocate the caches */
+    if(fs_iso9660_set_cache_size(icache_size, dcache_size))
+        return -1;
+
+    shrinker_register(&iso_shrinker);
 
     percd_done = 0;
     iso_last_status = -1;
@@ -1084,16 +1115,15 @@ int fs_iso9660_init() {
 
 /* De-init the file system */
 int fs_iso9660_shutdown() {
-    int i;
-
     /* De-register with vblank */
     vblank_handler_remove(iso_vblank_hnd);
 
-    /* Dealloc cache block space */
-    for(i = 0; i < NUM_CACHE_BLOCKS; i++) {
-        free(icache[i]);
-        free(dcache[i]);
-    }
+    shrinker_unregister(&iso_shrinker);
+
+    /* Free the caches */
+    bcache_destroy(icache);
+    bcache_destroy(dcache);
+    icache = dcache = NULL;
 
     /* Free muteces */
     mutex_destroy(&cache_mutex);
@@ -1082,14 +1082,35 @@ static int atab_read_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
 static int atab_read_blocks_dma(kos_blockdev_t *d, uint64_t block, size_t count,
                                 void *buf) {
     ata_devdata_t *data = (ata_devdata_t *)d->dev_data;
+    size_t n, max = CAN_USE_LBA48() ? 65536 : 256;
+    uint8_t *bbuf = (uint8_t *)buf;
 
     if(block + count > data->end_block) {
         errno = EOVERFLOW;
         return -1;
     }
 
-    return g1_ata_read_lba_dma(block + data->start_block, count,
-                               (uint16_t *)buf, 1);
+    block += data->start_block;
+
+    /* Filesystems read large requests straight into the caller's buffer, which
+       may not be aligned well enough for DMA. Use PIO for those instead of
+       failing. */
+    if(((uint32_t)buf) & 0x1F)
+        return g1_ata_read_lba(block, count, (uint16_t *)buf);
+
+    /* Split up anything too big for a single DMA transfer. */
+    while(count) {
+        n = count > max ? max : count;
+
+        if(g1_ata_read_lba_dma(block, n, (uint16_t *)bbuf, 1))
+            return -1;
+
+        block += n;
+        count -= n;
+        bbuf += n << 9;
+    }
+
+    return 0;
 }
 
 static int atab_write_blocks(kos_blockdev_t *d, uint64_t block, size_t count,
@@ -10,6 +10,7 @@
 #include <arch/arch.h>
 #include <arch/spinlock.h>
 #include <arch/irq.h>
+#include <kos/ringbuf.h>
 #include <dc/fs_dcload.h>
 
 /*
@@ -52,37 +53,37 @@ void scif_set_parameters(int baud, int fifo) {
     serial_fifo = fifo;
 }
 
-/* Receive ring buffer */
+/* Receive ring buffer. The interrupt handler is the only producer and
+   scif_read() is the only consumer, so neither side needs to lock it. */
 #define BUFSIZE 1024
 static uint8 recvbuf[BUFSIZE];
-static int rb_head = 0, rb_tail = 0, rb_cnt = 0;
-static int rb_paused = 0;
+static ringbuf_t rb = RINGBUF_INITIALIZER(recvbuf, 1, BUFSIZE);
+static volatile int rb_paused = 0;
 
 static void rb_reset() {
-    rb_head = rb_tail = rb_cnt = rb_paused = 0;
+    ringbuf_reset(&rb);
+    rb_paused = 0;
 }
 
-static void rb_push_char(int c) {
-    recvbuf[rb_head] = c;
-    rb_head = (rb_head + 1) % BUFSIZE;
-    rb_cnt++;
+static void rb_push_chars(const uint8 *c, int cnt) {
+    ringbuf_put(&rb, c, cnt);
 
     /* If we're within 32 bytes of being out of space, pause for
        the moment. */
-    if(!rb_paused && (BUFSIZE - rb_cnt) < 32) {
+    if(!rb_paused && ringbuf_space(&rb) < 32) {
         rb_paused = 1;
         SCSPTR2 = 0x20;     /* Set CTS=0 */
     }
 }
 
 static int rb_pop_char() {
-    int c;
-    c = recvbuf[rb_tail];
-    rb_tail = (rb_tail + 1) % BUFSIZE;
-    rb_cnt--;
+    uint8 c;
+
+    if(!ringbuf_get(&rb, &c, 1))
+        return -1;
 
     /* If we're paused and clear again, re-enabled receiving. */
-    if(rb_paused && (BUFSIZE - rb_cnt) >= 64) {
+    if(rb_paused && ringbuf_space(&rb) >= 64) {
         rb_paused = 0;
         SCSPTR2 = 0x00;
     }
@@ -90,14 +91,6 @@ static int rb_pop_char() {
     return c;
 }
 
-/* static int rb_space_free() {
-    return BUFSIZE - rb_cnt;
-} */
-
-static int rb_space_used() {
-    return rb_cnt;
-}
-
 
 /* Serial receive and receive error interrupts. When this is triggered we
    must look for available data and error conditions, and clear them all
@@ -141,10 +134,16 @@ static void scif_data_irq(irq_t src, irq_context_t * cxt) {
 
     /* Check for received data available. */
     if(SCFSR2 & 3) {
-        while(SCFDR2 & 0x1f) {
-            int c = SCFRDR2;
-            rb_push_char(c);
-        }
+        uint8 c[16];
+        int cnt;
+
+        /* Drain the FIFO and push it into the buffer in one go. */
+        do {
+            for(cnt = 0; cnt < 16 && (SCFDR2 & 0x1f); ++cnt)
+                c[cnt] = SCFRDR2;
+
+            rb_push_chars(c, cnt);
+        } while(cnt == 16);
 
         SCFSR2 &= ~3;
     }
@@ -277,13 +276,13 @@ int scif_read() {
     }
 
     if(scif_irq_usage) {
+        int c;
+
         /* Do we have anything ready? */
-        if(rb_space_used() <= 0) {
+        if((c = rb_pop_char()) < 0)
             errno = EAGAIN;
-            return -1;
-        }
-        else
-            return rb_pop_char();
+
+        return c;
     }
     else {
         int c;
@@ -9,6 +9,7 @@
 #include <sys/queue.h>
 
 #include <arch/irq.h>
+#include <kos/thread.h>
 #include <dc/vblank.h>
 
 /*
@@ -33,6 +34,9 @@ static void vblank_handler(uint32 src) {
     TAILQ_FOREACH(t, &vblhnds, listent) {
         t->handler(src);
     }
+
+    /* Release any periodic threads that are waiting on us. */
+    thd_periodic_vblank();
 }
 
 int vblank_handler_add(asic_evt_handler hnd) {
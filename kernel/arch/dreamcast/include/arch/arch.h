@@ -134,11 +134,17 @@ int mm_init();
 
 /** \brief  Request more core memory from the system.
     \param  increment       The number of bytes requested.
-    \return                 A pointer to the memory.
-    \note                   This function will panic if no memory is available.
+    \return                 A pointer to the memory, or (void *)-1 if not
+                            enough memory is available (errno will be set to
+                            ENOMEM).
 */
 void * mm_sbrk(unsigned long increment);
 
+/** \brief  Find out how much more core memory is available.
+    \return                 The number of bytes mm_sbrk() can still hand out.
+*/
+unsigned long mm_sbrk_avail();
+
 /** \brief  Use this macro to determine the level of initialization you'd like
             in your program by default.
 
@@ -177,6 +183,7 @@ extern void * __kos_romdisk;
 #define INIT_NET            0x0004  /**< \brief Enable built-in networking */
 #define INIT_MALLOCSTATS    0x0008  /**< \brief Enable malloc statistics */
 #define INIT_QUIET          0x0010  /**< \brief Disable dbgio */
+#define INIT_THD_TICKLESS   0x0020  /**< \brief Tickless thread preemption */
 
 /* DC-specific stuff */
 #define INIT_OCRAM          0x10000 /**< \brief Use half of the dcache as RAM */
@@ -246,6 +246,12 @@ typedef void (*irq_handler)(irq_t source, irq_context_t *context);
 */
 int irq_inside_int();
 
+/** \brief  Are interrupts disabled?
+    \retval 1               If interrupts are currently disabled.
+    \retval 0               If interrupts are enabled.
+*/
+int irq_disabled();
+
 /** \brief  Pretend like we just came in from an interrupt and force
             a context switch back to the "current" context.
 
@@ -31,10 +31,18 @@ __BEGIN_DECLS
 #include <arch/types.h>
 #include <kos/limits.h>
 #include <kos/fs.h>
+#include <kos/bcache.h>
 
 /** \brief  The maximum number of files that can be open at once. */
 #define MAX_ISO_FILES 8
 
+/** \brief  The default number of sectors in each of the driver's caches.
+
+    The driver keeps one cache of directory sectors and one of file data
+    sectors, so that reading a file doesn't push the directories out.
+*/
+#define ISO_CACHE_BLOCKS 16
+
 /** \brief  Reset the internal ISO9660 cache.
 
     This function resets the cache of the ISO9660 driver, breaking connections
@@ -45,6 +53,38 @@ __BEGIN_DECLS
 */
 int iso_reset();
 
+/** \brief  Change the size of the sector caches.
+
+    This throws away everything that is cached, so it is best done before any
+    files are opened, and must not be done while another thread is using the
+    filesystem. Both caches start out with ISO_CACHE_BLOCKS sectors. Memory is
+    only used as the caches fill up, and the data cache gives sectors back
+    when memory runs low (see kos/shrinker.h), so a big data cache is cheap.
+
+    \param  inode_blocks    The number of directory sectors to cache.
+    \param  data_blocks     The number of file data sectors to cache.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     EINVAL - a size of 0 was given \n
+    \em     ENOMEM - out of memory
+*/
+int fs_iso9660_set_cache_size(size_t inode_blocks, size_t data_blocks);
+
+/** \brief  Retrieve statistics for the sector caches.
+    \param  inode           Storage for the directory cache statistics, or
+                            NULL.
+    \param  data            Storage for the file data cache statistics, or
+                            NULL.
+    \retval 0               On success.
+    \retval -1              On error, errno will be set as appropriate.
+
+    \par    Error Conditions:
+    \em     ENXIO - the filesystem has not been initialized
+*/
+int fs_iso9660_cache_stats(bcache_stats_t *inode, bcache_stats_t *data);
+
 /* \cond */
 int fs_iso9660_init();
 int fs_iso9660_shutdown();
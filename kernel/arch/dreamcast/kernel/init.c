@@ -86,7 +86,9 @@ int  __attribute__((weak)) arch_auto_init() {
     rtc_init();
 
     /* Threads */
-    if(__kos_init_flags & INIT_THD_PREEMPT)
+    if(__kos_init_flags & INIT_THD_TICKLESS)
+        thd_init(THD_MODE_TICKLESS);
+    else if(__kos_init_flags & INIT_THD_PREEMPT)
         thd_init(THD_MODE_PREEMPT);
     else
         thd_init(THD_MODE_COOP);
@@ -15,6 +15,7 @@
 #include <arch/stack.h>
 #include <kos/dbgio.h>
 #include <kos/thread.h>
+#include <kos/tasklet.h>
 #include <kos/library.h>
 
 /* Exception table -- this table matches (EXPEVT>>4) to a function pointer.
@@ -36,6 +37,14 @@ int irq_inside_int() {
     return inside_int;
 }
 
+/* Are interrupts masked off? */
+int irq_disabled() {
+    int old = irq_disable();
+
+    irq_restore(old);
+    return (old & 0xf0) != 0;
+}
+
 /* Set a handler, or remove a handler */
 int irq_set_handler(irq_t code, irq_handler hnd) {
     /* Make sure they don't do something crackheaded */
@@ -176,6 +185,11 @@ void irq_handle_exception(int code) {
         arch_panic("unhandled IRQ/Exception");
     }
 
+    /* If an interrupt queued up any deferred work, get it running right away.
+       Traps and other exceptions (code 1 or 2) are left alone. */
+    if(code == 3)
+        tasklet_irq_exit();
+
     /* dbgio_printf("returning from int\n"); */
 
     irq_disable();
@@ -18,6 +18,7 @@
 #include <arch/arch.h>
 #include <arch/irq.h>
 #include <stdio.h>
+#include <errno.h>
 
 /* The end of the program is always marked by the '_end' symbol. So we'll
    longword-align that and add a little for safety. sbrk() calls will
@@ -25,6 +26,9 @@
 extern unsigned long end;
 static void *sbrk_base;
 
+/* sbrk() won't go past this, so the heap doesn't run into the kernel stack. */
+#define SBRK_LIMIT  (0x8d000000 - 65536)
+
 /* MM-wide initialization */
 int mm_init() {
     int base = (int)(&end);
@@ -37,22 +41,30 @@ int mm_init() {
 /* Simple sbrk function */
 void* mm_sbrk(unsigned long increment) {
     int old;
-    void *base = sbrk_base;
+    void *base;
 
     old = irq_disable();
+    base = sbrk_base;
 
     if(increment & 3)
         increment = (increment + 4) & ~3;
 
-    sbrk_base = (void *)(increment + (unsigned long)sbrk_base);
-
-    if(((uint32)sbrk_base) >= (0x8d000000 - 65536)) {
-        dbglog(DBG_DEAD, "Requested sbrk_base %p, was %p, diff %lu\n",
-               sbrk_base, base, increment);
-        arch_panic("out of memory; about to run over kernel stack");
+    /* Let malloc() handle running out of memory, rather than panicking. */
+    if((long)increment > 0 &&
+       increment >= SBRK_LIMIT - (unsigned long)sbrk_base) {
+        irq_restore(old);
+        errno = ENOMEM;
+        return (void *)-1;
     }
 
+    sbrk_base = (void *)(increment + (unsigned long)sbrk_base);
+
     irq_restore(old);
 
     return base;
 }
+
+/* How much further sbrk() can go */
+unsigned long mm_sbrk_avail() {
+    return SBRK_LIMIT - (unsigned long)sbrk_base;
+}
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/queue.h>
+#include <kos/slab.h>
 #include <dc/sound/sound.h>
 
 /*
@@ -60,6 +61,9 @@ typedef struct snd_block_str {
 static int initted = 0;
 static TAILQ_HEAD(snd_block_q, snd_block_str) pool = {0};
 
+/* Where block descriptors come from */
+static slab_cache_t *snd_block_slab = NULL;
+
 /* Reinitialize the pool with the given RAM base offset */
 int snd_mem_init(uint32 reserve) {
     snd_block_t *blk;
@@ -70,10 +74,17 @@ int snd_mem_init(uint32 reserve) {
     // Make sure our base is 32-byte aligned
     reserve = (reserve + 0x1f) & ~0x1f;
 
+    if(!snd_block_slab &&
+       !(snd_block_slab = slab_cache_create("snd_block", sizeof(snd_block_t),
+                                            0, NULL)))
+        return -1;
+
     /* Make sure our tailq is initted */
     TAILQ_INIT(&pool);
 
-    blk = (snd_block_t *)malloc(sizeof(snd_block_t));
+    if(!(blk = (snd_block_t *)slab_alloc(snd_block_slab)))
+        return -1;
+
     memset(blk, 0, sizeof(snd_block_t));
     blk->addr = reserve;
     blk->size = 2 * 1024 * 1024 - reserve;
@@ -107,7 +118,7 @@ void snd_mem_shutdown() {
             dbglog(DBG_DEBUG, "snd_mem_shutdown: unused block at %08lx (size %d)\n", e->addr, e->size);
 
 #endif
-        free(e);
+        slab_free(snd_block_slab, e);
         e = n;
     }
 
@@ -150,7 +161,9 @@ uint32 snd_mem_malloc(size_t size) {
     }
 
     /* Nope: break it up into two chunks */
-    e = (snd_block_t*)malloc(sizeof(snd_block_t));
+    if(!(e = (snd_block_t *)slab_alloc(snd_block_slab)))
+        return 0;
+
     memset(e, 0, sizeof(snd_block_t));
     e->addr = best->addr + size;
     e->size = best->size - size;
@@ -205,7 +218,7 @@ void snd_mem_free(uint32 addr) {
 
         o->size += e->size;
         TAILQ_REMOVE(&pool, e, qent);
-        free(e);
+        slab_free(snd_block_slab, e);
         e = o;
     }
 
@@ -219,7 +232,7 @@ void snd_mem_free(uint32 addr) {
 
         e->size += o->size;
         TAILQ_REMOVE(&pool, o, qent);
-        free(o);
+        slab_free(snd_block_slab, o);
     }
 }
 
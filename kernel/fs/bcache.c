@@ -0,0 +1,522 @@
+/* KallistiOS ##version##
+
+   bcache.c
+   Copyright (C) 2026 The KallistiOS Team
+*/
+
+/* Block buffer cache. Every buffer with a valid block in it is in the hash
+   table. Buffers that nobody holds a reference to are also on the LRU list,
+   oldest first, which is where buffers get reused from; invalid buffers go at
+   its head so they get reused before anything else. Each buffer is allocated
+   in one piece, with its data right after the header. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <errno.h>
+
+#include <kos/bcache.h>
+
+#define BUF_VALID       1
+#define BUF_DIRTY       2
+#define BUF_RA          4           /* Read ahead, not looked up yet */
+
+/* Buffer data is aligned for DMA. */
+#define BUF_ALIGN       32
+#define BUF_HDR         ((sizeof(bcache_buf_t) + BUF_ALIGN - 1) & \
+                         ~(BUF_ALIGN - 1))
+
+LIST_HEAD(bcache_bucket, bcache_buf);
+
+struct bcache {
+    kos_blockdev_t *dev;
+    const bcache_ops_t *ops;
+    void *ops_data;
+    uint32_t dev_blocks;            /* Device blocks per cache block */
+
+    struct bcache_bucket *hash;
+    uint32_t hash_mask;
+
+    TAILQ_HEAD(bcache_lru, bcache_buf) lru;
+    uint32_t nlru;
+
+    bcache_stats_t stats;
+};
+
+static inline uint32_t bc_hash(bcache_t *c, uint64_t block) {
+    return (uint32_t)((block ^ (block >> 32)) * 2654435761UL) & c->hash_mask;
+}
+
+bcache_t *bcache_create(kos_blockdev_t *dev, size_t block_size,
+                        size_t max_bufs, const bcache_ops_t *ops, void *data) {
+    bcache_t *c;
+    uint32_t i, nhash;
+
+    if(!block_size || !max_bufs || (!ops && !dev)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* Without our own I/O functions, the cache block has to be made up of
+       whole device blocks. */
+    if(!ops && ((block_size & (block_size - 1)) ||
+                block_size < (1U << dev->l_block_size))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* Aim for two buffers per bucket once the cache is full. */
+    for(nhash = 16; nhash < max_bufs / 2; nhash <<= 1)
+        ;
+
+    if(!(c = (bcache_t *)malloc(sizeof(bcache_t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if(!(c->hash = (struct bcache_bucket *)malloc(sizeof(struct bcache_bucket) *
+                                                  nhash))) {
+        free(c);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for(i = 0; i < nhash; ++i)
+        LIST_INIT(&c->hash[i]);
+
+    c->hash_mask = nhash - 1;
+    c->dev = dev;
+    c->ops = ops;
+    c->ops_data = data;
+    c->dev_blocks = ops ? 0 : block_size >> dev->l_block_size;
+
+    TAILQ_INIT(&c->lru);
+    c->nlru = 0;
+
+    memset(&c->stats, 0, sizeof(bcache_stats_t));
+    c->stats.block_size = block_size;
+    c->stats.max_bufs = max_bufs;
+    c->stats.ra_max = BCACHE_RA_DEFAULT;
+
+    return c;
+}
+
+int bcache_destroy(bcache_t *c) {
+    bcache_buf_t *b;
+
+    /* Every buffer should be on the LRU list once they've all been released. */
+    if(c->nlru != c->stats.bufs) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    while((b = TAILQ_FIRST(&c->lru))) {
+        TAILQ_REMOVE(&c->lru, b, lru);
+        free(b);
+    }
+
+    free(c->hash);
+    free(c);
+
+    return 0;
+}
+
+static int bc_read(bcache_t *c, uint64_t block, size_t count, void *buf) {
+    if(c->ops)
+        return c->ops->read(c->ops_data, block, count, buf);
+
+    return c->dev->read_blocks(c->dev, block * c->dev_blocks,
+                               count * c->dev_blocks, buf);
+}
+
+static int bc_write(bcache_t *c, bcache_buf_t *b) {
+    int rv;
+
+    if(c->ops)
+        rv = c->ops->write(c->ops_data, b->block, b->data);
+    else
+        rv = c->dev->write_blocks(c->dev, b->block * c->dev_blocks,
+                                  c->dev_blocks, b->data);
+
+    if(!rv) {
+        b->flags &= ~BUF_DIRTY;
+        --c->stats.dirty;
+        ++c->stats.writebacks;
+    }
+
+    return rv;
+}
+
+static bcache_buf_t *bc_find(bcache_t *c, uint64_t block) {
+    bcache_buf_t *b;
+
+    LIST_FOREACH(b, &c->hash[bc_hash(c, block)], hash) {
+        if(b->block == block)
+            return b;
+    }
+
+    return NULL;
+}
+
+/* Take a buffer off the LRU list and give the caller a reference to it. */
+static void bc_ref(bcache_t *c, bcache_buf_t *b) {
+    if(!b->refcnt++) {
+        TAILQ_REMOVE(&c->lru, b, lru);
+        --c->nlru;
+    }
+}
+
+/* Come up with a buffer for a new block, either by allocating one or by
+   reusing the least recently used one. The buffer is returned referenced, and
+   not in the hash table. */
+static bcache_buf_t *bc_alloc(bcache_t *c) {
+    bcache_buf_t *b = NULL;
+
+    if(c->stats.bufs < c->stats.max_bufs &&
+       (b = (bcache_buf_t *)memalign(BUF_ALIGN, BUF_HDR +
+                                     c->stats.block_size))) {
+        b->data = (uint8_t *)b + BUF_HDR;
+        b->flags = 0;
+        b->refcnt = 1;
+        ++c->stats.bufs;
+        return b;
+    }
+
+    if(!(b = TAILQ_FIRST(&c->lru))) {
+        errno = EBUSY;
+        return NULL;
+    }
+
+    if((b->flags & BUF_DIRTY) && bc_write(c, b)) {
+        errno = EIO;
+        return NULL;
+    }
+
+    bc_ref(c, b);
+
+    if(b->flags & BUF_VALID)
+        LIST_REMOVE(b, hash);
+
+    b->flags = 0;
+    return b;
+}
+
+static bcache_buf_t *bc_get(bcache_t *c, uint64_t block, int read) {
+    bcache_buf_t *b;
+
+    if((b = bc_find(c, block))) {
+        ++c->stats.hits;
+
+        if(b->flags & BUF_RA) {
+            b->flags &= ~BUF_RA;
+            ++c->stats.ra_hits;
+        }
+
+        bc_ref(c, b);
+        return b;
+    }
+
+    ++c->stats.misses;
+
+    if(!(b = bc_alloc(c)))
+        return NULL;
+
+    b->block = block;
+
+    if(read && bc_read(c, block, 1, b->data)) {
+        /* Put it back where it'll be reused first. */
+        b->refcnt = 0;
+        TAILQ_INSERT_HEAD(&c->lru, b, lru);
+        ++c->nlru;
+        errno = EIO;
+        return NULL;
+    }
+
+    b->flags = BUF_VALID;
+    LIST_INSERT_HEAD(&c->hash[bc_hash(c, block)], b, hash);
+
+    return b;
+}
+
+bcache_buf_t *bcache_read(bcache_t *c, uint64_t block) {
+    return bc_get(c, block, 1);
+}
+
+bcache_buf_t *bcache_get(bcache_t *c, uint64_t block) {
+    return bc_get(c, block, 0);
+}
+
+bcache_buf_t *bcache_lookup(bcache_t *c, uint64_t block) {
+    bcache_buf_t *b;
+
+    if((b = bc_find(c, block)))
+        bc_ref(c, b);
+
+    return b;
+}
+
+void bcache_release(bcache_t *c, bcache_buf_t *b) {
+    if(!--b->refcnt) {
+        TAILQ_INSERT_TAIL(&c->lru, b, lru);
+        ++c->nlru;
+    }
+}
+
+void bcache_mark_dirty(bcache_t *c, bcache_buf_t *b) {
+    if(!(b->flags & BUF_DIRTY)) {
+        b->flags |= BUF_DIRTY;
+        ++c->stats.dirty;
+    }
+}
+
+void bcache_invalidate(bcache_t *c) {
+    bcache_buf_t *b, *next;
+
+    for(b = TAILQ_FIRST(&c->lru); b; b = next) {
+        next = TAILQ_NEXT(b, lru);
+
+        if(!(b->flags & BUF_VALID))
+            continue;
+
+        if(b->flags & BUF_DIRTY)
+            --c->stats.dirty;
+
+        LIST_REMOVE(b, hash);
+        b->flags = 0;
+
+        /* Empty buffers get reused first. */
+        TAILQ_REMOVE(&c->lru, b, lru);
+        TAILQ_INSERT_HEAD(&c->lru, b, lru);
+    }
+}
+
+static int bc_compare(const void *a, const void *b) {
+    const bcache_buf_t *l = *(const bcache_buf_t **)a;
+    const bcache_buf_t *r = *(const bcache_buf_t **)b;
+
+    return l->block < r->block ? -1 : l->block > r->block;
+}
+
+int bcache_sync(bcache_t *c) {
+    bcache_buf_t *b, **list;
+    uint32_t i, n = 0;
+    int rv = 0;
+
+    if(!c->stats.dirty)
+        return 0;
+
+    /* Write everything out in block order, which is kinder to the device. If
+       there's no memory to sort with, just go in whatever order. */
+    if(!(list = (bcache_buf_t **)malloc(sizeof(bcache_buf_t *) *
+                                        c->stats.dirty))) {
+        for(i = 0; i <= c->hash_mask; ++i) {
+            LIST_FOREACH(b, &c->hash[i], hash) {
+                if((b->flags & BUF_DIRTY) && bc_write(c, b))
+                    rv = -1;
+            }
+        }
+    }
+    else {
+        for(i = 0; i <= c->hash_mask; ++i) {
+            LIST_FOREACH(b, &c->hash[i], hash) {
+                if(b->flags & BUF_DIRTY)
+                    list[n++] = b;
+            }
+        }
+
+        qsort(list, n, sizeof(bcache_buf_t *), bc_compare);
+
+        for(i = 0; i < n; ++i) {
+            if(bc_write(c, list[i]))
+                rv = -1;
+        }
+
+        free(list);
+    }
+
+    if(rv)
+        errno = EIO;
+
+    return rv;
+}
+
+size_t bcache_shrink(bcache_t *c, size_t want) {
+    bcache_buf_t *b, *next;
+    size_t rv = 0;
+
+    for(b = TAILQ_FIRST(&c->lru); b && rv < want; b = next) {
+        next = TAILQ_NEXT(b, lru);
+
+        if(b->flags & BUF_DIRTY)
+            continue;
+
+        TAILQ_REMOVE(&c->lru, b, lru);
+        --c->nlru;
+
+        if(b->flags & BUF_VALID)
+            LIST_REMOVE(b, hash);
+
+        free(b);
+        --c->stats.bufs;
+        rv += BUF_HDR + c->stats.block_size;
+    }
+
+    return rv;
+}
+
+int bcache_read_direct(bcache_t *c, uint64_t block, size_t count, void *buf) {
+    bcache_buf_t *b;
+    size_t i;
+
+    if(bc_read(c, block, count, buf)) {
+        errno = EIO;
+        return -1;
+    }
+
+    if(!c->stats.dirty)
+        return 0;
+
+    for(i = 0; i < count; ++i) {
+        if((b = bc_find(c, block + i)) && (b->flags & BUF_DIRTY))
+            memcpy((uint8_t *)buf + i * c->stats.block_size, b->data,
+                   c->stats.block_size);
+    }
+
+    return 0;
+}
+
+size_t bcache_prefetch(bcache_t *c, uint64_t block, size_t count) {
+    bcache_buf_t *b;
+    uint8_t *buf;
+    size_t i, n, max = c->stats.max_bufs / 2;
+    int err = errno;
+
+    while(count && bc_find(c, block)) {
+        ++block;
+        --count;
+    }
+
+    if(!count)
+        return 0;
+
+    for(i = 0; i < count; ++i) {
+        if(bc_find(c, block + i))
+            break;
+    }
+
+    /* Never read so much at once that the run would push itself out. */
+    count = i < max ? i : max;
+
+    if(!count)
+        return 0;
+
+    /* The blocks are read into one big buffer so it can all be done in a single
+       request, then copied into the cache. The copy costs far less than the
+       extra device commands would. */
+    if(!(buf = (uint8_t *)memalign(BUF_ALIGN, count * c->stats.block_size)))
+        return 0;
+
+    if(bc_read(c, block, count, buf)) {
+        free(buf);
+        return 0;
+    }
+
+    for(i = n = 0; i < count; ++i) {
+        /* Never put a second copy of a block in the hash table. */
+        if(bc_find(c, block + i))
+            continue;
+
+        if(!(b = bc_alloc(c))) {
+            errno = err;
+            break;
+        }
+
+        ++n;
+        b->block = block + i;
+        b->flags = BUF_VALID | BUF_RA;
+        memcpy(b->data, buf + i * c->stats.block_size, c->stats.block_size);
+        LIST_INSERT_HEAD(&c->hash[bc_hash(c, b->block)], b, hash);
+        bcache_release(c, b);
+    }
+
+    free(buf);
+    c->stats.ra_blocks += n;
+
+    return n;
+}
+
+void bcache_ra_init(bcache_ra_t *ra) {
+    ra->next = 0;
+    ra->end = 0;
+    ra->window = 0;
+}
+
+size_t bcache_readahead(bcache_t *c, bcache_ra_t *ra, uint64_t fblock,
+                        uint64_t nblocks, bcache_map_t map, void *data) {
+    uint64_t start, run, block, next;
+    size_t i, count, rv = 0, max = c->stats.ra_max;
+
+    if(max > c->stats.max_bufs / 2)
+        max = c->stats.max_bufs / 2;
+
+    /* Small reads will ask for the same block more than once. */
+    if(fblock + 1 == ra->next && max)
+        return 0;
+
+    /* Anything else out of order starts things over. */
+    if(fblock != ra->next || !max) {
+        ra->next = fblock + 1;
+        ra->end = fblock + 1;
+        ra->window = 0;
+        return 0;
+    }
+
+    ra->next = fblock + 1;
+
+    /* Don't start on the next window until the last one is half used up, but
+       do start before it runs out, so that the reader never has to wait for a
+       block at a time. */
+    if(fblock + ra->window / 2 < ra->end)
+        return 0;
+
+    ra->window = ra->window ? ra->window * 2 : 2;
+
+    if(ra->window > max)
+        ra->window = max;
+
+    start = ra->end > fblock + 1 ? ra->end : fblock + 1;
+
+    if(start >= nblocks)
+        return 0;
+
+    count = ra->window;
+
+    if(count > nblocks - start)
+        count = nblocks - start;
+
+    ra->end = start + count;
+
+    /* Read each physically contiguous piece of the window in one go. */
+    for(i = 0; i < count; i += (size_t)(next - run)) {
+        if(map(data, start + i, &run))
+            break;
+
+        for(next = run + 1; i + (next - run) < count; ++next) {
+            if(map(data, start + i + (next - run), &block) || block != next)
+                break;
+        }
+
+        rv += bcache_prefetch(c, run, (size_t)(next - run));
+    }
+
+    return rv;
+}
+
+void bcache_set_readahead(bcache_t *c, size_t blocks) {
+    c->stats.ra_max = blocks;
+}
+
+int bcache_get_stats(bcache_t *c, bcache_stats_t *stats) {
+    *stats = c->stats;
+    return 0;
+}
@@ -39,6 +39,7 @@ something like this:
 #include <kos/mutex.h>
 #include <kos/nmmgr.h>
 #include <kos/dbgio.h>
+#include <kos/slab.h>
 
 /* File handle structure; this is an entirely internal structure so it does
    not go in a header file. */
@@ -51,6 +52,9 @@ typedef struct fs_hnd {
 /* The global file descriptor table */
 fs_hnd_t * fd_table[FD_SETSIZE] = { NULL };
 
+/* Where file handle structures come from */
+static slab_cache_t *fs_hnd_cache;
+
 /* For some reason, Newlib doesn't seem to define this function in stdlib.h. */
 extern char *realpath(const char *, const char *);
 
@@ -59,7 +63,11 @@ extern char *realpath(const char *, const char *);
 static fs_hnd_t * fs_root_opendir() {
     fs_hnd_t    *hnd;
 
-    hnd = malloc(sizeof(fs_hnd_t));
+    hnd = slab_alloc(fs_hnd_cache);
+
+    if(hnd == NULL)
+        return NULL;
+
     hnd->handler = NULL;
     hnd->hnd = 0;
     hnd->refcnt = 0;
@@ -149,7 +157,7 @@ static fs_hnd_t * fs_hnd_open(const char *fn, int mode) {
     if(h == NULL) return NULL;
 
     /* Wrap it up in a structure */
-    hnd = malloc(sizeof(fs_hnd_t));
+    hnd = slab_alloc(fs_hnd_cache);
 
     if(hnd == NULL) {
         cur->close(h);
@@ -189,7 +197,7 @@ static int fs_hnd_unref(fs_hnd_t * ref) {
             retval = ref->handler->close(ref->hnd);
         }
 
-        free(ref);
+        slab_free(fs_hnd_cache, ref);
     }
     return retval;
 }
@@ -250,7 +258,7 @@ file_t fs_open_handle(vfs_handler_t * vfs, void * vhnd) {
     fs_hnd_t * hnd;
 
     /* Wrap it up in a structure */
-    hnd = malloc(sizeof(fs_hnd_t));
+    hnd = slab_alloc(fs_hnd_cache);
 
     if(hnd == NULL) {
         errno = ENOMEM;
@@ -915,8 +923,16 @@ int fs_fstat(file_t fd, struct stat *st) {
 
 /* Initialize FS structures */
 int fs_init() {
+    if(!fs_hnd_cache &&
+       !(fs_hnd_cache = slab_cache_create("fs_hnd", sizeof(fs_hnd_t), 0,
+                                          NULL)))
+        return -1;
+
     return 0;
 }
 
 void fs_shutdown() {
+    /* If any files are still open, keep the cache around for next time. */
+    if(fs_hnd_cache && !slab_cache_destroy(fs_hnd_cache))
+        fs_hnd_cache = NULL;
 }
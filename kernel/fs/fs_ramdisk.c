@@ -34,6 +34,8 @@ cache data from disk rather than as a general purpose file system.
 #include <kos/thread.h>
 #include <kos/mutex.h>
 #include <kos/fs_ramdisk.h>
+#include <kos/arena.h>
+#include <kos/shrinker.h>
 #include <malloc.h>
 #include <string.h>
 #include <strings.h>
@@ -102,6 +104,9 @@ static struct {
 /* Mutex for file system structs */
 static mutex_t rd_mutex;
 
+/* Scratch space for path lookups; protected by rd_mutex. */
+static arena_t rd_scratch;
+
 /* Search a directory for the named file; return the struct if
    we find it. Assumes we hold rd_mutex. */
 static rd_file_t * ramdisk_find(rd_dir_t * parent, const char * name, int namelen) {
@@ -166,6 +171,7 @@ static int ramdisk_get_parent(rd_dir_t * parent, const char * fn, rd_dir_t ** do
     const char  * p;
     char        * pname;
     rd_file_t   * f;
+    arena_mark_t  mark;
 
     p = strrchr(fn, '/');
 
@@ -174,12 +180,13 @@ static int ramdisk_get_parent(rd_dir_t * parent, const char * fn, rd_dir_t ** do
         *fnout = fn;
     }
     else {
-        pname = (char *)malloc((p - fn) + 1);
-        strncpy(pname, fn, p - fn);
-        pname[p - fn] = 0;
+        mark = arena_mark(&rd_scratch);
+
+        if(!(pname = arena_strndup(&rd_scratch, fn, p - fn)))
+            return -1;
 
         f = ramdisk_find_path(parent, pname, 1);
-        free(pname);
+        arena_rewind(&rd_scratch, mark);
 
         if(!f)
             return -1;
@@ -838,6 +845,50 @@ int fs_ramdisk_detach(const char * fn, void ** obj, size_t * size) {
     return 0;
 }
 
+/* Give back the slack at the end of each file that isn't open. Assumes we hold
+   rd_mutex. */
+static size_t ramdisk_trim_dir(rd_dir_t *dir) {
+    rd_file_t *f;
+    void *np;
+    size_t rv = 0;
+
+    LIST_FOREACH(f, dir, dirlist) {
+        if(f->type == STAT_TYPE_DIR) {
+            rv += ramdisk_trim_dir((rd_dir_t *)f->data);
+        }
+        else if(!f->usage && f->size && f->datasize > f->size) {
+            if((np = realloc(f->data, f->size))) {
+                rv += f->datasize - f->size;
+                f->data = np;
+                f->datasize = f->size;
+            }
+        }
+    }
+
+    return rv;
+}
+
+static size_t ramdisk_shrink(size_t want, void *data) {
+    size_t rv;
+
+    (void)want;
+    (void)data;
+
+    if(mutex_trylock(&rd_mutex))
+        return 0;
+
+    rv = ramdisk_trim_dir(rootdir);
+    mutex_unlock(&rd_mutex);
+
+    return rv;
+}
+
+static shrinker_t rd_shrinker = {
+    .name = "ramdisk",
+    .priority = SHRINKER_PRIO_SPARE,
+    .shrink = ramdisk_shrink
+};
+
 /* Initialize the file system */
 int fs_ramdisk_init() {
     /* Create an empty root dir */
@@ -857,6 +908,9 @@ int fs_ramdisk_init() {
 
     /* Init thread mutexes */
     mutex_init(&rd_mutex, MUTEX_TYPE_NORMAL);
+    arena_init(&rd_scratch, 256);
+
+    shrinker_register(&rd_shrinker);
 
     /* Register with VFS */
     return nmmgr_handler_add(&vh.nmmgr);
@@ -865,6 +919,9 @@ int fs_ramdisk_init() {
 /* De-init the file system */
 int fs_ramdisk_shutdown() {
     rd_file_t *f1, *f2;
+
+    shrinker_unregister(&rd_shrinker);
+
     /* For now assume there's only the root dir, since mkdir and
        rmdir aren't even implemented... */
     f1 = LIST_FIRST(rootdir);
@@ -881,5 +938,6 @@ int fs_ramdisk_shutdown() {
     free(root);
 
     mutex_destroy(&rd_mutex);
+    arena_destroy(&rd_scratch);
     return nmmgr_handler_remove(&vh.nmmgr);
 }
@@ -0,0 +1,235 @@
+/* KallistiOS ##version##
+
+   arena.c
+   Copyright (C) 2026 The KallistiOS Team
+*/
+
+/* Arena allocators. Chunks in use are kept in a list from newest to oldest,
+   so that rewinding only has to look at the chunks allocated since the mark,
+   and resetting can splice the whole list onto the spare list at once. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <kos/arena.h>
+#include <kos/once.h>
+#include <kos/tls.h>
+
+/* Same alignment as malloc(). */
+#define ARENA_ALIGN     8
+
+#define ROUND_UP(x, a)  (((x) + (a) - 1) & ~((a) - 1))
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+};
+
+#define CHUNK_HDR       ROUND_UP(sizeof(struct arena_chunk), ARENA_ALIGN)
+#define CHUNK_DATA(c)   ((uintptr_t)(c) + CHUNK_HDR)
+
+int arena_init(arena_t *a, size_t chunk_size) {
+    a->head = a->first = a->spare = NULL;
+    a->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+    a->fixed = 0;
+
+    return 0;
+}
+
+int arena_init_buffer(arena_t *a, void *buf, size_t size) {
+    uintptr_t start = ROUND_UP((uintptr_t)buf, ARENA_ALIGN);
+    struct arena_chunk *c = (struct arena_chunk *)start;
+
+    if(size < (start - (uintptr_t)buf) + CHUNK_HDR + ARENA_ALIGN) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    c->next = NULL;
+    c->size = size - (start - (uintptr_t)buf) - CHUNK_HDR;
+    c->used = 0;
+
+    a->head = a->first = c;
+    a->spare = NULL;
+    a->chunk_size = 0;
+    a->fixed = 1;
+
+    return 0;
+}
+
+static size_t free_chunks(struct arena_chunk *c) {
+    struct arena_chunk *n;
+    size_t rv = 0;
+
+    while(c) {
+        n = c->next;
+        rv += c->size + CHUNK_HDR;
+        free(c);
+        c = n;
+    }
+
+    return rv;
+}
+
+void arena_destroy(arena_t *a) {
+    if(!a->fixed)
+        free_chunks(a->head);
+
+    free_chunks(a->spare);
+    a->head = a->first = a->spare = NULL;
+}
+
+/* Find a chunk with at least the given amount of space, either from the spare
+   list or from malloc(). */
+static struct arena_chunk *get_chunk(arena_t *a, size_t need) {
+    struct arena_chunk *c, **prev;
+
+    for(prev = &a->spare; (c = *prev); prev = &c->next) {
+        if(c->size >= need) {
+            *prev = c->next;
+            return c;
+        }
+    }
+
+    if(need < a->chunk_size)
+        need = a->chunk_size;
+
+    if(!(c = (struct arena_chunk *)malloc(CHUNK_HDR + need)))
+        return NULL;
+
+    c->size = need;
+    return c;
+}
+
+void *arena_alloc_aligned(arena_t *a, size_t size, size_t align) {
+    struct arena_chunk *c = a->head;
+    uintptr_t p;
+
+    if(align & (align - 1)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if(align < ARENA_ALIGN)
+        align = ARENA_ALIGN;
+
+    if(c) {
+        p = ROUND_UP(CHUNK_DATA(c) + c->used, align);
+
+        if(p + size <= CHUNK_DATA(c) + c->size) {
+            c->used = p + size - CHUNK_DATA(c);
+            return (void *)p;
+        }
+    }
+
+    /* Doesn't fit, so we need a new chunk. */
+    if(a->fixed || !(c = get_chunk(a, size + align - ARENA_ALIGN))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    c->next = a->head;
+    a->head = c;
+
+    if(!a->first)
+        a->first = c;
+
+    p = ROUND_UP(CHUNK_DATA(c), align);
+    c->used = p + size - CHUNK_DATA(c);
+
+    return (void *)p;
+}
+
+void *arena_alloc(arena_t *a, size_t size) {
+    return arena_alloc_aligned(a, size, ARENA_ALIGN);
+}
+
+char *arena_strndup(arena_t *a, const char *s, size_t n) {
+    size_t len = strnlen(s, n);
+    char *rv;
+
+    if(!(rv = (char *)arena_alloc_aligned(a, len + 1, 1)))
+        return NULL;
+
+    memcpy(rv, s, len);
+    rv[len] = 0;
+
+    return rv;
+}
+
+char *arena_strdup(arena_t *a, const char *s) {
+    return arena_strndup(a, s, strlen(s));
+}
+
+arena_mark_t arena_mark(arena_t *a) {
+    arena_mark_t rv;
+
+    rv.chunk = a->head;
+    rv.used = a->head ? a->head->used : 0;
+
+    return rv;
+}
+
+void arena_rewind(arena_t *a, arena_mark_t mark) {
+    struct arena_chunk *c;
+
+    /* Put back any chunks that were started after the mark. */
+    while(a->head && a->head != mark.chunk) {
+        c = a->head;
+        a->head = c->next;
+        c->next = a->spare;
+        a->spare = c;
+    }
+
+    if(a->head)
+        a->head->used = mark.used;
+    else
+        a->first = NULL;
+}
+
+void arena_reset(arena_t *a) {
+    if(a->fixed) {
+        a->head->used = 0;
+        return;
+    }
+
+    if(a->head) {
+        a->first->next = a->spare;
+        a->spare = a->head;
+        a->head = a->first = NULL;
+    }
+}
+
+size_t arena_trim(arena_t *a) {
+    size_t rv = free_chunks(a->spare);
+
+    a->spare = NULL;
+    return rv;
+}
+
+/* Per-thread arenas are kept in thread-local storage, with the key created the
+   first time anyone asks for it. */
+static kthread_once_t arena_key_once = KTHREAD_ONCE_INIT;
+static kthread_key_t arena_key;
+
+static void arena_key_create(void) {
+    kthread_key_create(&arena_key, NULL);
+}
+
+arena_t *arena_set_thread(arena_t *a) {
+    arena_t *rv;
+
+    kthread_once(&arena_key_once, arena_key_create);
+    rv = (arena_t *)kthread_getspecific(arena_key);
+    kthread_setspecific(arena_key, a);
+
+    return rv;
+}
+
+arena_t *arena_get_thread(void) {
+    kthread_once(&arena_key_once, arena_key_create);
+    return (arena_t *)kthread_getspecific(arena_key);
+}
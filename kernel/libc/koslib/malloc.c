@@ -19,11 +19,16 @@
 #include <malloc.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <arch/spinlock.h>
 #include <arch/arch.h>
+#include <arch/irq.h>
 
 #include <kos/opts.h>
+#include <kos/heapprof.h>
+#include <kos/shrinker.h>
 
 #undef DEBUG
 
@@ -53,6 +58,11 @@ int malloc_irq_safe() {
     return !spinlock_is_locked(&mALLOC_MUTEx);
 }
 
+/* Get more memory through a wrapper around sbrk(), so that we can tell when
+   the heap is getting close to the end of memory. */
+static void *kos_morecore(long size);
+#define MORECORE kos_morecore
+
 /* This is arch-specific */
 // extern void * sbrk(size_t amt);
 
@@ -1675,7 +1685,479 @@ static LIST_HEAD(memctl_list, memctl) block_list;
 
 #endif  /* KM_DEBUG */
 
+/************************** Memory Pressure **************************/
+
+/* Set when the heap grows to within the shrinker watermark of the end of
+   memory (see kos/shrinker.h). This is checked once the malloc lock has been
+   released, since the shrinkers will want to free things. */
+static volatile int mp_low = 0;
+
+static void *kos_morecore(long size) {
+    void *rv = sbrk(size);
+    size_t wm;
+
+    if(size > 0 && rv != (void *)-1 && (wm = shrinker_get_watermark()) &&
+       mm_sbrk_avail() < wm)
+        mp_low = 1;
+
+    return rv;
+}
+
+/* Called with the malloc lock held when an allocation fails. Outside of an
+   interrupt, the lock is dropped while the shrinkers try to free up some
+   memory. Returns nonzero if they did, so the allocation can be retried. */
+static int mp_reclaim(size_t bytes) {
+    size_t freed;
+
+    if(irq_inside_int())
+        return 0;
+
+    (void)MALLOC_POSTACTION;
+    freed = shrinker_run(bytes);
+    (void)MALLOC_PREACTION;
+
+    return freed != 0;
+}
+
+/* Called after the malloc lock is released. */
+static inline void mp_check(void) {
+    size_t wm, avail;
+
+    if(__builtin_expect(mp_low, 0) && !irq_inside_int()) {
+        mp_low = 0;
+        wm = shrinker_get_watermark();
+        avail = mm_sbrk_avail();
+
+        if(avail < wm)
+            shrinker_run(wm - avail);
+    }
+}
+
+/************************** Heap Profiling **************************/
+
+/* Sampling heap profiler (see kos/heapprof.h). Every hp_rate allocations, the
+   new block is charged to its caller and its size bucket, and entered in a
+   hash table of live sampled blocks so that the charge can be taken back when
+   it is freed. Everything here is protected by the malloc lock. The tables
+   come straight from the internal allocator, so they never show up in the
+   profile themselves. */
+
+struct hp_live {
+    Void_t          *ptr;
+    uint32          size;
+    uint16          site;
+    uint16          bucket;
+};
+
+static uint32 hp_rate = 0;
+static uint32 hp_countdown = 0;     /* 0 while the profiler is stopped */
+static uint32 hp_samples = 0;
+static uint32 hp_dropped = 0;
+static uint32 hp_nlive = 0;
+static int hp_nsites = 0;
+static struct hp_live *hp_live = NULL;
+static heapprof_site_t *hp_sites = NULL;
+static heapprof_bucket_t hp_buckets[HEAPPROF_BUCKETS];
+
+/* Both tables are a power of two in size, and are never allowed to fill up
+   completely, so that probing always ends at an empty slot. */
+#define HP_LIVE_MASK    (HEAPPROF_MAX_LIVE - 1)
+#define HP_SITE_MASK    (HEAPPROF_MAX_SITES - 1)
+#define HP_LIVE_LIMIT   (HEAPPROF_MAX_LIVE * 7 / 8)
+#define HP_SITE_LIMIT   (HEAPPROF_MAX_SITES * 7 / 8)
+
+static inline int hp_live_hash(Void_t *ptr) {
+    return (int)((((uint32)ptr >> 3) * 2654435761UL) & HP_LIVE_MASK);
+}
+
+static inline int hp_site_hash(uint32 caller) {
+    return (int)(((caller >> 1) * 2654435761UL) & HP_SITE_MASK);
+}
+
+static int hp_bucket(size_t size) {
+    int i = 0;
+
+    while(i < HEAPPROF_BUCKETS - 1 && size > HEAPPROF_BUCKET_MAX(i))
+        ++i;
+
+    return i;
+}
+
+/* Find the entry for a caller, creating it if need be. Entries are never
+   removed (except by heapprof_reset()), so a lookup can stop at the first
+   empty slot. Returns -1 if the table is full. */
+static int hp_site_lookup(uint32 caller) {
+    int idx = hp_site_hash(caller);
+
+    while(hp_sites[idx].caller) {
+        if(hp_sites[idx].caller == caller)
+            return idx;
+
+        idx = (idx + 1) & HP_SITE_MASK;
+    }
+
+    if(hp_nsites >= HP_SITE_LIMIT)
+        return -1;
+
+    hp_sites[idx].caller = caller;
+    ++hp_nsites;
+
+    return idx;
+}
+
+/* Find the slot a block is in, or the empty slot it would go in. */
+static int hp_live_slot(Void_t *ptr) {
+    int idx = hp_live_hash(ptr);
+
+    while(hp_live[idx].ptr && hp_live[idx].ptr != ptr)
+        idx = (idx + 1) & HP_LIVE_MASK;
+
+    return idx;
+}
+
+static void hp_track(Void_t *ptr, size_t size, int site) {
+    struct hp_live *e = &hp_live[hp_live_slot(ptr)];
+    int b = hp_bucket(size);
+
+    e->ptr = ptr;
+    e->size = size;
+    e->site = site;
+    e->bucket = b;
+    ++hp_nlive;
+
+    ++hp_sites[site].allocs;
+    hp_sites[site].live_bytes += size;
+    ++hp_buckets[b].allocs;
+    hp_buckets[b].live_bytes += size;
+}
+
+/* Take a block out of the live table, if it's there. Returns the site it was
+   charged to, or -1 if it wasn't sampled. */
+static int hp_untrack(Void_t *ptr) {
+    int i, j, k, site;
+    struct hp_live *e;
+
+    i = hp_live_slot(ptr);
+    e = &hp_live[i];
+
+    if(!e->ptr)
+        return -1;
+
+    site = e->site;
+    ++hp_sites[site].frees;
+    hp_sites[site].live_bytes -= e->size;
+    ++hp_buckets[e->bucket].frees;
+    hp_buckets[e->bucket].live_bytes -= e->size;
+    --hp_nlive;
+
+    /* Close up the hole, moving back any later entries in the same run that
+       could no longer be found from their home slot otherwise. */
+    for(j = (i + 1) & HP_LIVE_MASK; hp_live[j].ptr; j = (j + 1) & HP_LIVE_MASK) {
+        k = hp_live_hash(hp_live[j].ptr);
+
+        if(i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+
+        hp_live[i] = hp_live[j];
+        i = j;
+    }
+
+    hp_live[i].ptr = NULL;
+
+    return site;
+}
+
+static void hp_sample(Void_t *ptr, size_t size, uint32 caller) {
+    int site;
+
+    hp_countdown = hp_rate;
+
+    if(!ptr)
+        return;
+
+    ++hp_samples;
+
+    if(hp_nlive >= HP_LIVE_LIMIT || (site = hp_site_lookup(caller)) < 0) {
+        ++hp_dropped;
+        return;
+    }
+
+    hp_track(ptr, size, site);
+}
+
+/* These are called by the public entry points with the malloc lock held. When
+   the profiler isn't in use, each is just a single test. */
+static inline void hp_alloc(Void_t *ptr, size_t size, uint32 caller) {
+    if(__builtin_expect(hp_countdown != 0, 0) && !--hp_countdown)
+        hp_sample(ptr, size, caller);
+}
+
+static inline void hp_free(Void_t *ptr) {
+    if(__builtin_expect(hp_nlive != 0, 0))
+        hp_untrack(ptr);
+}
+
+/* A sampled block stays sampled when it's resized, and stays charged to the
+   caller that allocated it in the first place. Moving it isn't counted as a
+   free and another allocation by that caller (though it is by the size
+   buckets, since it may well have changed buckets). */
+static inline void hp_realloc(Void_t *old, Void_t *ptr, size_t size,
+                              uint32 caller) {
+    int site = -1;
+
+    if(__builtin_expect(hp_nlive != 0, 0) && old)
+        site = hp_untrack(old);
+
+    if(site < 0) {
+        hp_alloc(ptr, size, caller);
+    }
+    else if(ptr) {
+        hp_track(ptr, size, site);
+        --hp_sites[site].allocs;
+        --hp_sites[site].frees;
+    }
+}
+
+int heapprof_start(uint32 rate) {
+    struct hp_live *live;
+    heapprof_site_t *sites;
+
+    if(!rate) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(MALLOC_PREACTION != 0) {
+        return -1;
+    }
+
+    if(!hp_live) {
+        live = (struct hp_live *)mALLOc(sizeof(struct hp_live) *
+                                        HEAPPROF_MAX_LIVE);
+        sites = (heapprof_site_t *)mALLOc(sizeof(heapprof_site_t) *
+                                          HEAPPROF_MAX_SITES);
+
+        if(!live || !sites) {
+            if(live)
+                fREe(live);
+
+            if(sites)
+                fREe(sites);
+
+            if(MALLOC_POSTACTION != 0) {
+            }
+
+            errno = ENOMEM;
+            return -1;
+        }
+
+        memset(live, 0, sizeof(struct hp_live) * HEAPPROF_MAX_LIVE);
+        memset(sites, 0, sizeof(heapprof_site_t) * HEAPPROF_MAX_SITES);
+        hp_live = live;
+        hp_sites = sites;
+    }
+
+    hp_rate = hp_countdown = rate;
+
+    if(MALLOC_POSTACTION != 0) {
+    }
+
+    return 0;
+}
+
+void heapprof_stop(void) {
+    if(MALLOC_PREACTION != 0) {
+        return;
+    }
+
+    hp_rate = hp_countdown = 0;
+
+    if(MALLOC_POSTACTION != 0) {
+    }
+}
+
+void heapprof_reset(void) {
+    if(MALLOC_PREACTION != 0) {
+        return;
+    }
+
+    if(hp_rate) {
+        memset(hp_live, 0, sizeof(struct hp_live) * HEAPPROF_MAX_LIVE);
+        memset(hp_sites, 0, sizeof(heapprof_site_t) * HEAPPROF_MAX_SITES);
+    }
+    else if(hp_live) {
+        fREe(hp_live);
+        fREe(hp_sites);
+        hp_live = NULL;
+        hp_sites = NULL;
+    }
+
+    memset(hp_buckets, 0, sizeof(hp_buckets));
+    hp_samples = hp_dropped = hp_nlive = 0;
+    hp_nsites = 0;
+
+    if(MALLOC_POSTACTION != 0) {
+    }
+}
+
+static void hp_get_stats(heapprof_stats_t *st) {
+    st->rate = hp_rate;
+    st->samples = hp_samples;
+    st->dropped = hp_dropped;
+    st->live = hp_nlive;
+    memcpy(st->sizes, hp_buckets, sizeof(hp_buckets));
+}
+
+int heapprof_get_stats(heapprof_stats_t *stats) {
+    if(MALLOC_PREACTION != 0) {
+        return -1;
+    }
+
+    hp_get_stats(stats);
+
+    if(MALLOC_POSTACTION != 0) {
+    }
+
+    return 0;
+}
+
+/* Copy out the callers seen so far, along with the overall statistics and the
+   state of the heap at the same moment. The copy comes from the internal
+   allocator, and must be given back with hp_release(). */
+static int hp_snapshot(heapprof_site_t **out, int *count, heapprof_stats_t *st,
+                       struct mallinfo *mi) {
+    heapprof_site_t *rv = NULL;
+    int i, n = 0;
+
+    if(MALLOC_PREACTION != 0) {
+        return -1;
+    }
+
+    if(hp_nsites) {
+        if(!(rv = (heapprof_site_t *)mALLOc(sizeof(heapprof_site_t) *
+                                            hp_nsites))) {
+            if(MALLOC_POSTACTION != 0) {
+            }
+
+            return -1;
+        }
+
+        for(i = 0; i < HEAPPROF_MAX_SITES; ++i) {
+            if(hp_sites[i].caller)
+                rv[n++] = hp_sites[i];
+        }
+    }
+
+    if(st)
+        hp_get_stats(st);
+
+    if(mi)
+        *mi = mALLINFo();
+
+    if(MALLOC_POSTACTION != 0) {
+    }
+
+    *out = rv;
+    *count = n;
+    return 0;
+}
+
+static void hp_release(heapprof_site_t *snap) {
+    if(!snap)
+        return;
+
+    if(MALLOC_PREACTION != 0) {
+        return;
+    }
+
+    fREe(snap);
+
+    if(MALLOC_POSTACTION != 0) {
+    }
+}
+
+static int hp_compare_live(const void *a, const void *b) {
+    const heapprof_site_t *l = (const heapprof_site_t *)a;
+    const heapprof_site_t *r = (const heapprof_site_t *)b;
+
+    if(l->live_bytes != r->live_bytes)
+        return l->live_bytes > r->live_bytes ? -1 : 1;
+
+    return (int)r->allocs - (int)l->allocs;
+}
+
+static int hp_compare_caller(const void *a, const void *b) {
+    const heapprof_site_t *l = (const heapprof_site_t *)a;
+    const heapprof_site_t *r = (const heapprof_site_t *)b;
+
+    return l->caller < r->caller ? -1 : l->caller > r->caller;
+}
+
+int heapprof_get_sites(heapprof_site_t *sites, int count) {
+    heapprof_site_t *snap;
+    int n;
+
+    if(hp_snapshot(&snap, &n, NULL, NULL) < 0)
+        return 0;
+
+    qsort(snap, n, sizeof(heapprof_site_t), hp_compare_live);
+
+    if(count > n)
+        count = n;
+
+    memcpy(sites, snap, count * sizeof(heapprof_site_t));
+    hp_release(snap);
+
+    return count;
+}
+
+int heapprof_dump(int (*pf)(const char *fmt, ...)) {
+    heapprof_site_t *snap, *s;
+    heapprof_bucket_t *b;
+    heapprof_stats_t st;
+    struct mallinfo mi;
+    int i, n;
+
+    if(hp_snapshot(&snap, &n, &st, &mi) < 0)
+        return -1;
+
+    /* Sorted by address, so that two dumps line up under diff. */
+    qsort(snap, n, sizeof(heapprof_site_t), hp_compare_caller);
+
+    pf("HEAP: arena %d, in use %d, free %d in %d chunks, top %d\n",
+       mi.arena, mi.uordblks, mi.fordblks, mi.ordblks, mi.keepcost);
+    pf("SAMPLES: rate %lu, sampled %lu, dropped %lu, live %lu\n",
+       st.rate, st.samples, st.dropped, st.live);
+
+    pf("SIZE         ALLOCS     FREES  LIVE_BYTES\n");
+
+    for(i = 0; i < HEAPPROF_BUCKETS; ++i) {
+        b = &st.sizes[i];
+
+        if(i < HEAPPROF_BUCKETS - 1)
+            pf("<= %-7lu  %8lu  %8lu  %10lu\n", HEAPPROF_BUCKET_MAX(i),
+               b->allocs, b->frees, b->live_bytes);
+        else
+            pf(">  %-7lu  %8lu  %8lu  %10lu\n", HEAPPROF_BUCKET_MAX(i - 1),
+               b->allocs, b->frees, b->live_bytes);
+    }
+
+    pf("CALLER       ALLOCS     FREES  LIVE_BYTES\n");
+
+    for(i = 0; i < n; ++i) {
+        s = &snap[i];
+        pf("%08lx   %8lu  %8lu  %10lu\n", s->caller, s->allocs, s->frees,
+           s->live_bytes);
+    }
+
+    pf("--end of list--\n");
+    hp_release(snap);
+
+    return 0;
+}
+
 Void_t* public_mALLOc(size_t bytes) {
+    uint32 caller = arch_get_ret_addr();
     Void_t* m;
 
 #ifdef KM_DBG
@@ -1724,11 +2206,18 @@ Void_t* public_mALLOc(size_t bytes) {
 
 #else
     m = mALLOc(bytes);
+
+    while(!m && mp_reclaim(bytes))
+        m = mALLOc(bytes);
 #endif
 
+    hp_alloc(m, bytes, caller);
+
     if(MALLOC_POSTACTION != 0) {
     }
 
+    mp_check();
+
     return m;
 }
 
@@ -1747,6 +2236,8 @@ void public_fREe(Void_t* m) {
         return;
     }
 
+    hp_free(m);
+
 #ifdef KM_DBG
 
 #ifdef KM_DBG_VERBOSE
@@ -1895,6 +2386,9 @@ int mem_check_all() {
 }
 
 Void_t* public_rEALLOc(Void_t* m, size_t bytes) {
+    uint32 caller = arch_get_ret_addr();
+    Void_t* old = m;
+
 #ifdef KM_DBG
     uint32 rv = arch_get_ret_addr(), rs, *nt, i;
     memctl_t * ctl;
@@ -2016,16 +2510,26 @@ Void_t* public_rEALLOc(Void_t* m, size_t bytes) {
     }
 
 #else
-    m = rEALLOc(m, bytes);
+    m = rEALLOc(old, bytes);
+
+    while(!m && bytes && mp_reclaim(bytes))
+        m = rEALLOc(old, bytes);
 #endif
 
+    /* If the realloc failed, the old block is still there. */
+    if(m || !bytes)
+        hp_realloc(old, m, bytes, caller);
+
     if(MALLOC_POSTACTION != 0) {
     }
 
+    mp_check();
+
     return m;
 }
 
 Void_t* public_mEMALIGn(size_t alignment, size_t bytes) {
+    uint32 caller = arch_get_ret_addr();
     Void_t* m;
 
 #ifdef KM_DBG
@@ -2075,11 +2579,18 @@ Void_t* public_mEMALIGn(size_t alignment, size_t bytes) {
 
 #else
     m = mEMALIGn(alignment, bytes);
+
+    while(!m && mp_reclaim(bytes + alignment))
+        m = mEMALIGn(alignment, bytes);
 #endif
 
+    hp_alloc(m, bytes, caller);
+
     if(MALLOC_POSTACTION != 0) {
     }
 
+    mp_check();
+
     return m;
 }
 
@@ -2100,6 +2611,7 @@ Void_t* public_pVALLOc(size_t bytes) {
 }
 
 Void_t* public_cALLOc(size_t n, size_t elem_size) {
+    uint32 caller = arch_get_ret_addr();
     Void_t* m;
 
 #ifdef KM_DBG
@@ -2150,11 +2662,18 @@ Void_t* public_cALLOc(size_t n, size_t elem_size) {
 
 #else
     m = cALLOc(n, elem_size);
+
+    while(!m && mp_reclaim(n * elem_size))
+        m = cALLOc(n, elem_size);
 #endif
 
+    hp_alloc(m, n * elem_size, caller);
+
     if(MALLOC_POSTACTION != 0) {
     }
 
+    mp_check();
+
     return m;
 }
 
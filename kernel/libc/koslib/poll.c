@@ -13,6 +13,7 @@
 #include <kos/fs.h>
 #include <kos/mutex.h>
 #include <kos/cond.h>
+#include <kos/tasklet.h>
 
 struct poll_int {
     LIST_ENTRY(poll_int) entry;
@@ -26,6 +27,14 @@ LIST_HEAD(polllist, poll_int) poll_list;
 
 static mutex_t mutex = MUTEX_INITIALIZER;
 
+void __poll_event_trigger(int fd, short event);
+
+static void poll_event_deferred(void *data) {
+    uint32 ev = (uint32)data;
+
+    __poll_event_trigger((int)(ev >> 16), (short)(ev & 0xFFFF));
+}
+
 void __poll_event_trigger(int fd, short event) {
     struct poll_int *i;
     nfds_t j;
@@ -33,9 +42,13 @@ void __poll_event_trigger(int fd, short event) {
     short mask;
 
     if(irq_inside_int()) {
-        if(mutex_trylock(&mutex))
-            /* XXXX: Uhh... this is bad... */
+        /* If someone's holding the lock, hand this off to be done once we're
+           out of the interrupt, rather than losing the event. */
+        if(mutex_trylock(&mutex)) {
+            tasklet_schedule(poll_event_deferred,
+                             (void *)(((uint32)fd << 16) | (uint16)event));
             return;
+        }
     }
     else {
         mutex_lock(&mutex);
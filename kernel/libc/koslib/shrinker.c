@@ -0,0 +1,104 @@
+/* KallistiOS ##version##
+
+   shrinker.c
+   Copyright (C) 2026 The KallistiOS Team
+*/
+
+/* Memory pressure callbacks. The list is kept sorted by priority. Changes to
+   it are made with interrupts disabled, so that shrinkers can be registered
+   before threads are up, and running the shrinkers is serialized with an
+   error-checking mutex, which also keeps a shrinker that allocates memory
+   from setting off another round on the same thread. Since the shrinkers are
+   run from inside malloc(), they are never waited for: if another thread is
+   already running them, or the caller can't sleep, nothing is done. */
+
+#include <errno.h>
+
+#include <kos/shrinker.h>
+#include <kos/mutex.h>
+#include <kos/thread.h>
+#include <arch/irq.h>
+
+static TAILQ_HEAD(shrinker_list, shrinker) shrinkers =
+    TAILQ_HEAD_INITIALIZER(shrinkers);
+
+static mutex_t shrinker_mutex = ERRORCHECK_MUTEX_INITIALIZER;
+static size_t shrinker_watermark = 0;
+
+int shrinker_register(shrinker_t *s) {
+    shrinker_t *i;
+    int old;
+
+    if(!s->shrink) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    old = irq_disable();
+
+    TAILQ_FOREACH(i, &shrinkers, list) {
+        if(i->priority > s->priority)
+            break;
+    }
+
+    if(i)
+        TAILQ_INSERT_BEFORE(i, s, list);
+    else
+        TAILQ_INSERT_TAIL(&shrinkers, s, list);
+
+    irq_restore(old);
+
+    return 0;
+}
+
+int shrinker_unregister(shrinker_t *s) {
+    int old;
+
+    if(irq_inside_int() || mutex_lock(&shrinker_mutex)) {
+        errno = EPERM;
+        return -1;
+    }
+
+    old = irq_disable();
+    TAILQ_REMOVE(&shrinkers, s, list);
+    irq_restore(old);
+
+    mutex_unlock(&shrinker_mutex);
+
+    return 0;
+}
+
+size_t shrinker_run(size_t want) {
+    shrinker_t *s;
+    size_t rv = 0;
+
+    /* malloc() is often called with interrupts disabled, and the shrinkers
+       may need to sleep on their own locks, so don't run them then. */
+    if(irq_inside_int() || irq_disabled() || !thd_current ||
+       TAILQ_EMPTY(&shrinkers))
+        return 0;
+
+    /* This fails if any thread (this one included) is already running the
+       shrinkers. */
+    if(mutex_trylock(&shrinker_mutex))
+        return 0;
+
+    TAILQ_FOREACH(s, &shrinkers, list) {
+        rv += s->shrink(want - rv, s->data);
+
+        if(rv >= want)
+            break;
+    }
+
+    mutex_unlock(&shrinker_mutex);
+
+    return rv;
+}
+
+void shrinker_set_watermark(size_t bytes) {
+    shrinker_watermark = bytes;
+}
+
+size_t shrinker_get_watermark(void) {
+    return shrinker_watermark;
+}
@@ -0,0 +1,450 @@
+/* KallistiOS ##version##
+
+   slab.c
+   Copyright (C) 2026 The KallistiOS Team
+*/
+
+/* Fixed-size object caches, carved out of blocks from malloc(). Each slab
+   starts with a header, and each object is followed by a pointer back to its
+   slab, so slabs don't need any special alignment (asking malloc() for highly
+   aligned blocks would just leave gaps in the heap). Free objects in a slab
+   are chained together through a pointer stored in the object itself (or just
+   after it, if the cache has a constructor, so that the constructed state
+   isn't clobbered). */
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/queue.h>
+
+#include <kos/slab.h>
+#include <kos/shrinker.h>
+#include <kos/mutex.h>
+#include <arch/irq.h>
+
+/* Slabs are about this big. Caches whose objects don't fit at least
+   SLAB_MIN_OBJS to a slab that size get bigger slabs instead, holding that many
+   objects, or as many as fit in SLAB_MAX_SIZE (but always at least one). */
+#define SLAB_SIZE       4096
+#define SLAB_MIN_OBJS   8
+#define SLAB_MAX_SIZE   16384
+
+/* Number of completely free slabs a cache holds on to, to keep from going back
+   and forth to malloc() when usage hovers around a slab boundary. */
+#define SLAB_KEEP_EMPTY 1
+
+/* Default alignment, same as malloc(). */
+#define SLAB_ALIGN      8
+
+#define ROUND_UP(x, a)  (((x) + (a) - 1) & ~((a) - 1))
+
+struct slab {
+    LIST_ENTRY(slab) list;
+    slab_cache_t *cache;
+    void *free;
+    uint32 inuse;
+};
+
+LIST_HEAD(slab_list, slab);
+
+struct slab_cache {
+    LIST_ENTRY(slab_cache) list;
+
+    size_t stride;              /* Distance between objects */
+    size_t link;                /* Offset of the free list pointer */
+    size_t back;                /* Offset of the slab pointer */
+    size_t align;               /* Alignment of each object */
+    size_t first;               /* Offset of the first object in a slab */
+    void (*ctor)(void *obj);
+
+    struct slab_list full;
+    struct slab_list partial;
+    struct slab_list empty;
+    int nempty;
+
+    slab_stats_t stats;
+};
+
+static LIST_HEAD(cache_list, slab_cache) slab_caches =
+    LIST_HEAD_INITIALIZER(slab_caches);
+
+/* Held while adding and removing caches, so the shrinker can walk the list
+   without caches disappearing out from under it. The list is also only
+   changed with interrupts disabled, for slab_dump(). */
+static mutex_t slab_mutex = MUTEX_INITIALIZER;
+
+static size_t slab_shrink(size_t want, void *data);
+
+static shrinker_t slab_shrinker = {
+    .name = "slab",
+    .priority = SHRINKER_PRIO_SPARE,
+    .shrink = slab_shrink
+};
+static int slab_shrinker_registered = 0;
+
+#define OBJ_LINK(c, o)  (*(void **)((uint8 *)(o) + (c)->link))
+#define OBJ_BACK(c, o)  (*(struct slab **)((uint8 *)(o) + (c)->back))
+
+slab_cache_t *slab_cache_create(const char *name, size_t size, size_t align,
+                                void (*ctor)(void *obj)) {
+    slab_cache_t *c;
+    size_t objsz, ssize;
+    uint32 cnt;
+    int old;
+
+    if(!align)
+        align = SLAB_ALIGN;
+
+    if(!size || (align & (align - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if(align < sizeof(void *))
+        align = sizeof(void *);
+
+    if(!(c = (slab_cache_t *)malloc(sizeof(slab_cache_t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset(c, 0, sizeof(slab_cache_t));
+
+    /* Figure out where the free list pointer goes, and from that, how much
+       space each object takes up. */
+    if(ctor) {
+        c->link = ROUND_UP(size, sizeof(void *));
+        objsz = c->link + sizeof(void *);
+    }
+    else {
+        c->link = 0;
+        objsz = size < sizeof(void *) ? sizeof(void *) : size;
+    }
+
+    c->align = align;
+    c->first = ROUND_UP(sizeof(struct slab), align);
+
+    c->back = ROUND_UP(objsz, sizeof(void *));
+    c->stride = ROUND_UP(c->back + sizeof(void *), align);
+
+    cnt = (SLAB_SIZE - c->first) / c->stride;
+
+    if(cnt < SLAB_MIN_OBJS) {
+        cnt = (SLAB_MAX_SIZE - c->first) / c->stride;
+
+        if(cnt > SLAB_MIN_OBJS)
+            cnt = SLAB_MIN_OBJS;
+        else if(!cnt)
+            cnt = 1;
+    }
+
+    ssize = c->first + c->stride * cnt;
+
+    c->ctor = ctor;
+    LIST_INIT(&c->full);
+    LIST_INIT(&c->partial);
+    LIST_INIT(&c->empty);
+
+    c->stats.name = name;
+    c->stats.obj_size = size;
+    c->stats.slab_size = ssize;
+    c->stats.objs_per_slab = (ssize - c->first) / c->stride;
+
+    mutex_lock(&slab_mutex);
+
+    if(!slab_shrinker_registered) {
+        shrinker_register(&slab_shrinker);
+        slab_shrinker_registered = 1;
+    }
+
+    old = irq_disable();
+    LIST_INSERT_HEAD(&slab_caches, c, list);
+    irq_restore(old);
+
+    mutex_unlock(&slab_mutex);
+
+    return c;
+}
+
+/* Give all of a cache's empty slabs back to malloc(). malloc() takes a
+   spinlock, so this is done with interrupts enabled, one slab at a time. */
+static size_t slab_release_empty(slab_cache_t *c) {
+    struct slab *s;
+    size_t rv = 0;
+    int old;
+
+    for(;;) {
+        old = irq_disable();
+
+        if((s = LIST_FIRST(&c->empty))) {
+            LIST_REMOVE(s, list);
+            --c->nempty;
+            --c->stats.slabs;
+        }
+
+        irq_restore(old);
+
+        if(!s)
+            return rv;
+
+        free(s);
+        rv += c->stats.slab_size;
+    }
+}
+
+int slab_cache_destroy(slab_cache_t *c) {
+    int old;
+
+    mutex_lock(&slab_mutex);
+    old = irq_disable();
+
+    if(c->stats.in_use) {
+        irq_restore(old);
+        mutex_unlock(&slab_mutex);
+        errno = EBUSY;
+        return -1;
+    }
+
+    LIST_REMOVE(c, list);
+    irq_restore(old);
+    mutex_unlock(&slab_mutex);
+
+    /* Since nothing is in use, everything's on the empty list. */
+    slab_release_empty(c);
+    free(c);
+
+    return 0;
+}
+
+/* Allocate and set up a new slab. */
+static struct slab *slab_grow(slab_cache_t *c) {
+    struct slab *s;
+    uint8 *obj;
+    uint32 i;
+
+    if(c->align <= SLAB_ALIGN)
+        s = (struct slab *)malloc(c->stats.slab_size);
+    else
+        s = (struct slab *)memalign(c->align, c->stats.slab_size);
+
+    if(!s)
+        return NULL;
+
+    s->cache = c;
+    s->inuse = 0;
+    s->free = NULL;
+
+    /* Build the free list back to front, so objects get handed out in address
+       order. */
+    obj = (uint8 *)s + c->first + c->stride * c->stats.objs_per_slab;
+
+    for(i = 0; i < c->stats.objs_per_slab; ++i) {
+        obj -= c->stride;
+
+        if(c->ctor)
+            c->ctor(obj);
+
+        OBJ_BACK(c, obj) = s;
+
+        OBJ_LINK(c, obj) = s->free;
+        s->free = obj;
+    }
+
+    return s;
+}
+
+/* Add a new slab to the empty list. Interrupts must be disabled. */
+static void slab_add(slab_cache_t *c, struct slab *s) {
+    LIST_INSERT_HEAD(&c->empty, s, list);
+    ++c->nempty;
+    ++c->stats.slabs;
+}
+
+void *slab_alloc(slab_cache_t *c) {
+    struct slab *s;
+    void *obj;
+    int old;
+
+    old = irq_disable();
+
+    while(!(s = LIST_FIRST(&c->partial))) {
+        if((s = LIST_FIRST(&c->empty))) {
+            --c->nempty;
+            break;
+        }
+
+        /* Nothing free, so we need another slab. Inside an interrupt, we can
+           only do that if nobody's in the middle of a malloc(). */
+        if(irq_inside_int() && !malloc_irq_safe()) {
+            ++c->stats.failures;
+            irq_restore(old);
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        irq_restore(old);
+        s = slab_grow(c);
+        old = irq_disable();
+
+        if(!s) {
+            ++c->stats.failures;
+            irq_restore(old);
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        slab_add(c, s);
+    }
+
+    obj = s->free;
+    s->free = OBJ_LINK(c, obj);
+
+    LIST_REMOVE(s, list);
+
+    if(++s->inuse == c->stats.objs_per_slab)
+        LIST_INSERT_HEAD(&c->full, s, list);
+    else
+        LIST_INSERT_HEAD(&c->partial, s, list);
+
+    ++c->stats.allocs;
+
+    if(++c->stats.in_use > c->stats.peak)
+        c->stats.peak = c->stats.in_use;
+
+    irq_restore(old);
+
+    return obj;
+}
+
+void slab_free(slab_cache_t *c, void *obj) {
+    struct slab *s, *dead = NULL;
+    int old;
+
+    if(!obj)
+        return;
+
+    s = OBJ_BACK(c, obj);
+    assert(s->cache == c);
+
+    old = irq_disable();
+
+    OBJ_LINK(c, obj) = s->free;
+    s->free = obj;
+
+    LIST_REMOVE(s, list);
+
+    if(--s->inuse) {
+        LIST_INSERT_HEAD(&c->partial, s, list);
+    }
+    else if(c->nempty < SLAB_KEEP_EMPTY ||
+            (irq_inside_int() && !malloc_irq_safe())) {
+        LIST_INSERT_HEAD(&c->empty, s, list);
+        ++c->nempty;
+    }
+    else {
+        --c->stats.slabs;
+        dead = s;
+    }
+
+    ++c->stats.frees;
+    --c->stats.in_use;
+
+    irq_restore(old);
+
+    if(dead)
+        free(dead);
+}
+
+int slab_cache_reserve(slab_cache_t *c, uint32 count) {
+    struct slab *s;
+    uint32 avail;
+    int old;
+
+    if(irq_inside_int()) {
+        errno = EPERM;
+        return -1;
+    }
+
+    for(;;) {
+        old = irq_disable();
+        avail = c->stats.slabs * c->stats.objs_per_slab - c->stats.in_use;
+        irq_restore(old);
+
+        if(avail >= count)
+            return 0;
+
+        if(!(s = slab_grow(c))) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        old = irq_disable();
+        slab_add(c, s);
+        irq_restore(old);
+    }
+}
+
+size_t slab_cache_shrink(slab_cache_t *c) {
+    if(irq_inside_int() && !malloc_irq_safe())
+        return 0;
+
+    return slab_release_empty(c);
+}
+
+/* Memory pressure callback: give back the empty slabs from every cache. */
+static size_t slab_shrink(size_t want, void *data) {
+    slab_cache_t *c;
+    size_t rv = 0;
+
+    (void)data;
+
+    if(mutex_trylock(&slab_mutex))
+        return 0;
+
+    LIST_FOREACH(c, &slab_caches, list) {
+        if(rv >= want)
+            break;
+
+        rv += slab_release_empty(c);
+    }
+
+    mutex_unlock(&slab_mutex);
+
+    return rv;
+}
+
+int slab_cache_get_stats(slab_cache_t *c, slab_stats_t *stats) {
+    int old;
+
+    old = irq_disable();
+    *stats = c->stats;
+    irq_restore(old);
+
+    return 0;
+}
+
+int slab_dump(int (*pf)(const char *fmt, ...)) {
+    slab_cache_t *c;
+    slab_stats_t st;
+    int old;
+
+    pf("CACHE                 OBJSIZE  SLABS  IN_USE    PEAK     ALLOCS"
+       "  FAILS\n");
+
+    old = irq_disable();
+
+    LIST_FOREACH(c, &slab_caches, list) {
+        st = c->stats;
+        pf("%-20s  %7lu  %5lu  %6lu  %6lu  %9lu  %5lu\n",
+           st.name ? st.name : "?", (uint32)st.obj_size, st.slabs, st.in_use,
+           st.peak, st.allocs, st.failures);
+    }
+
+    irq_restore(old);
+
+    pf("--end of list--\n");
+
+    return 0;
+}
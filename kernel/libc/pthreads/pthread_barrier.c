@@ -0,0 +1,79 @@
+/* KallistiOS ##version##
+
+   pthread_barrier.c
+   Copyright (C) 2026 The KallistiOS Team
+*/
+
+#include <pthread.h>
+#include <errno.h>
+#include <assert.h>
+
+/* Barrier Initialization Attributes, P1003.1j/D10, p. 30 */
+
+/* There's only ever one process, so barriers are always process-private and
+   there's nothing to keep in the attributes. */
+
+int pthread_barrierattr_init(pthread_barrierattr_t *attr) {
+    if(!attr)
+        return EINVAL;
+
+    return 0;
+}
+
+int pthread_barrierattr_destroy(pthread_barrierattr_t *attr) {
+    if(!attr)
+        return EINVAL;
+
+    return 0;
+}
+
+int pthread_barrierattr_getpshared(const pthread_barrierattr_t *attr,
+                                   int *pshared) {
+    if(!attr || !pshared)
+        return EINVAL;
+
+    *pshared = PTHREAD_PROCESS_PRIVATE;
+    return 0;
+}
+
+int pthread_barrierattr_setpshared(pthread_barrierattr_t *attr, int pshared) {
+    if(!attr || pshared != PTHREAD_PROCESS_PRIVATE)
+        return EINVAL;
+
+    return 0;
+}
+
+/* Initializing and Destroying a Barrier, P1003.1j/D10, p. 33 */
+
+int pthread_barrier_init(pthread_barrier_t *barrier,
+                         const pthread_barrierattr_t *attr, unsigned count) {
+    (void)attr;
+    assert(barrier);
+
+    if(barrier_init(barrier, count))
+        return errno;
+
+    return 0;
+}
+
+int pthread_barrier_destroy(pthread_barrier_t *barrier) {
+    assert(barrier);
+
+    if(barrier_destroy(barrier))
+        return errno;
+
+    return 0;
+}
+
+/* Synchronizing at a Barrier, P1003.1j/D10, p. 36 */
+
+int pthread_barrier_wait(pthread_barrier_t *barrier) {
+    int rv;
+
+    assert(barrier);
+
+    if((rv = barrier_wait(barrier)) < 0)
+        return errno;
+
+    return rv == BARRIER_SERIAL_THREAD ? PTHREAD_BARRIER_SERIAL_THREAD : 0;
+}
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <kos/net.h>
 #include <kos/thread.h>
+#include <kos/slab.h>
 #include <arch/timer.h>
 
 #include "net_ipv4.h"
@@ -71,6 +72,9 @@ LIST_HEAD(netarp_list, netarp);
 /* ARP cache */
 struct netarp_list net_arp_cache = LIST_HEAD_INITIALIZER(0);
 
+/* Where ARP entries come from */
+static slab_cache_t *net_arp_slab = NULL;
+
 /**************************************************************************/
 /* Cache management */
 
@@ -93,7 +97,7 @@ static int net_arp_gc(netif_t *nif) {
                     free(a1->data);
                 }
 
-                free(a1);
+                slab_free(net_arp_slab, a1);
                 a1 = a2;
                 continue;
             }
@@ -140,7 +144,9 @@ int net_arp_insert(netif_t *nif, const uint8 mac[6], const uint8 ip[4],
     }
 
     /* It's not there, add an entry */
-    cur = (netarp_t *)malloc(sizeof(netarp_t));
+    if(!(cur = (netarp_t *)slab_alloc(net_arp_slab)))
+        return -1;
+
     memcpy(cur->mac, mac, 6);
     memcpy(cur->ip, ip, 4);
     cur->timestamp = timestamp;
@@ -185,7 +191,9 @@ int net_arp_lookup(netif_t *nif, const uint8 ip_in[4], uint8 mac_out[6],
     }
 
     /* It's not there... Add an incomplete ARP entry */
-    cur = (netarp_t *)malloc(sizeof(netarp_t));
+    if(!(cur = (netarp_t *)slab_alloc(net_arp_slab)))
+        return -1;
+
     memset(cur, 0, sizeof(netarp_t));
     memcpy(cur->ip, ip_in, 4);
     cur->timestamp = timer_ms_gettime64();
@@ -351,6 +359,11 @@ int net_arp_query(netif_t *nif, const uint8 ip[4]) {
 
 /* Init */
 int net_arp_init(void) {
+    if(!net_arp_slab &&
+       !(net_arp_slab = slab_cache_create("net_arp", sizeof(netarp_t), 0,
+                                          NULL)))
+        return -1;
+
     /* Initialize the ARP cache */
     LIST_INIT(&net_arp_cache);
 
@@ -372,7 +385,7 @@ void net_arp_shutdown(void) {
             free(a1->data);
         }
 
-        free(a1);
+        slab_free(net_arp_slab, a1);
         a1 = a2;
     }
 
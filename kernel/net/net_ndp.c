@@ -11,6 +11,7 @@
 #include <netinet/in.h>
 #include <sys/queue.h>
 #include <kos/net.h>
+#include <kos/slab.h>
 #include <arch/timer.h>
 
 #include "net_ipv6.h"
@@ -37,6 +38,9 @@ typedef struct ndp_entry {
 LIST_HEAD(ndp_list, ndp_entry);
 static struct ndp_list ndp_cache = LIST_HEAD_INITIALIZER(0);
 
+/* Where NDP entries come from */
+static slab_cache_t *ndp_slab = NULL;
+
 /* List of states for the ndp entry */
 #define NDP_STATE_INCOMPLETE    0
 #define NDP_STATE_REACHABLE     1
@@ -66,7 +70,7 @@ void net_ndp_gc(void) {
                 free(i->data);
             }
 
-            free(i);
+            slab_free(ndp_slab, i);
         }
 
         i = tmp;
@@ -114,7 +118,7 @@ int net_ndp_insert(netif_t *net, const uint8 mac[6], const struct in6_addr *ip,
     }
 
     /* No entry exists yet, so create one */
-    if(!(i = (ndp_entry_t *)malloc(sizeof(ndp_entry_t)))) {
+    if(!(i = (ndp_entry_t *)slab_alloc(ndp_slab))) {
         return -1;
     }
 
@@ -181,7 +185,7 @@ int net_ndp_lookup(netif_t *net, const struct in6_addr *ip, uint8 mac_out[6],
     }
 
     /* Its not there, add an incomplete entry and solicit the info */
-    if(!(i = (ndp_entry_t *)malloc(sizeof(ndp_entry_t)))) {
+    if(!(i = (ndp_entry_t *)slab_alloc(ndp_slab))) {
         return -1;
     }
 
@@ -218,6 +222,10 @@ int net_ndp_lookup(netif_t *net, const struct in6_addr *ip, uint8 mac_out[6],
 }
 
 int net_ndp_init(void) {
+    if(!ndp_slab &&
+       !(ndp_slab = slab_cache_create("net_ndp", sizeof(ndp_entry_t), 0, NULL)))
+        return -1;
+
     return 0;
 }
 
@@ -235,7 +243,7 @@ void net_ndp_shutdown(void) {
             free(i->data);
         }
 
-        free(i);
+        slab_free(ndp_slab, i);
         i = tmp;
     }
 
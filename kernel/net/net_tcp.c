@@ -17,6 +17,8 @@
 #include <kos/cond.h>
 #include <kos/mutex.h>
 #include <kos/rwsem.h>
+#include <kos/lockprof.h>
+#include <kos/slab.h>
 #include <kos/fs_socket.h>
 
 #include <arch/timer.h>
@@ -181,6 +183,9 @@ static struct tcp_sock_list tcp_socks = LIST_HEAD_INITIALIZER(0);
 static rw_semaphore_t tcp_sem = RWSEM_INITIALIZER;
 static int thd_cb_id = 0;
 
+/* Where socket structures come from */
+static slab_cache_t *tcp_sock_slab = NULL;
+
 /* Default starting window size for connections. This should be big enough as a
    starting point, in general. If you need to adjust it, you can do so... */
 #define TCP_DEFAULT_WINDOW  8192
@@ -259,7 +264,7 @@ static int net_tcp_socket(net_socket_t *hnd, int domain, int type, int proto) {
     (void)type;
     (void)proto;
 
-    if(!(sock = (struct tcp_sock *)malloc(sizeof(struct tcp_sock)))) {
+    if(!(sock = (struct tcp_sock *)slab_alloc(tcp_sock_slab))) {
         errno = ENOMEM;
         return -1;
     }
@@ -268,7 +273,7 @@ static int net_tcp_socket(net_socket_t *hnd, int domain, int type, int proto) {
 
     if(mutex_init(&sock->mutex, MUTEX_TYPE_NORMAL)) {
         errno = ENOMEM;
-        free(sock);
+        slab_free(tcp_sock_slab, sock);
         return -1;
     }
 
@@ -280,7 +285,7 @@ static int net_tcp_socket(net_socket_t *hnd, int domain, int type, int proto) {
 
     if(irq_inside_int()) {
         if(rwsem_write_trylock(&tcp_sem)) {
-            free(sock);
+            slab_free(tcp_sock_slab, sock);
             errno = EWOULDBLOCK;
             return -1;
         }
@@ -428,7 +433,7 @@ ret_remove:
     LIST_REMOVE(sock, sock_list);
     mutex_unlock(&sock->mutex);
     mutex_destroy(&sock->mutex);
-    free(sock);
+    slab_free(tcp_sock_slab, sock);
 
     rwsem_write_unlock(&tcp_sem);
     return;
@@ -529,7 +534,7 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
             LIST_REMOVE(sock, sock_list);
             mutex_unlock(&sock->mutex);
             mutex_destroy(&sock->mutex);
-            free(sock);
+            slab_free(tcp_sock_slab, sock);
 
             rwsem_write_unlock(&tcp_sem);
 
@@ -547,7 +552,7 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
         sock->listen.head = 0;
 
     /* Allocate the memory we will need... */
-    if(!(sock2 = (struct tcp_sock *)malloc(sizeof(struct tcp_sock)))) {
+    if(!(sock2 = (struct tcp_sock *)slab_alloc(tcp_sock_slab))) {
         mutex_unlock(&sock->mutex);
         errno = ENOMEM;
         return -1;
@@ -558,7 +563,7 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
     if(mutex_init(&sock2->mutex, MUTEX_TYPE_NORMAL)) {
         mutex_unlock(&sock->mutex);
         errno = ENOMEM;
-        free(sock2);
+        slab_free(tcp_sock_slab, sock2);
         return -1;
     }
 
@@ -566,7 +571,7 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
         errno = ENOMEM;
         mutex_unlock(&sock->mutex);
         mutex_destroy(&sock2->mutex);
-        free(sock2);
+        slab_free(tcp_sock_slab, sock2);
         return -1;
     }
 
@@ -575,7 +580,7 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
         mutex_unlock(&sock->mutex);
         free(sock2->data.rcvbuf);
         mutex_destroy(&sock2->mutex);
-        free(sock2);
+        slab_free(tcp_sock_slab, sock2);
         return -1;
     }
 
@@ -585,7 +590,7 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
         free(sock2->data.sndbuf);
         free(sock2->data.rcvbuf);
         mutex_destroy(&sock2->mutex);
-        free(sock2);
+        slab_free(tcp_sock_slab, sock2);
         return -1;
     }
 
@@ -596,7 +601,7 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
         free(sock2->data.sndbuf);
         free(sock2->data.rcvbuf);
         mutex_destroy(&sock2->mutex);
-        free(sock2);
+        slab_free(tcp_sock_slab, sock2);
         return -1;
     }
 
@@ -608,7 +613,7 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
         free(sock2->data.sndbuf);
         free(sock2->data.rcvbuf);
         mutex_destroy(&sock2->mutex);
-        free(sock2);
+        slab_free(tcp_sock_slab, sock2);
         return -1;
     }
 
@@ -672,7 +677,7 @@ static int net_tcp_accept(net_socket_t *hnd, struct sockaddr *addr,
             free(sock2->data.sndbuf);
             free(sock2->data.rcvbuf);
             mutex_destroy(&sock2->mutex);
-            free(sock2);
+            slab_free(tcp_sock_slab, sock2);
             errno = EWOULDBLOCK;
             return -1;
         }
@@ -2983,7 +2988,7 @@ static void tcp_thd_cb(void *arg) {
             mutex_destroy(&i->mutex);
             free(i->data.sndbuf);
             free(i->data.rcvbuf);
-            free(i);
+            slab_free(tcp_sock_slab, i);
         }
 
         i = tmp;
@@ -3015,6 +3020,16 @@ static fs_socket_proto_t proto = {
 };
 
 int net_tcp_init(void) {
+    lockprof_set_name(&tcp_sem, "tcp_sem");
+
+    if(!tcp_sock_slab) {
+        tcp_sock_slab = slab_cache_create("tcp_sock", sizeof(struct tcp_sock),
+                                          0, NULL);
+
+        if(!tcp_sock_slab)
+            return -1;
+    }
+
     if((thd_cb_id = net_thd_add_callback(tcp_thd_cb, NULL, 50)) < 0)
         return -1;
 
@@ -3048,7 +3063,7 @@ void net_tcp_shutdown(void) {
             mutex_destroy(&i->mutex);
             free(i->data.sndbuf);
             free(i->data.rcvbuf);
-            free(i);
+            slab_free(tcp_sock_slab, i);
         }
 
         i = tmp;
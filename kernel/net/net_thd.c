@@ -10,6 +10,8 @@
 #include <stdlib.h>
 
 #include <kos/thread.h>
+#include <kos/genwait.h>
+#include <kos/slab.h>
 #include <arch/timer.h>
 #include "net_thd.h"
 
@@ -29,10 +31,12 @@ static struct thd_cb_queue cbs;
 static kthread_t *thd;
 static int done = 0;
 static int cbid_top;
+static slab_cache_t *cb_cache;
 
 static void *net_thd_thd(void *data __attribute__((unused))) {
     struct thd_cb *cb;
-    uint64 now;
+    uint64 now, next;
+    int old;
 
     while(!done) {
         now = timer_ms_gettime64();
@@ -45,8 +49,30 @@ static void *net_thd_thd(void *data __attribute__((unused))) {
             }
         }
 
-        /* Go to sleep til we need to be run again. */
-        thd_sleep(50);
+        /* Figure out when the next callback is due. Do this with interrupts
+           disabled so that we can't miss the wakeup from a callback being
+           added in the meantime. */
+        old = irq_disable();
+        next = 0;
+
+        TAILQ_FOREACH(cb, &cbs, thds) {
+            if(!next || cb->nextrun < next)
+                next = cb->nextrun;
+        }
+
+        /* Go to sleep til we need to be run again (or until someone adds a
+           new callback or kills us). A timeout of 0 means to sleep until we're
+           woken up explicitly. */
+        if(!done) {
+            now = timer_ms_gettime64();
+
+            if(!next)
+                genwait_wait(&cbs, "net_thd_sleep", 0, NULL);
+            else if(next > now)
+                genwait_wait(&cbs, "net_thd_sleep", (int)(next - now), NULL);
+        }
+
+        irq_restore(old);
     }
 
     return NULL;
@@ -57,7 +83,7 @@ int net_thd_add_callback(void (*cb)(void *), void *data, uint64 timeout) {
     struct thd_cb *newcb;
 
     /* Allocate space for the new callback and set it up. */
-    newcb = (struct thd_cb *)malloc(sizeof(struct thd_cb));
+    newcb = (struct thd_cb *)slab_alloc(cb_cache);
 
     if(!newcb) {
         errno = ENOMEM;
@@ -73,6 +99,7 @@ int net_thd_add_callback(void (*cb)(void *), void *data, uint64 timeout) {
     /* Disable interrupts, insert, and reenable interrupts */
     old = irq_disable();
     TAILQ_INSERT_TAIL(&cbs, newcb, thds);
+    genwait_wake_all(&cbs);
     irq_restore(old);
 
     return newcb->cbid;
@@ -90,7 +117,7 @@ int net_thd_del_callback(int cbid) {
     TAILQ_FOREACH(cb, &cbs, thds) {
         if(cb->cbid == cbid) {
             TAILQ_REMOVE(&cbs, cb, thds);
-            free(cb);
+            slab_free(cb_cache, cb);
             irq_restore(old);
             return 0;
         }
@@ -108,6 +135,7 @@ int net_thd_is_current(void) {
 void net_thd_kill(void) {
     /* Do things gracefully, if we can... Otherwise, punt. */
     done = 1;
+    genwait_wake_all(&cbs);
 
     if(!irq_inside_int()) {
         thd_join(thd, NULL);
@@ -120,6 +148,11 @@ void net_thd_kill(void) {
 }
 
 int net_thd_init(void) {
+    if(!cb_cache &&
+       !(cb_cache = slab_cache_create("net_thd_cb", sizeof(struct thd_cb), 0,
+                                      NULL)))
+        return -1;
+
     TAILQ_INIT(&cbs);
     done = 0;
     cbid_top = 1;
@@ -142,7 +175,7 @@ void net_thd_shutdown(void) {
 
     while(c) {
         n = TAILQ_NEXT(c, thds);
-        free(c);
+        slab_free(cb_cache, c);
         c = n;
     }
 
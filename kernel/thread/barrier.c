@@ -0,0 +1,177 @@
+/* KallistiOS ##version##
+
+   barrier.c
+   Copyright (C) 2026 The KallistiOS Team
+*/
+
+/* Defines thread barriers and countdown latches. Both sleep directly on the
+   object with genwait, so releasing everyone is a single genwait_wake_all(). */
+
+#include <errno.h>
+
+#include <kos/barrier.h>
+#include <kos/genwait.h>
+#include <kos/dbglog.h>
+#include <arch/irq.h>
+
+int barrier_init(barrier_t *b, unsigned int count) {
+    if(!count) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    b->initialized = 1;
+    b->count = count;
+    b->waiting = 0;
+    b->generation = 0;
+
+    return 0;
+}
+
+int barrier_destroy(barrier_t *b) {
+    int rv = 0, old;
+
+    old = irq_disable();
+
+    if(b->waiting) {
+        errno = EBUSY;
+        rv = -1;
+    }
+    else {
+        b->initialized = 0;
+    }
+
+    irq_restore(old);
+    return rv;
+}
+
+int barrier_wait(barrier_t *b) {
+    unsigned int gen;
+    int old, rv = 0;
+
+    if(irq_inside_int()) {
+        dbglog(DBG_WARNING, "barrier_wait: called inside interrupt\n");
+        errno = EPERM;
+        return -1;
+    }
+
+    old = irq_disable();
+
+    if(b->initialized != 1) {
+        irq_restore(old);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(++b->waiting == b->count) {
+        /* Last one in: reset for the next round and let everyone go. */
+        b->waiting = 0;
+        ++b->generation;
+        genwait_wake_all(b);
+        rv = BARRIER_SERIAL_THREAD;
+    }
+    else {
+        gen = b->generation;
+
+        while(gen == b->generation)
+            genwait_wait(b, "barrier_wait", 0, NULL);
+    }
+
+    irq_restore(old);
+    return rv;
+}
+
+int latch_init(latch_t *l, unsigned int count) {
+    l->initialized = 1;
+    l->count = count;
+    l->waiting = 0;
+
+    return 0;
+}
+
+int latch_destroy(latch_t *l) {
+    int rv = 0, old;
+
+    old = irq_disable();
+
+    if(l->waiting) {
+        errno = EBUSY;
+        rv = -1;
+    }
+    else {
+        l->initialized = 0;
+    }
+
+    irq_restore(old);
+    return rv;
+}
+
+int latch_count_down(latch_t *l) {
+    int old;
+
+    old = irq_disable();
+
+    if(l->initialized != 1) {
+        irq_restore(old);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(l->count && !--l->count)
+        genwait_wake_all(l);
+
+    irq_restore(old);
+    return 0;
+}
+
+int latch_wait_timed(latch_t *l, int timeout) {
+    int old, rv = 0;
+
+    if(irq_inside_int()) {
+        dbglog(DBG_WARNING, "latch_wait: called inside interrupt\n");
+        errno = EPERM;
+        return -1;
+    }
+
+    if(timeout < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    old = irq_disable();
+
+    if(l->initialized != 1) {
+        irq_restore(old);
+        errno = EINVAL;
+        return -1;
+    }
+
+    ++l->waiting;
+
+    while(l->count) {
+        if(genwait_wait(l, timeout ? "latch_wait_timed" : "latch_wait",
+                        timeout, NULL) < 0) {
+            errno = ETIMEDOUT;
+            rv = -1;
+            break;
+        }
+    }
+
+    --l->waiting;
+
+    irq_restore(old);
+    return rv;
+}
+
+int latch_wait(latch_t *l) {
+    return latch_wait_timed(l, 0);
+}
+
+int latch_try_wait(latch_t *l) {
+    if(l->count) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return 0;
+}
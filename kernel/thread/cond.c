@@ -17,6 +17,7 @@
 #include <kos/limits.h>
 #include <kos/cond.h>
 #include <kos/genwait.h>
+#include <kos/lockprof.h>
 
 #include <kos/dbglog.h>
 
@@ -37,6 +38,8 @@ condvar_t *cond_create() {
 
     cv->initialized = 1;
     cv->dynamic = 1;
+    cv->mutex = NULL;
+    cv->waiters = 0;
 
     return cv;
 }
@@ -44,6 +47,8 @@ condvar_t *cond_create() {
 int cond_init(condvar_t *cv) {
     cv->initialized = 1;
     cv->dynamic = 0;
+    cv->mutex = NULL;
+    cv->waiters = 0;
     return 0;
 }
 
@@ -63,6 +68,7 @@ int cond_destroy(condvar_t *cv) {
 
 int cond_wait_timed(condvar_t *cv, mutex_t *m, int timeout) {
     int old, rv;
+    LOCKPROF_DECL(start);
 
     if(irq_inside_int()) {
         dbglog(DBG_WARNING, "cond_wait: called inside interrupt\n");
@@ -77,24 +83,38 @@ int cond_wait_timed(condvar_t *cv, mutex_t *m, int timeout) {
         irq_restore(old);
         return -1;
     }
-    else if(m->type < MUTEX_TYPE_NORMAL || m->type > MUTEX_TYPE_RECURSIVE ||
+    else if(m->type < MUTEX_TYPE_NORMAL || m->type > MUTEX_TYPE_PI ||
             !mutex_is_locked(m)) {
         errno = EINVAL;
         irq_restore(old);
         return -1;
     }
 
+    /* Remember which mutex goes with the condvar, so that signalling it can
+       move waiters straight over to the mutex. If the waiters don't agree on
+       the mutex, don't try to be clever until they've all gone. */
+    if(!cv->waiters++)
+        cv->mutex = m;
+    else if(cv->mutex != m)
+        cv->mutex = NULL;
+
     /* First of all, release the associated mutex */
     mutex_unlock(m);
 
     /* Now block us until we're signaled */
+    LOCKPROF_START(start);
     rv = genwait_wait(cv, timeout ? "cond_wait_timed" : "cond_wait", timeout,
                       NULL);
+    LOCKPROF_RECORD(cv, LOCKPROF_CONDVAR, start, 1);
 
     if(rv < 0 && errno == EAGAIN)
         errno = ETIMEDOUT;
 
-    /* Re-lock our mutex */
+    --cv->waiters;
+
+    /* Re-lock our mutex. If we were moved over to the mutex's wait queue, we
+       were woken by it being unlocked, so this shouldn't block unless someone
+       else got in first. */
     mutex_lock(m);
 
     /* Ok, ready to return */
@@ -107,8 +127,24 @@ int cond_wait(condvar_t *cv, mutex_t *m) {
     return cond_wait_timed(cv, m, 0);
 }
 
+/* Can we move waiters straight to the condvar's mutex rather than waking them?
+   This is only done for the simple mutex types, where unlocking wakes up one
+   waiter to try for the lock again. Assumes interrupts are disabled. */
+static mutex_t *cond_morph_mutex(condvar_t *cv) {
+    mutex_t *m = cv->mutex;
+
+    if(!m || !cv->waiters)
+        return NULL;
+
+    if(m->type != MUTEX_TYPE_NORMAL && m->type != MUTEX_TYPE_ERRORCHECK)
+        return NULL;
+
+    return m;
+}
+
 int cond_signal(condvar_t *cv) {
     int old, rv = 0;
+    mutex_t *m;
 
     old = irq_disable();
 
@@ -116,6 +152,11 @@ int cond_signal(condvar_t *cv) {
         errno = EINVAL;
         rv = -1;
     }
+    /* If the mutex is held, the waiter would only block on it as soon as it
+       woke up, so just move it over to the mutex's wait queue instead. */
+    else if((m = cond_morph_mutex(cv)) && mutex_is_locked(m)) {
+        genwait_requeue(cv, m, 1);
+    }
     else {
         /* Wake one thread who's waiting */
         genwait_wake_one(cv);
@@ -128,6 +169,7 @@ int cond_signal(condvar_t *cv) {
 
 int cond_broadcast(condvar_t *cv) {
     int old, rv = 0;
+    mutex_t *m;
 
     old = irq_disable();
 
@@ -135,6 +177,16 @@ int cond_broadcast(condvar_t *cv) {
         errno = EINVAL;
         rv = -1;
     }
+    else if((m = cond_morph_mutex(cv))) {
+        /* Only one of the waiters can get the mutex at a time, so rather than
+           having them all wake up and fight over it, wake one (only if the
+           mutex is free) and line the rest up on the mutex. Each unlock will
+           then wake the next one. */
+        if(!mutex_is_locked(m))
+            genwait_wake_one(cv);
+
+        genwait_requeue(cv, m, -1);
+    }
     else {
         /* Wake all threads who are waiting */
         genwait_wake_all(cv);
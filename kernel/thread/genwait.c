@@ -31,40 +31,138 @@
 static TAILQ_HEAD(slpquehead, kthread) slpque[TABLESIZE];
 #define LOOKUP(x)   (((ptr_t)(x) >> 8) & (TABLESIZE - 1))
 
+/* Sleep queues for threads in genwait_wait_multi(). Such a thread has one node
+   on these queues for each object it is sleeping on (all of which live on its
+   stack), and isn't on the normal sleep queues at all. Keeping these separate
+   means the normal single object case doesn't have to pay for any of this. */
+struct genwait_node {
+    TAILQ_ENTRY(genwait_node) q;
+    void *obj;
+    kthread_t *thd;
+    int idx;
+};
+
+struct genwait_multi {
+    int cnt;
+    struct genwait_node nodes[GENWAIT_MULTI_MAX];
+};
+
+static TAILQ_HEAD(multiquehead, genwait_node) multique[TABLESIZE];
+
 /* Timed event queue. Anything that isn't ready to run yet, but will be
    ready to run at a later time will be placed here. Note that this doesn't
    deal with pre-emptive timeslice context switching, only things that are
    specifically blocked for a timed event (thd_sleep, genwait_wait, etc).
-   This queue is sorted by remaining time (smallest at the front). */
-static struct ktqueue timer_queue;
 
-/* Internal function to insert a thread on the timer queue. Maintains
-   sorting order by wait time. */
-static void tq_insert(kthread_t * thd) {
-    kthread_t * t;
+   This is a pairing heap ordered by wakeup time (smallest at the root), linked
+   through the timerq fields of each thread so that no allocation is ever
+   needed. Inserting is constant time, peeking at the next event is constant
+   time, and removing any thread (timed out or woken early) is O(log n)
+   amortized. A sorted list would make every timed wait pay O(n), which hurts
+   once there are a few hundred sockets and condvars with timeouts. */
+static kthread_t *timer_queue;
+
+/* Internal function to meld two heaps together, returning the new root. Both
+   arguments must be roots (no parent and no siblings). */
+static kthread_t *tq_meld(kthread_t *a, kthread_t *b) {
+    kthread_t *t;
+
+    if(!a)
+        return b;
+    else if(!b)
+        return a;
+
+    /* Keep the earlier timeout on top. */
+    if(b->wait_timeout < a->wait_timeout) {
+        t = a;
+        a = b;
+        b = t;
+    }
 
-    /* Search for its place; note that new threads will be placed at
-       the end of a group with the same timeout. */
-    TAILQ_FOREACH(t, &timer_queue, timerq) {
-        if(thd->wait_timeout < t->wait_timeout) {
-            TAILQ_INSERT_BEFORE(t, thd, timerq);
-            return;
+    /* Make b the first child of a. */
+    b->timerq.next = a->timerq.child;
+
+    if(a->timerq.child)
+        a->timerq.child->timerq.prev = b;
+
+    b->timerq.prev = a;
+    a->timerq.child = b;
+
+    return a;
+}
+
+/* Internal function to combine a list of siblings into one heap (the standard
+   two-pass pairing heap merge), returning the new root. */
+static kthread_t *tq_merge_pairs(kthread_t *first) {
+    kthread_t *a, *b, *next, *list = NULL;
+
+    /* First pass: meld siblings pairwise from left to right, pushing each
+       result onto a list (which ends up reversed). */
+    while(first) {
+        a = first;
+        b = a->timerq.next;
+        next = b ? b->timerq.next : NULL;
+
+        a->timerq.next = a->timerq.prev = NULL;
+
+        if(b) {
+            b->timerq.next = b->timerq.prev = NULL;
+            a = tq_meld(a, b);
         }
+
+        a->timerq.next = list;
+        list = a;
+        first = next;
+    }
+
+    /* Second pass: meld everything together from right to left. */
+    a = NULL;
+
+    while(list) {
+        next = list->timerq.next;
+        list->timerq.next = NULL;
+        a = tq_meld(a, list);
+        list = next;
     }
 
-    /* Couldn't find anything scheduled later, put this at the end. */
-    TAILQ_INSERT_TAIL(&timer_queue, thd, timerq);
+    return a;
+}
+
+/* Internal function to insert a thread on the timer queue. */
+static void tq_insert(kthread_t * thd) {
+    thd->timerq.child = thd->timerq.next = thd->timerq.prev = NULL;
+    timer_queue = tq_meld(timer_queue, thd);
 }
 
 /* Internal function to remove a thread from the timer queue. */
 static void tq_remove(kthread_t * thd) {
-    TAILQ_REMOVE(&timer_queue, thd, timerq);
+    kthread_t *sub;
+
+    if(thd == timer_queue) {
+        timer_queue = tq_merge_pairs(thd->timerq.child);
+    }
+    else {
+        /* Cut it (and its subtree) out of its sibling list... */
+        if(thd->timerq.prev->timerq.child == thd)
+            thd->timerq.prev->timerq.child = thd->timerq.next;
+        else
+            thd->timerq.prev->timerq.next = thd->timerq.next;
+
+        if(thd->timerq.next)
+            thd->timerq.next->timerq.prev = thd->timerq.prev;
+
+        /* ...and put its children back into the heap. */
+        sub = tq_merge_pairs(thd->timerq.child);
+        timer_queue = tq_meld(timer_queue, sub);
+    }
+
+    thd->timerq.child = thd->timerq.next = thd->timerq.prev = NULL;
 }
 
 /* Returns the top thread on the timer queue (next event). If nothing is
    queued, we'll return NULL. */
 static kthread_t * tq_next() {
-    return TAILQ_FIRST(&timer_queue);
+    return timer_queue;
 }
 
 int genwait_wait(void * obj, const char * mesg, int timeout, void (*callback)(void *)) {
@@ -107,16 +205,89 @@ int genwait_wait(void * obj, const char * mesg, int timeout, void (*callback)(vo
     return rv;
 }
 
+int genwait_wait_multi(void **objs, int cnt, const char *mesg, int timeout) {
+    struct genwait_multi multi;
+    struct genwait_node *n;
+    kthread_t *me;
+    int old, rv, i;
+
+    if(irq_inside_int()) {
+        dbglog(DBG_WARNING, "genwait_wait_multi: called inside interrupt\n");
+        errno = EPERM;
+        return -1;
+    }
+
+    if(cnt < 1 || cnt > GENWAIT_MULTI_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    old = irq_disable();
+
+    /* Prepare us for sleep */
+    me = thd_current;
+    thd_current = NULL;
+    me->state = STATE_WAIT;
+    me->wait_obj = &multi;
+    me->wait_msg = mesg;
+    me->wait_multi = &multi;
+    me->wait_callback = NULL;
+
+    if(timeout > 0) {
+        me->wait_timeout = timer_ms_gettime64() + timeout;
+        tq_insert(me);
+    }
+    else
+        me->wait_timeout = 0;
+
+    /* Insert us on the queue for each object */
+    multi.cnt = cnt;
+
+    for(i = 0; i < cnt; ++i) {
+        n = &multi.nodes[i];
+        n->obj = objs[i];
+        n->thd = me;
+        n->idx = i;
+        TAILQ_INSERT_TAIL(&multique[LOOKUP(objs[i])], n, q);
+    }
+
+    /* Block us until we're signaled. Whoever wakes us up sets the return
+       value to the index of the object we were woken on. */
+    rv = thd_block_now(&me->context);
+
+    irq_restore(old);
+
+    return rv;
+}
+
 /* Removes a thread from its wait queue; assumes ints are disabled. */
 static void genwait_unqueue(kthread_t * thd) {
+    struct genwait_multi *multi;
+    uint64 now;
+    int i;
+
     if(thd->wait_obj) {
-        /* Remove it from the queue */
-        TAILQ_REMOVE(&slpque[LOOKUP(thd->wait_obj)], thd, thdq);
+        /* Remove it from the queue (or queues) */
+        if((multi = thd->wait_multi)) {
+            for(i = 0; i < multi->cnt; ++i)
+                TAILQ_REMOVE(&multique[LOOKUP(multi->nodes[i].obj)],
+                             &multi->nodes[i], q);
+
+            thd->wait_multi = NULL;
+        }
+        else {
+            TAILQ_REMOVE(&slpque[LOOKUP(thd->wait_obj)], thd, thdq);
+        }
 
         /* Also remove it from the timer queue if applicable */
         if(thd->wait_timeout)
             tq_remove(thd);
 
+        /* Charge the thread with the time it spent asleep */
+        now = timer_us_gettime64();
+        thd->stats.wait_time += now - thd->stats_stamp;
+        thd->stats_stamp = now;
+
         /* Clean up wait stuff */
         thd->wait_obj = NULL;
         thd->wait_msg = NULL;
@@ -129,6 +300,45 @@ static void genwait_unqueue(kthread_t * thd) {
     }
 }
 
+/* Wakes up threads in genwait_wait_multi() that are sleeping on the given
+   object, until the count reaches cntmax. Returns the new count. Assumes ints
+   are disabled. */
+static int genwait_wake_multi(void *obj, int cnt, int cntmax, int err) {
+    struct multiquehead *qp = &multique[LOOKUP(obj)];
+    struct genwait_node *n;
+    kthread_t *t;
+
+    if(cntmax > 0 && cnt >= cntmax)
+        return cnt;
+
+again:
+    TAILQ_FOREACH(n, qp, q) {
+        if(n->obj != obj)
+            continue;
+
+        t = n->thd;
+
+        if(err) {
+            CONTEXT_RET(t->context) = -1;
+            t->thd_errno = err;
+        }
+        else {
+            CONTEXT_RET(t->context) = n->idx;
+        }
+
+        /* This takes all of the thread's nodes off of the queues, which might
+           include the next one on this queue, so start over afterwards. */
+        genwait_unqueue(t);
+
+        if(++cnt >= cntmax && cntmax > 0)
+            break;
+
+        goto again;
+    }
+
+    return cnt;
+}
+
 int genwait_wake_cnt(void * obj, int cntmax, int err) {
     kthread_t       * t, * nt;
     struct slpquehead   * qp;
@@ -159,16 +369,15 @@ int genwait_wake_cnt(void * obj, int cntmax, int err) {
                 CONTEXT_RET(t->context) = 0;
             }
 
-            /* Check to see if we've filled our quota */
-            if(cntmax > 0) {
-                cnt++;
-
-                if(cnt >= cntmax)
-                    break;
-            }
+            /* Count it, and check to see if we've filled our quota */
+            if(++cnt >= cntmax && cntmax > 0)
+                break;
         }
     }
 
+    /* Then take care of anyone sleeping on more than one object. */
+    cnt = genwait_wake_multi(obj, cnt, cntmax, err);
+
     /* Re-fix IRQs */
     irq_restore(old);
 
@@ -194,11 +403,33 @@ void genwait_wake_all_err(void *obj, int err) {
 int genwait_wake_thd(void *obj, kthread_t *thd, int err) {
     kthread_t *t, *nt;
     struct slpquehead *qp;
-    int old, rv = 0;
+    int old, rv = 0, i;
 
     /* Twiddle interrupt state */
     old = irq_disable();
 
+    /* Is the thread sleeping on more than one object? */
+    if(thd->wait_multi && thd->state == STATE_WAIT) {
+        for(i = 0; i < thd->wait_multi->cnt; ++i) {
+            if(thd->wait_multi->nodes[i].obj == obj) {
+                if(err) {
+                    CONTEXT_RET(thd->context) = -1;
+                    thd->thd_errno = err;
+                }
+                else {
+                    CONTEXT_RET(thd->context) = i;
+                }
+
+                genwait_unqueue(thd);
+                rv = 1;
+                break;
+            }
+        }
+
+        irq_restore(old);
+        return rv;
+    }
+
     /* Find the queue */
     qp = &slpque[LOOKUP(obj)];
 
@@ -233,6 +464,62 @@ int genwait_wake_thd(void *obj, kthread_t *thd, int err) {
     return rv;
 }
 
+kthread_t *genwait_top_waiter(void *obj) {
+    kthread_t *t, *rv = NULL;
+    int old;
+
+    old = irq_disable();
+
+    /* Look for the highest priority thread waiting on this object. If there's
+       a tie, the one that's been waiting the longest wins. */
+    TAILQ_FOREACH(t, &slpque[LOOKUP(obj)], thdq) {
+        if(t->wait_obj == obj && (!rv || t->prio < rv->prio))
+            rv = t;
+    }
+
+    irq_restore(old);
+    return rv;
+}
+
+int genwait_requeue(void *obj, void *new_obj, int cntmax) {
+    kthread_t *t, *nt;
+    struct slpquehead *qp, *nqp;
+    int cnt = 0, old;
+
+    old = irq_disable();
+
+    qp = &slpque[LOOKUP(obj)];
+    nqp = &slpque[LOOKUP(new_obj)];
+
+    for(t = TAILQ_FIRST(qp); t != NULL; t = nt) {
+        nt = TAILQ_NEXT(t, thdq);
+
+        if(t->wait_obj != obj)
+            continue;
+
+        /* Move it over to the new object's queue... */
+        TAILQ_REMOVE(qp, t, thdq);
+        TAILQ_INSERT_TAIL(nqp, t, thdq);
+        t->wait_obj = new_obj;
+
+        /* ...and forget about any timeout it had. */
+        if(t->wait_timeout) {
+            tq_remove(t);
+            t->wait_timeout = 0;
+        }
+
+        if(++cnt == cntmax)
+            break;
+    }
+
+    /* Threads sleeping on more than one object can't be moved, since they're
+       not just sleeping on the new object, so wake them instead. */
+    cnt = genwait_wake_multi(obj, cnt, cntmax, 0);
+
+    irq_restore(old);
+    return cnt;
+}
+
 void genwait_check_timeouts(uint64 tm) {
     kthread_t   *t;
 
@@ -274,10 +561,12 @@ uint64 genwait_next_timeout() {
 int genwait_init() {
     int i;
 
-    for(i = 0; i < TABLESIZE; i++)
+    for(i = 0; i < TABLESIZE; i++) {
         TAILQ_INIT(&slpque[i]);
+        TAILQ_INIT(&multique[i]);
+    }
 
-    TAILQ_INIT(&timer_queue);
+    timer_queue = NULL;
     return 0;
 }
 
@@ -0,0 +1,214 @@
+/* KallistiOS ##version##
+
+   lockprof.c
+   Copyright (C) 2026 The KallistiOS Team
+*/
+
+/* Lock contention profiling. The actual measurements are taken in the various
+   lock implementations (mutex.c, sem.c, rwsem.c, and cond.c); this just keeps
+   track of them. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include <kos/lockprof.h>
+#include <arch/irq.h>
+
+#ifdef KOS_LOCK_PROFILE
+
+/* Per-lock statistics, in an open-addressed hash table keyed by the address
+   of the lock. Entries are never removed (except by lockprof_reset()), so a
+   lookup can stop at the first empty slot. */
+static lockprof_stats_t lp_table[LOCKPROF_MAX_LOCKS];
+static int lp_used = 0;
+static uint32 lp_dropped = 0;
+
+static inline int lp_hash(const void *lock) {
+    return (int)((((uint32)lock >> 2) * 2654435761UL) % LOCKPROF_MAX_LOCKS);
+}
+
+/* Find the entry for a lock, creating it if need be. Interrupts must be
+   disabled. Returns NULL if the table is full. */
+static lockprof_stats_t *lp_lookup(const void *lock, int type) {
+    int i, idx = lp_hash(lock);
+    lockprof_stats_t *e;
+
+    for(i = 0; i < LOCKPROF_MAX_LOCKS; ++i) {
+        e = &lp_table[idx];
+
+        if(e->lock == lock) {
+            /* Entries created by lockprof_set_name() don't know their type
+               until the lock is actually used. */
+            if(e->type < 0)
+                e->type = type;
+
+            return e;
+        }
+
+        if(!e->lock) {
+            /* Don't let the table fill up completely, so lookups of locks that
+               aren't in it always terminate quickly. */
+            if(lp_used >= LOCKPROF_MAX_LOCKS * 7 / 8)
+                return NULL;
+
+            e->lock = lock;
+            e->type = type;
+            ++lp_used;
+            return e;
+        }
+
+        if(++idx == LOCKPROF_MAX_LOCKS)
+            idx = 0;
+    }
+
+    return NULL;
+}
+
+void lockprof_record(const void *lock, int type, uint64 start, int acquired) {
+    lockprof_stats_t *e;
+    uint64 wait;
+    int old = irq_disable();
+
+    if(!(e = lp_lookup(lock, type))) {
+        ++lp_dropped;
+        irq_restore(old);
+        return;
+    }
+
+    if(acquired)
+        ++e->acquired;
+
+    if(start) {
+        wait = timer_us_gettime64() - start;
+        ++e->contended;
+        e->wait_total += wait;
+
+        if(wait > e->wait_max)
+            e->wait_max = wait;
+    }
+
+    irq_restore(old);
+}
+
+void lockprof_set_name(const void *lock, const char *name) {
+    lockprof_stats_t *e;
+    int old = irq_disable();
+
+    if((e = lp_lookup(lock, -1)))
+        e->name = name;
+
+    irq_restore(old);
+}
+
+static int lp_compare(const void *a, const void *b) {
+    const lockprof_stats_t *l = (const lockprof_stats_t *)a;
+    const lockprof_stats_t *r = (const lockprof_stats_t *)b;
+
+    if(l->wait_total > r->wait_total)
+        return -1;
+    else if(l->wait_total < r->wait_total)
+        return 1;
+
+    return (int)r->contended - (int)l->contended;
+}
+
+/* Take a sorted snapshot of the table. The caller must free the result. */
+static lockprof_stats_t *lp_snapshot(int *count) {
+    lockprof_stats_t *rv;
+    int i, n = 0, old;
+
+    if(!(rv = (lockprof_stats_t *)malloc(sizeof(lp_table))))
+        return NULL;
+
+    old = irq_disable();
+
+    for(i = 0; i < LOCKPROF_MAX_LOCKS; ++i) {
+        if(lp_table[i].lock)
+            rv[n++] = lp_table[i];
+    }
+
+    irq_restore(old);
+
+    qsort(rv, n, sizeof(lockprof_stats_t), lp_compare);
+    *count = n;
+    return rv;
+}
+
+int lockprof_get(lockprof_stats_t *stats, int count) {
+    lockprof_stats_t *snap;
+    int n;
+
+    if(!(snap = lp_snapshot(&n)))
+        return 0;
+
+    if(count > n)
+        count = n;
+
+    memcpy(stats, snap, count * sizeof(lockprof_stats_t));
+    free(snap);
+
+    return count;
+}
+
+int lockprof_dump(int (*pf)(const char *fmt, ...)) {
+    static const char *types[] = { "mutex", "sem", "rwsem", "cond" };
+    lockprof_stats_t *snap, *e;
+    int i, n;
+
+    if(!(snap = lp_snapshot(&n)))
+        return -1;
+
+    pf("LOCK       TYPE   ACQUIRED  CONTENDED  WAIT_TOTAL(us)  WAIT_MAX(us)"
+       "  NAME\n");
+
+    for(i = 0; i < n; ++i) {
+        e = &snap[i];
+        pf("%08lx   %-5s  %8lu  %9lu  %14llu  %12llu  %s\n",
+           (uint32)e->lock,
+           e->type >= 0 && e->type <= LOCKPROF_CONDVAR ? types[e->type] : "?",
+           e->acquired, e->contended, e->wait_total, e->wait_max,
+           e->name ? e->name : "");
+    }
+
+    if(lp_dropped)
+        pf("-- %lu events dropped (table full)\n", lp_dropped);
+
+    pf("--end of list--\n");
+    free(snap);
+
+    return 0;
+}
+
+void lockprof_reset(void) {
+    int old = irq_disable();
+
+    memset(lp_table, 0, sizeof(lp_table));
+    lp_used = 0;
+    lp_dropped = 0;
+
+    irq_restore(old);
+}
+
+#else /* !KOS_LOCK_PROFILE */
+
+void lockprof_set_name(const void *lock, const char *name) {
+    (void)lock;
+    (void)name;
+}
+
+int lockprof_get(lockprof_stats_t *stats, int count) {
+    (void)stats;
+    (void)count;
+    return 0;
+}
+
+int lockprof_dump(int (*pf)(const char *fmt, ...)) {
+    pf("lock profiling not enabled (see KOS_LOCK_PROFILE in kos/opts.h)\n");
+    return 0;
+}
+
+void lockprof_reset(void) {
+}
+
+#endif /* KOS_LOCK_PROFILE */
@@ -11,10 +11,86 @@
 
 #include <kos/mutex.h>
 #include <kos/genwait.h>
+#include <kos/lockprof.h>
 #include <kos/dbglog.h>
 
 #include <arch/irq.h>
 
+/* Maximum length of a chain of priority inheritance mutexes that we'll follow
+   when adjusting priorities. This keeps a deadlock (or a really convoluted
+   locking scheme) from keeping us busy in here with interrupts disabled. */
+#define PI_MAX_DEPTH    16
+
+/* Change the priority the scheduler sees for a thread, moving it within the
+   run queue if need be. Assumes interrupts are disabled. */
+static void mutex_pi_set_prio(kthread_t *thd, prio_t prio) {
+    if(thd->flags & THD_QUEUED) {
+        thd_remove_from_runnable(thd);
+        thd->prio = prio;
+        thd_add_to_runnable(thd, 0);
+    }
+    else {
+        thd->prio = prio;
+    }
+}
+
+/* Figure out what priority a thread should be running at. That's its own
+   priority, unless a higher priority thread is waiting on a priority
+   inheritance mutex that it holds. Assumes interrupts are disabled. */
+static prio_t mutex_pi_prio(kthread_t *thd) {
+    prio_t prio = thd->real_prio;
+    mutex_t *m;
+    kthread_t *w;
+
+    LIST_FOREACH(m, &thd->pi_held, pi_list) {
+        if((w = genwait_top_waiter(m)) && w->prio < prio)
+            prio = w->prio;
+    }
+
+    return prio;
+}
+
+void mutex_pi_update(kthread_t *thd) {
+    int old, depth;
+    prio_t prio;
+
+    old = irq_disable();
+
+    for(depth = 0; depth < PI_MAX_DEPTH; ++depth) {
+        if(!thd || thd == (kthread_t *)0xFFFFFFFF)
+            break;
+
+        if((prio = mutex_pi_prio(thd)) == thd->prio)
+            break;
+
+        mutex_pi_set_prio(thd, prio);
+
+        /* If this thread is waiting on a priority inheritance mutex itself,
+           then the holder of that one may need to change as well. */
+        thd = thd->pi_wait ? thd->pi_wait->holder : NULL;
+    }
+
+    irq_restore(old);
+}
+
+/* Boost the holder of a priority inheritance mutex to (at least) the given
+   priority, following the chain of mutexes if the holder is blocked on
+   another one. Assumes interrupts are disabled. */
+static void mutex_pi_boost(mutex_t *m, prio_t prio) {
+    kthread_t *thd;
+    int depth;
+
+    for(depth = 0; m && depth < PI_MAX_DEPTH; ++depth) {
+        thd = m->holder;
+
+        if(!thd || thd == (kthread_t *)0xFFFFFFFF || thd->prio <= prio)
+            break;
+
+        mutex_pi_set_prio(thd, prio);
+        m = thd->pi_wait;
+    }
+}
+
 mutex_t *mutex_create() {
     mutex_t *rv;
 
@@ -36,7 +112,7 @@ mutex_t *mutex_create() {
 
 int mutex_init(mutex_t *m, int mtype) {
     /* Check the type */
-    if(mtype < MUTEX_TYPE_NORMAL || mtype > MUTEX_TYPE_RECURSIVE) {
+    if(mtype < MUTEX_TYPE_NORMAL || mtype > MUTEX_TYPE_PI) {
         errno = EINVAL;
         return -1;
     }
@@ -55,7 +131,7 @@ int mutex_destroy(mutex_t *m) {
 
     old = irq_disable();
 
-    if(m->type < MUTEX_TYPE_NORMAL || m->type > MUTEX_TYPE_RECURSIVE) {
+    if(m->type < MUTEX_TYPE_NORMAL || m->type > MUTEX_TYPE_PI) {
         errno = EINVAL;
         rv = -1;
     }
@@ -84,6 +160,7 @@ int mutex_lock(mutex_t *m) {
 
 int mutex_lock_timed(mutex_t *m, int timeout) {
     int old, rv = 0;
+    LOCKPROF_DECL(start);
 
     if(irq_inside_int()) {
         dbglog(DBG_WARNING, "%s: called inside interrupt\n",
@@ -99,13 +176,18 @@ int mutex_lock_timed(mutex_t *m, int timeout) {
 
     old = irq_disable();
 
-    if(m->type < MUTEX_TYPE_NORMAL || m->type > MUTEX_TYPE_RECURSIVE) {
+    if(m->type < MUTEX_TYPE_NORMAL || m->type > MUTEX_TYPE_PI) {
         errno = EINVAL;
         rv = -1;
     }
     else if(!m->count) {
         m->count = 1;
         m->holder = thd_current;
+
+        if(m->type == MUTEX_TYPE_PI)
+            LIST_INSERT_HEAD(&thd_current->pi_held, m, pi_list);
+
+        LOCKPROF_RECORD(m, LOCKPROF_MUTEX, 0, 1);
     }
     else if(m->type == MUTEX_TYPE_RECURSIVE && m->holder == thd_current) {
         if(m->count == INT_MAX) {
@@ -114,15 +196,42 @@ int mutex_lock_timed(mutex_t *m, int timeout) {
         }
         else {
             ++m->count;
+            LOCKPROF_RECORD(m, LOCKPROF_MUTEX, 0, 1);
         }
     }
-    else if(m->type == MUTEX_TYPE_ERRORCHECK && m->holder == thd_current) {
+    else if((m->type == MUTEX_TYPE_ERRORCHECK || m->type == MUTEX_TYPE_PI) &&
+            m->holder == thd_current) {
         errno = EDEADLK;
         rv = -1;
     }
+    else if(m->type == MUTEX_TYPE_PI) {
+        /* Lend our priority to the holder (and anyone it's waiting on) while
+           we wait. When the lock is released, it'll be handed to us directly,
+           so there's nothing to do on wakeup. */
+        thd_current->pi_wait = m;
+        mutex_pi_boost(m, thd_current->prio);
+
+        LOCKPROF_START(start);
+        rv = genwait_wait(m, timeout ? "mutex_lock_timed" : "mutex_lock",
+                          timeout, NULL);
+        LOCKPROF_RECORD(m, LOCKPROF_MUTEX, start, !rv);
+        thd_current->pi_wait = NULL;
+
+        if(rv) {
+            /* We're not waiting anymore, so the holder shouldn't keep any
+               boost it got from us. */
+            mutex_pi_update(m->holder);
+            errno = ETIMEDOUT;
+            rv = -1;
+        }
+    }
     else {
-        if(!(rv = genwait_wait(m, timeout ? "mutex_lock_timed" : "mutex_lock",
-                               timeout, NULL))) {
+        LOCKPROF_START(start);
+        rv = genwait_wait(m, timeout ? "mutex_lock_timed" : "mutex_lock",
+                          timeout, NULL);
+        LOCKPROF_RECORD(m, LOCKPROF_MUTEX, start, !rv);
+
+        if(!rv) {
             m->holder = thd_current;
             m->count = 1;
         }
@@ -151,7 +260,7 @@ int mutex_trylock(mutex_t *m) {
     if(irq_inside_int())
         thd = (kthread_t *)0xFFFFFFFF;
 
-    if(m->type < MUTEX_TYPE_NORMAL || m->type > MUTEX_TYPE_RECURSIVE) {
+    if(m->type < MUTEX_TYPE_NORMAL || m->type > MUTEX_TYPE_PI) {
         errno = EINVAL;
         rv = -1;
     }
@@ -175,6 +284,19 @@ int mutex_trylock(mutex_t *m) {
                 }
                 break;
 
+            case MUTEX_TYPE_PI:
+                if(m->count) {
+                    errno = EDEADLK;
+                    rv = -1;
+                }
+                else {
+                    m->count = 1;
+
+                    if(thd != (kthread_t *)0xFFFFFFFF)
+                        LIST_INSERT_HEAD(&thd->pi_held, m, pi_list);
+                }
+                break;
+
             case MUTEX_TYPE_RECURSIVE:
                 if(m->count == INT_MAX) {
                     errno = EAGAIN;
@@ -185,6 +307,9 @@ int mutex_trylock(mutex_t *m) {
                 }
                 break;
         }
+
+        if(!rv)
+            LOCKPROF_RECORD(m, LOCKPROF_MUTEX, 0, 1);
     }
 
     irq_restore(old);
@@ -193,6 +318,7 @@ int mutex_trylock(mutex_t *m) {
 
 static int mutex_unlock_common(mutex_t *m, kthread_t *thd) {
     int old, rv = 0, wakeup = 0;
+    kthread_t *next;
 
     old = irq_disable();
 
@@ -226,6 +352,36 @@ static int mutex_unlock_common(mutex_t *m, kthread_t *thd) {
             }
             break;
 
+        case MUTEX_TYPE_PI:
+            if(m->holder != thd) {
+                errno = EPERM;
+                rv = -1;
+                break;
+            }
+
+            if(thd != (kthread_t *)0xFFFFFFFF)
+                LIST_REMOVE(m, pi_list);
+
+            /* Hand the lock straight to the highest priority waiter, if there
+               is one, so that nothing of lower priority can sneak in first. */
+            if((next = genwait_top_waiter(m))) {
+                m->holder = next;
+                next->pi_wait = NULL;
+                LIST_INSERT_HEAD(&next->pi_held, m, pi_list);
+                genwait_wake_thd(m, next, 0);
+
+                /* The new holder inherits from anyone left waiting. */
+                mutex_pi_update(next);
+            }
+            else {
+                m->count = 0;
+                m->holder = NULL;
+            }
+
+            /* Drop any boost we had from holding this lock. */
+            mutex_pi_update(thd);
+            break;
+
         default:
             errno = EINVAL;
             rv = -1;
@@ -259,3 +415,20 @@ int mutex_unlock_as_thread(mutex_t *m, kthread_t *thd) {
 
     return mutex_unlock_common(m, thd);
 }
+
+void mutex_pi_release_all(kthread_t *thd) {
+    mutex_t *m;
+    int old;
+
+    old = irq_disable();
+
+    /* Unlocking takes the mutex off the list, and hands it to the highest
+       priority waiter, if there is one. */
+    while((m = LIST_FIRST(&thd->pi_held))) {
+        dbglog(DBG_WARNING, "mutex: thread %d exited holding a priority "
+               "inheritance mutex\n", thd->tid);
+        mutex_unlock_common(m, thd);
+    }
+
+    irq_restore(old);
+}
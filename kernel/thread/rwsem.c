@@ -12,6 +12,7 @@
 
 #include <kos/rwsem.h>
 #include <kos/genwait.h>
+#include <kos/lockprof.h>
 
 /* Allocate a new reader/writer semaphore */
 rw_semaphore_t *rwsem_create() {
@@ -66,6 +67,7 @@ int rwsem_destroy(rw_semaphore_t *s) {
 /* Lock a reader/writer semaphore for reading */
 int rwsem_read_lock_timed(rw_semaphore_t *s, int timeout) {
     int old, rv = 0;
+    LOCKPROF_DECL(start);
 
     if(irq_inside_int()) {
         dbglog(DBG_WARNING, "rwsem_read_lock_timed: called inside interrupt\n");
@@ -89,11 +91,14 @@ int rwsem_read_lock_timed(rw_semaphore_t *s, int timeout) {
     /* If the write lock is not held, let the thread proceed */
     if(!s->write_lock) {
         ++s->read_count;
+        LOCKPROF_RECORD(s, LOCKPROF_RWSEM, 0, 1);
     }
     else {
         /* Block until the write lock is not held any more */
+        LOCKPROF_START(start);
         rv = genwait_wait(s, timeout ? "rwsem_read_lock_timed" :
                           "rwsem_read_lock", timeout, NULL);
+        LOCKPROF_RECORD(s, LOCKPROF_RWSEM, start, !rv);
 
         if(rv < 0) {
             rv = -1;
@@ -116,6 +121,7 @@ int rwsem_read_lock(rw_semaphore_t *s) {
 /* Lock a reader/writer semaphore for writing */
 int rwsem_write_lock_timed(rw_semaphore_t *s, int timeout) {
     int old, rv = 0;
+    LOCKPROF_DECL(start);
 
     if(irq_inside_int()) {
         dbglog(DBG_WARNING, "rwsem_write_lock_timed: called inside "
@@ -141,12 +147,15 @@ int rwsem_write_lock_timed(rw_semaphore_t *s, int timeout) {
        sections, let the thread proceed. */
     if(!s->write_lock && !s->read_count) {
         s->write_lock = thd_current;
+        LOCKPROF_RECORD(s, LOCKPROF_RWSEM, 0, 1);
     }
     else {
         /* Block until the write lock is not held and there are no readers
            inside their critical sections */
+        LOCKPROF_START(start);
         rv = genwait_wait(&s->write_lock, timeout ? "rwsem_write_lock_timed" :
                           "rwsem_write_lock", timeout, NULL);
+        LOCKPROF_RECORD(s, LOCKPROF_RWSEM, start, !rv);
 
         if(rv < 0) {
             rv = -1;
@@ -279,6 +288,7 @@ int rwsem_read_trylock(rw_semaphore_t *s) {
     else {
         rv = 0;
         ++s->read_count;
+        LOCKPROF_RECORD(s, LOCKPROF_RWSEM, 0, 1);
     }
 
     irq_restore(old);
@@ -304,6 +314,7 @@ int rwsem_write_trylock(rw_semaphore_t *s) {
     else {
         rv = 0;
         s->write_lock = thd_current;
+        LOCKPROF_RECORD(s, LOCKPROF_RWSEM, 0, 1);
     }
 
     irq_restore(old);
@@ -313,6 +324,7 @@ int rwsem_write_trylock(rw_semaphore_t *s) {
 /* "Upgrade" a read lock to a write lock. */
 int rwsem_read_upgrade_timed(rw_semaphore_t *s, int timeout) {
     int old, rv = 0;
+    LOCKPROF_DECL(start);
 
     if(irq_inside_int()) {
         dbglog(DBG_WARNING, "rwsem_read_upgrade_timed: called inside "
@@ -344,9 +356,11 @@ int rwsem_read_upgrade_timed(rw_semaphore_t *s, int timeout) {
         else {
             --s->read_count;
             s->reader_waiting = thd_current;
+            LOCKPROF_START(start);
             rv = genwait_wait(&s->write_lock, timeout ?
                               "rwsem_read_upgrade_timed" : "rwsem_read_upgrade",
                               timeout, NULL);
+            LOCKPROF_RECORD(s, LOCKPROF_RWSEM, start, !rv);
 
             if(rv < 0) {
                 /* The only way we can error out is if there are still readers
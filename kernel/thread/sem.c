@@ -19,6 +19,9 @@
 #include <kos/limits.h>
 #include <kos/sem.h>
 #include <kos/genwait.h>
+#include <kos/lockprof.h>
+
+#include <arch/timer.h>
 
 /**************************************/
 
@@ -79,6 +82,7 @@ int sem_destroy(semaphore_t *sm) {
 /* Wait on a semaphore, with timeout (in milliseconds) */
 int sem_wait_timed(semaphore_t *sem, int timeout) {
     int old, rv = 0;
+    LOCKPROF_DECL(start);
 
     /* Make sure we're not inside an interrupt */
     if(irq_inside_int()) {
@@ -103,12 +107,15 @@ int sem_wait_timed(semaphore_t *sem, int timeout) {
     /* If there's enough count left, then let the thread proceed */
     else if(sem->count > 0) {
         sem->count--;
+        LOCKPROF_RECORD(sem, LOCKPROF_SEMAPHORE, 0, 1);
     }
     else {
         /* Block us until we're signaled */
         sem->count--;
+        LOCKPROF_START(start);
         rv = genwait_wait(sem, timeout ? "sem_wait_timed" : "sem_wait", timeout,
                           NULL);
+        LOCKPROF_RECORD(sem, LOCKPROF_SEMAPHORE, start, !rv);
 
         /* Did we fail to get the lock? */
         if(rv < 0) {
@@ -125,6 +132,76 @@ int sem_wait_timed(semaphore_t *sem, int timeout) {
     return rv;
 }
 
+int sem_wait_any(semaphore_t **sems, int cnt, int timeout) {
+    int old, i, rv = -1;
+    uint64 deadline = 0, now;
+
+    if(irq_inside_int()) {
+        dbglog(DBG_WARNING, "sem_wait_any: called inside interrupt\n");
+        errno = EPERM;
+        return -1;
+    }
+
+    if(timeout < 0 || cnt < 1 || cnt > GENWAIT_MULTI_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    old = irq_disable();
+
+    for(i = 0; i < cnt; ++i) {
+        if(sems[i]->initialized != 1 && sems[i]->initialized != 2) {
+            irq_restore(old);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    if(timeout)
+        deadline = timer_ms_gettime64() + timeout;
+
+    for(;;) {
+        /* Take the first one that has anything available. */
+        for(i = 0; i < cnt; ++i) {
+            if(sems[i]->count > 0) {
+                sems[i]->count--;
+                LOCKPROF_RECORD(sems[i], LOCKPROF_SEMAPHORE, 0, 1);
+                rv = i;
+                break;
+            }
+        }
+
+        if(rv >= 0)
+            break;
+
+        if(timeout) {
+            now = timer_ms_gettime64();
+
+            if(now >= deadline) {
+                errno = ETIMEDOUT;
+                break;
+            }
+
+            timeout = (int)(deadline - now);
+        }
+
+        /* Nothing yet, so sleep on all of them. Unlike sem_wait(), we don't
+           take a count while waiting, so sem_signal() will just bump the count
+           and wake us up to try again. */
+        if(genwait_wait_multi((void **)sems, cnt, "sem_wait_any",
+                              timeout) < 0) {
+            if(errno == EAGAIN)
+                errno = ETIMEDOUT;
+
+            break;
+        }
+    }
+
+    irq_restore(old);
+
+    return rv;
+}
+
 int sem_wait(semaphore_t *sm) {
     return sem_wait_timed(sm, 0);
 }
@@ -143,6 +220,7 @@ int sem_trywait(semaphore_t *sm) {
     /* Is there enough count left? */
     else if(sm->count > 0) {
         sm->count--;
+        LOCKPROF_RECORD(sm, LOCKPROF_SEMAPHORE, 0, 1);
     }
     else {
         rv = -1;
@@ -174,6 +252,11 @@ int sem_signal(semaphore_t *sm) {
     else {
         /* No one is waiting, so just add another tick */
         sm->count++;
+
+        /* Let anyone in sem_wait_any() know that there's something to take
+           now. They don't hold a count while waiting, so they'll never be
+           woken by the branch above. */
+        genwait_wake_one(sm);
     }
 
     irq_restore(old);
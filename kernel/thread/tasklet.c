@@ -0,0 +1,126 @@
+/* KallistiOS ##version##
+
+   tasklet.c
+   Copyright (C) 2026 The KallistiOS Team
+*/
+
+/* Defines tasklets: work pushed out of interrupt handlers to be run in a high
+   priority thread. */
+
+#include <errno.h>
+
+#include <kos/thread.h>
+#include <kos/genwait.h>
+#include <kos/tasklet.h>
+#include <arch/irq.h>
+
+#define TASKLET_QUEUE_MASK  (TASKLET_QUEUE_SIZE - 1)
+
+/* Keep the compiler from moving memory accesses across this point. */
+#define barrier() __asm__ __volatile__("" : : : "memory")
+
+typedef struct tasklet_ent {
+    tasklet_func_t func;
+    void *data;
+} tasklet_ent_t;
+
+/* The queue itself. Producers (interrupts, or threads with interrupts
+   disabled) only ever touch the tail, and the tasklet thread is the only one
+   that touches the head, so the tasklet thread never needs to disable
+   interrupts to pull things off of the queue. */
+static tasklet_ent_t tasklet_queue[TASKLET_QUEUE_SIZE];
+static volatile uint32 tasklet_head = 0, tasklet_tail = 0;
+static volatile uint32 tasklet_drops = 0;
+
+static kthread_t *tasklet_thd = NULL;
+static volatile int tasklet_quit = 0;
+
+int tasklet_schedule(tasklet_func_t func, void *data) {
+    int old = irq_disable();
+    uint32 tail = tasklet_tail;
+
+    if(tail - tasklet_head >= TASKLET_QUEUE_SIZE) {
+        ++tasklet_drops;
+        irq_restore(old);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    tasklet_queue[tail & TASKLET_QUEUE_MASK].func = func;
+    tasklet_queue[tail & TASKLET_QUEUE_MASK].data = data;
+    barrier();
+    tasklet_tail = tail + 1;
+
+    genwait_wake_one(&tasklet_queue);
+    irq_restore(old);
+
+    return 0;
+}
+
+uint32 tasklet_dropped(void) {
+    return tasklet_drops;
+}
+
+void tasklet_irq_exit(void) {
+    /* Only jump straight over to the tasklet thread if there's something for
+       it to do, and if we're allowed to pre-empt whoever was running. */
+    if(tasklet_head == tasklet_tail || !tasklet_thd)
+        return;
+
+    if(thd_get_mode() == THD_MODE_COOP || thd_get_mode() == THD_MODE_NONE)
+        return;
+
+    if(!thd_current || thd_current == tasklet_thd ||
+       tasklet_thd->state != STATE_READY)
+        return;
+
+    thd_schedule_next(tasklet_thd);
+}
+
+static void *tasklet_thread(void *param) {
+    tasklet_ent_t ent;
+    int old;
+
+    (void)param;
+
+    for(;;) {
+        old = irq_disable();
+
+        while(tasklet_head == tasklet_tail && !tasklet_quit)
+            genwait_wait(&tasklet_queue, "tasklet_thread", 0, NULL);
+
+        irq_restore(old);
+
+        if(tasklet_quit)
+            break;
+
+        while(tasklet_head != tasklet_tail) {
+            ent = tasklet_queue[tasklet_head & TASKLET_QUEUE_MASK];
+            barrier();
+            ++tasklet_head;
+
+            ent.func(ent.data);
+        }
+    }
+
+    return NULL;
+}
+
+int tasklet_init(void) {
+    tasklet_quit = 0;
+
+    if(!(tasklet_thd = thd_create(1, tasklet_thread, NULL)))
+        return -1;
+
+    thd_set_label(tasklet_thd, "[tasklet]");
+    thd_set_prio(tasklet_thd, TASKLET_PRIO);
+
+    return 0;
+}
+
+void tasklet_shutdown(void) {
+    /* The thread itself is torn down along with all the others, so just make
+       sure nobody tries to switch to it anymore. */
+    tasklet_quit = 1;
+    tasklet_thd = NULL;
+}
@@ -15,9 +15,12 @@
 #include <kos/thread.h>
 #include <kos/dbgio.h>
 #include <kos/sem.h>
+#include <kos/mutex.h>
 #include <kos/rwsem.h>
 #include <kos/cond.h>
 #include <kos/genwait.h>
+#include <kos/tasklet.h>
+#include <kos/slab.h>
 #include <arch/irq.h>
 #include <arch/timer.h>
 #include <arch/arch.h>
@@ -42,13 +45,22 @@ also using their queue library verbatim (sys/queue.h).
 static struct ktlist thd_list;
 
 /* Run queue. This is more like on a standard time sharing system than the
-   previous versions. The top element of this priority queue should be the
-   thread that is ready to run next. When a thread is scheduled, it will be
-   removed from this queue. When it's de-scheduled, it will be re-inserted
-   by its priority value at the end of its priority group. Note that right
-   now this condition is being broken because sleeping threads are on the
-   same queue. We deal with those in thd_switch below. */
-static struct ktqueue run_queue;
+   previous versions. Each priority level has its own FIFO list of threads
+   that are ready to run, and a two-level bitmap keeps track of which of the
+   lists are non-empty. When a thread is scheduled, it will be removed from
+   its list. When it's de-scheduled, it will be re-inserted at the end of its
+   priority group (or at the front, if requested). This makes enqueueing,
+   dequeueing, and finding the next thread to run all constant time
+   operations, regardless of how many threads are runnable. Only threads that
+   are ready to run are ever placed on these lists; sleeping threads live on
+   the genwait sleep queues instead. */
+#define RQ_LEVELS       (PRIO_MAX + 1)
+#define RQ_WORDS        ((RQ_LEVELS + 31) / 32)
+#define RQ_SUMWORDS     ((RQ_WORDS + 31) / 32)
+
+static struct ktqueue run_queue[RQ_LEVELS];
+static uint32 rq_bitmap[RQ_WORDS];
+static uint32 rq_summary[RQ_SUMWORDS];
 
 /* The currently executing thread. This thread should not be on any queues. */
 kthread_t *thd_current = NULL;
@@ -62,9 +74,27 @@ static semaphore_t thd_reap_sem;
 /* Number of threads active in the system. */
 static uint32 thd_count = 0;
 
+/* Number of those that belong to the kernel and never exit (the idle task,
+   the reaper, and the tasklet thread). */
+static uint32 thd_sys_count = 0;
+
 /* The idle task */
 static kthread_t *thd_idle_thd = NULL;
 
+/* The thread that was most recently switched in. This is used to charge time
+   to a thread after it has blocked itself (and thd_current is NULL). */
+static kthread_t *thd_last_run = NULL;
+
+/* In tickless mode, the absolute time (in milliseconds) that the primary timer
+   is currently set to go off at, or 0 if it isn't set. */
+static uint64 thd_tickless_deadline = 0;
+
+/* Number of vertical blanks seen so far, and the number of periodic threads
+   that are released by them. Periodic threads waiting on the vertical blank
+   sleep on thd_vblank_count. */
+static volatile uint32 thd_vblank_count = 0;
+static int thd_vblank_users = 0;
+
 /*****************************************************************************/
 /* Debug */
 
@@ -102,11 +132,15 @@ int thd_each(int (*cb)(kthread_t* thd, void* user_data), void* data) {
 
 int thd_pslist(int (*pf)(const char *fmt, ...)) {
     kthread_t *cur;
+    kthread_stats_t st;
 
     pf("All threads (may not be deterministic):\n");
-    pf("addr\t\ttid\tprio\tflags\twait_timeout\tstate     name\n");
+    pf("addr\t\ttid\tprio\tflags\twait_timeout\tcpu_ms\tvcsw\ticsw\t"
+       "state     name\n");
 
     LIST_FOREACH(cur, &thd_list, t_list) {
+        thd_get_stats(cur, &st);
+
         pf("%08lx\t", CONTEXT_PC(cur->context));
         pf("%d\t", cur->tid);
 
@@ -117,6 +151,8 @@ int thd_pslist(int (*pf)(const char *fmt, ...)) {
 
         pf("%08lx\t", cur->flags);
         pf("%ld\t\t", (uint32)cur->wait_timeout);
+        pf("%lu\t", (uint32)(st.run_time / 1000));
+        pf("%lu\t%lu\t", st.switches_vol, st.switches_invol);
         pf("%10s", thd_state_to_str(cur));
         pf("%s\n", cur->label);
     }
@@ -127,22 +163,29 @@ int thd_pslist(int (*pf)(const char *fmt, ...)) {
 
 int thd_pslist_queue(int (*pf)(const char *fmt, ...)) {
     kthread_t *cur;
+    int i;
 
     pf("Queued threads:\n");
     pf("addr\t\ttid\tprio\tflags\twait_timeout\tstate     name\n");
-    TAILQ_FOREACH(cur, &run_queue, thdq) {
-        pf("%08lx\t", CONTEXT_PC(cur->context));
-        pf("%d\t", cur->tid);
 
-        if(cur->prio == PRIO_MAX)
-            pf("MAX\t");
-        else
-            pf("%d\t", cur->prio);
+    for(i = 0; i < RQ_LEVELS; ++i) {
+        if(!(rq_bitmap[i >> 5] & (1UL << (i & 31))))
+            continue;
 
-        pf("%08lx\t", cur->flags);
-        pf("%ld\t\t", (uint32)cur->wait_timeout);
-        pf("%10s", thd_state_to_str(cur));
-        pf("%s\n", cur->label);
+        TAILQ_FOREACH(cur, &run_queue[i], thdq) {
+            pf("%08lx\t", CONTEXT_PC(cur->context));
+            pf("%d\t", cur->tid);
+
+            if(cur->prio == PRIO_MAX)
+                pf("MAX\t");
+            else
+                pf("%d\t", cur->prio);
+
+            pf("%08lx\t", cur->flags);
+            pf("%ld\t\t", (uint32)cur->wait_timeout);
+            pf("%10s", thd_state_to_str(cur));
+            pf("%s\n", cur->label);
+        }
     }
 
     return 0;
@@ -151,30 +194,268 @@ int thd_pslist_queue(int (*pf)(const char *fmt, ...)) {
 /*****************************************************************************/
 /* Returns a fresh thread ID for each new thread */
 
-/* Highest thread id (used when assigning next thread id) */
-static tid_t tid_highest;
+/* Thread IDs are made up of an index into the table below (in the low bits)
+   and a generation count for that slot (in the high bits). The generation is
+   bumped every time a slot is freed, so a stale thread ID will not resolve to
+   whatever thread happens to reuse its slot later on. Looking up a thread by
+   its ID is a simple array index. Slot 0 is never used, so that 0 is never a
+   valid thread ID, and the first set of threads get the same small IDs that
+   they always have.
+
+   The slot takes 12 bits, which is more threads than there is memory for
+   stacks anyway, leaving 19 bits of generation below the sign bit. A slot
+   must be reused 524288 times before its generation wraps. */
+#define TID_SLOT_BITS   12
+#define TID_SLOT_MASK   ((1 << TID_SLOT_BITS) - 1)
+#define TID_GEN_MASK    0x7FFFF
+#define TID_SLOTS_INIT  32
+
+/* Don't reuse a freed slot until at least this many are waiting to be reused.
+   Freed slots are reused in FIFO order, so a slot is reused at most once in
+   every 32 thread creations, and a stale thread ID can't match a new thread
+   until at least 16 million (32 * 524288) more have been created. */
+#define TID_REUSE_MIN   32
+
+typedef struct thd_tid_slot {
+    kthread_t *thd;
+    uint32 gen;
+    uint16 next_free;
+} thd_tid_slot_t;
+
+static thd_tid_slot_t *tid_slots;
+static int tid_slot_count, tid_slot_used;
+static int tid_free_head, tid_free_tail, tid_free_count;
+
+/* Return the next available thread id, and associate it with the given
+   thread. Returns -1 if we're completely out of thread IDs (or memory). */
+static tid_t thd_next_free(kthread_t *thd) {
+    thd_tid_slot_t *ns;
+    int slot, cnt;
+
+    if(tid_free_count && (tid_free_count >= TID_REUSE_MIN ||
+                          tid_slot_used == TID_SLOT_MASK + 1)) {
+        /* Pull the oldest freed slot off the free list. */
+        slot = tid_free_head;
+        tid_free_head = tid_slots[slot].next_free;
+
+        if(!--tid_free_count)
+            tid_free_head = tid_free_tail = 0;
+    }
+    else if(tid_slot_used <= TID_SLOT_MASK) {
+        /* Grab a fresh slot, expanding the table if need be. */
+        if(tid_slot_used >= tid_slot_count) {
+            cnt = tid_slot_count ? tid_slot_count * 2 : TID_SLOTS_INIT;
+
+            if(cnt > TID_SLOT_MASK + 1)
+                cnt = TID_SLOT_MASK + 1;
+
+            ns = (thd_tid_slot_t *)realloc(tid_slots,
+                                           cnt * sizeof(thd_tid_slot_t));
+
+            if(!ns) {
+                errno = ENOMEM;
+                return -1;
+            }
+
+            memset(ns + tid_slot_count, 0,
+                   (cnt - tid_slot_count) * sizeof(thd_tid_slot_t));
+            tid_slots = ns;
+            tid_slot_count = cnt;
+        }
+
+        slot = tid_slot_used++;
+    }
+    else {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    tid_slots[slot].thd = thd;
+    return (tid_slots[slot].gen << TID_SLOT_BITS) | slot;
+}
+
+/* Release a thread id so that its slot can be reused later. */
+static void thd_release_tid(tid_t tid) {
+    int slot = tid & TID_SLOT_MASK;
+
+    tid_slots[slot].thd = NULL;
+    tid_slots[slot].gen = (tid_slots[slot].gen + 1) & TID_GEN_MASK;
+    tid_slots[slot].next_free = 0;
+
+    if(tid_free_count)
+        tid_slots[tid_free_tail].next_free = slot;
+    else
+        tid_free_head = slot;
 
-/* Return the next available thread id (assumes wraparound will not run
-   into old processes). */
-static tid_t thd_next_free() {
-    int id;
-    id = tid_highest++;
-    return id;
+    tid_free_tail = slot;
+    ++tid_free_count;
 }
 
 /* Given a thread ID, locates the thread structure */
 kthread_t *thd_by_tid(tid_t tid) {
+    int slot = tid & TID_SLOT_MASK;
     kthread_t *np;
 
-    LIST_FOREACH(np, &thd_list, t_list) {
-        if(np->tid == tid)
-            return np;
-    }
+    if(tid <= 0 || slot >= tid_slot_used)
+        return NULL;
+
+    np = tid_slots[slot].thd;
+
+    if(np && np->tid == tid)
+        return np;
 
     return NULL;
 }
 
 
+/*****************************************************************************/
+/* Thread object cache */
+
+/* Dead threads whose kthread_t (and stack, if we allocated it) are being kept
+   around to be reused by thd_create_ex(). These are linked through t_list,
+   since they're no longer on the thread list. All of this is protected by
+   disabling interrupts. */
+static struct ktlist thd_cache = LIST_HEAD_INITIALIZER(thd_cache);
+static size_t thd_cache_max = THD_CACHE_DEFAULT_COUNT;
+static size_t thd_cache_stack_max = THD_CACHE_DEFAULT_STACK;
+static size_t thd_cache_count = 0;
+static size_t thd_cache_bytes = 0;
+static uint32 thd_cache_hits = 0, thd_cache_misses = 0;
+
+/* Where thread structures come from, when the cache above is empty */
+static slab_cache_t *thd_slab = NULL;
+
+/* Free a thread structure and its stack. Cached threads only ever keep
+   stacks that we allocated ourselves. */
+static void thd_free(kthread_t *thd) {
+    free(thd->stack);
+
+    slab_free(thd_slab, thd);
+}
+
+/* Grab a thread structure out of the cache. If stack_size is non-zero, only a
+   thread with a kernel-allocated stack of exactly that size will do, otherwise
+   we'd prefer one without a stack at all (though any will do in a pinch). */
+static kthread_t *thd_cache_get(size_t stack_size) {
+    kthread_t *t, *rv = NULL;
+
+    LIST_FOREACH(t, &thd_cache, t_list) {
+        if(stack_size) {
+            if((t->flags & THD_OWN_STACK) && t->stack_size == stack_size) {
+                rv = t;
+                break;
+            }
+        }
+        else if(!(t->flags & THD_OWN_STACK)) {
+            rv = t;
+            break;
+        }
+        else if(!rv) {
+            rv = t;
+        }
+    }
+
+    if(!rv) {
+        ++thd_cache_misses;
+        return NULL;
+    }
+
+    LIST_REMOVE(rv, t_list);
+    --thd_cache_count;
+
+    if(rv->flags & THD_OWN_STACK) {
+        thd_cache_bytes -= rv->stack_size;
+
+        /* We can't use the stack, so don't hang onto it. */
+        if(!stack_size) {
+            free(rv->stack);
+            rv->stack = NULL;
+            rv->flags &= ~THD_OWN_STACK;
+        }
+    }
+
+    ++thd_cache_hits;
+    return rv;
+}
+
+/* Put a dead thread into the cache, or free it if the cache is full. */
+static void thd_cache_put(kthread_t *thd) {
+    if(thd_cache_count >= thd_cache_max ||
+       ((thd->flags & THD_OWN_STACK) && thd->stack_size > thd_cache_stack_max)) {
+        thd_free(thd);
+        return;
+    }
+
+    LIST_INSERT_HEAD(&thd_cache, thd, t_list);
+    ++thd_cache_count;
+
+    if(thd->flags & THD_OWN_STACK)
+        thd_cache_bytes += thd->stack_size;
+}
+
+/* Throw out anything in the cache beyond the current limits. */
+static void thd_cache_trim(void) {
+    kthread_t *t, *n;
+
+    t = LIST_FIRST(&thd_cache);
+
+    while(t) {
+        n = LIST_NEXT(t, t_list);
+
+        if(thd_cache_count > thd_cache_max || ((t->flags & THD_OWN_STACK) &&
+                                               t->stack_size > thd_cache_stack_max)) {
+            LIST_REMOVE(t, t_list);
+            --thd_cache_count;
+
+            if(t->flags & THD_OWN_STACK)
+                thd_cache_bytes -= t->stack_size;
+
+            thd_free(t);
+        }
+
+        t = n;
+    }
+}
+
+int thd_cache_set_limits(size_t count, size_t max_stack) {
+    int old = irq_disable();
+
+    thd_cache_max = count;
+    thd_cache_stack_max = max_stack;
+    thd_cache_trim();
+
+    irq_restore(old);
+    return 0;
+}
+
+int thd_cache_get_stats(kthread_cache_stats_t *stats) {
+    int old;
+
+    if(!stats)
+        return -1;
+
+    old = irq_disable();
+    stats->hits = thd_cache_hits;
+    stats->misses = thd_cache_misses;
+    stats->count = thd_cache_count;
+    stats->stack_bytes = thd_cache_bytes;
+    irq_restore(old);
+
+    return 0;
+}
+
+void thd_cache_flush(void) {
+    int old = irq_disable();
+    size_t max = thd_cache_max;
+
+    thd_cache_max = 0;
+    thd_cache_trim();
+    thd_cache_max = max;
+
+    irq_restore(old);
+}
+
+
 /*****************************************************************************/
 /* Thread support routines: idle task and start task wrapper */
 
@@ -247,6 +528,9 @@ void thd_exit(void *rv) {
     /* Call newlib's thread cleanup function */
     _reclaim_reent(&thd_current->thd_reent);
 
+    /* Don't leave anyone waiting forever on a lock we still hold */
+    mutex_pi_release_all(thd_current);
+
     if(thd_current->flags & THD_DETACHED) {
         /* Call Dr. Kevorkian; after this executes we could be killed
            at any time. */
@@ -271,66 +555,154 @@ void thd_exit(void *rv) {
 /*****************************************************************************/
 /* Thread creation and deletion */
 
+/* Map a thread's priority onto a run queue level. Anything outside of the
+   valid range gets clamped into it. */
+static inline int rq_level(kthread_t *t) {
+    if(t->prio < 0)
+        return 0;
+    else if(t->prio > PRIO_MAX)
+        return PRIO_MAX;
+
+    return t->prio;
+}
+
+/* Find the highest priority (lowest numbered) non-empty run queue level.
+   Returns -1 if nothing at all is runnable. */
+static int rq_highest(void) {
+    int i, w;
+
+    for(i = 0; i < RQ_SUMWORDS; ++i) {
+        if(rq_summary[i]) {
+            w = (i << 5) + __builtin_ctz(rq_summary[i]);
+            return (w << 5) + __builtin_ctz(rq_bitmap[w]);
+        }
+    }
+
+    return -1;
+}
+
+/* Program the primary timer for a tickless wakeup at the given absolute time.
+   Unless force is set, this will only ever move an already pending wakeup
+   earlier. A wakeup that ends up being unneeded is harmless, as the timer
+   handler will just figure out the next one and go back to sleep. */
+static void thd_tickless_arm(uint64 now, uint64 when, int force) {
+    uint64 delta;
+
+    if(!force && thd_tickless_deadline > now && thd_tickless_deadline <= when)
+        return;
+
+    if(when <= now)
+        when = now + 1;
+
+    delta = when - now;
+
+    if(delta > 0xFFFFFFFF)
+        delta = 0xFFFFFFFF;
+
+    thd_tickless_deadline = when;
+    timer_primary_wakeup((uint32)delta);
+}
+
+/* Figure out when the scheduler next needs to be run in tickless mode and set
+   up the timer for it. That is either the end of the current timeslice (only
+   if something else of the same or better priority is waiting to run) or the
+   next genwait timeout, whichever comes first. If neither applies, there's no
+   reason to take a timer interrupt at all. */
+static void thd_tickless_update(uint64 now) {
+    uint64 when;
+    int lvl;
+
+    when = genwait_next_timeout();
+    lvl = rq_highest();
+
+    if(lvl >= 0 && thd_current && lvl <= rq_level(thd_current)) {
+        if(!when || now + 1000 / HZ < when)
+            when = now + 1000 / HZ;
+    }
+
+    if(when)
+        thd_tickless_arm(now, when, 1);
+}
+
 /* Enqueue a process in the runnable queue; adds it right after the
    process group of the same priority (front_of_line==0) or
    right before the process group of the same priority (front_of_line!=0).
    See thd_schedule for why this is helpful. */
 void thd_add_to_runnable(kthread_t *t, int front_of_line) {
-    kthread_t *i;
-    int done;
+    int lvl;
 
     if(t->flags & THD_QUEUED)
         return;
 
-    done = 0;
+    lvl = rq_level(t);
 
-    if(!front_of_line) {
-        /* Look for a thread of lower priority and insert
-           before it. If there is nothing on the run queue, we'll
-           fall through to the bottom. */
-        TAILQ_FOREACH(i, &run_queue, thdq) {
-            if(i->prio > t->prio) {
-                TAILQ_INSERT_BEFORE(i, t, thdq);
-                done = 1;
-                break;
-            }
-        }
-    }
-    else {
-        /* Look for a thread of the same or lower priority and
-           insert before it. If there is nothing on the run queue,
-           we'll fall through to the bottom. */
-        TAILQ_FOREACH(i, &run_queue, thdq) {
-            if(i->prio >= t->prio) {
-                TAILQ_INSERT_BEFORE(i, t, thdq);
-                done = 1;
-                break;
-            }
-        }
-    }
+    if(!front_of_line)
+        TAILQ_INSERT_TAIL(&run_queue[lvl], t, thdq);
+    else
+        TAILQ_INSERT_HEAD(&run_queue[lvl], t, thdq);
 
-    /* Didn't find one, put it at the end */
-    if(!done)
-        TAILQ_INSERT_TAIL(&run_queue, t, thdq);
+    rq_bitmap[lvl >> 5] |= 1UL << (lvl & 31);
+    rq_summary[lvl >> 10] |= 1UL << ((lvl >> 5) & 31);
 
     t->flags |= THD_QUEUED;
+
+    /* In tickless mode, if this thread will be competing with the current one
+       for the processor, make sure a timeslice interrupt is coming. */
+    if(thd_mode == THD_MODE_TICKLESS && thd_current && t != thd_current &&
+       lvl <= rq_level(thd_current)) {
+        uint64 now = timer_ms_gettime64();
+        thd_tickless_arm(now, now + 1000 / HZ, 0);
+    }
 }
 
 /* Removes a thread from the runnable queue, if it's there. */
 int thd_remove_from_runnable(kthread_t *thd) {
+    int lvl;
+
     if(!(thd->flags & THD_QUEUED)) return 0;
 
+    lvl = rq_level(thd);
+
     thd->flags &= ~THD_QUEUED;
-    TAILQ_REMOVE(&run_queue, thd, thdq);
+    TAILQ_REMOVE(&run_queue[lvl], thd, thdq);
+
+    /* If that was the last thread at this level, clear its bit (and the
+       summary bit, if the whole word is now empty). */
+    if(TAILQ_EMPTY(&run_queue[lvl])) {
+        rq_bitmap[lvl >> 5] &= ~(1UL << (lvl & 31));
+
+        if(!rq_bitmap[lvl >> 5])
+            rq_summary[lvl >> 10] &= ~(1UL << ((lvl >> 5) & 31));
+    }
+
     return 0;
 }
 
+/* Set up (or tear down) a thread's periodic releases, with its current release
+   starting now. Interrupts must be disabled. */
+static void thd_periodic_set(kthread_t *thd, const kthread_periodic_t *p) {
+    if(thd->periodic.vblank)
+        --thd_vblank_users;
+
+    if(p)
+        thd->periodic = *p;
+    else
+        memset(&thd->periodic, 0, sizeof(kthread_periodic_t));
+
+    thd->period_release = timer_us_gettime64();
+    thd->period_vblank = thd_vblank_count + thd->periodic.vblank;
+
+    if(thd->periodic.vblank)
+        ++thd_vblank_users;
+}
+
 /* New thread function; given a routine address, it will create a
    new kernel thread with the given attributes. When the routine
    returns, the thread will exit. Returns the new thread struct. */
 kthread_t *thd_create_ex(kthread_attr_t *attr, void * (*routine)(void *param),
                          void *param) {
     kthread_t *nt = NULL;
+    uint32 *stack;
     tid_t tid;
     uint32 params[4];
     int oldirq = 0;
@@ -354,78 +726,96 @@ kthread_t *thd_create_ex(kthread_attr_t *attr, void * (*routine)(void *param),
 
     oldirq = irq_disable();
 
-    /* Get a new thread id */
-    tid = thd_next_free();
+    /* Reuse a dead thread's structure (and stack) if we can, otherwise create
+       a new thread structure */
+    nt = thd_cache_get(real_attr.stack_ptr ? 0 : real_attr.stack_size);
 
-    if(tid >= 0) {
-        /* Create a new thread structure */
-        nt = malloc(sizeof(kthread_t));
+    if(nt) {
+        stack = (nt->flags & THD_OWN_STACK) ? nt->stack : NULL;
+    }
+    else {
+        nt = slab_alloc(thd_slab);
+        stack = NULL;
+    }
 
-        if(nt != NULL) {
-            /* Clear out potentially unused stuff */
-            memset(nt, 0, sizeof(kthread_t));
+    /* Get a new thread id for it */
+    if(nt != NULL && (tid = thd_next_free(nt)) < 0) {
+        free(stack);
+        slab_free(thd_slab, nt);
+        nt = NULL;
+    }
 
-            /* Create a new thread stack */
-            if(!real_attr.stack_ptr) {
-                nt->stack = (uint32*)malloc(real_attr.stack_size);
+    if(nt != NULL) {
+        /* Clear out potentially unused stuff */
+        memset(nt, 0, sizeof(kthread_t));
 
-                if(!nt->stack) {
-                    free(nt);
-                    irq_restore(oldirq);
-                    return NULL;
-                }
-            }
-            else {
-                nt->stack = (uint32*)real_attr.stack_ptr;
+        /* Create a new thread stack, if we don't have one already */
+        if(real_attr.stack_ptr) {
+            nt->stack = (uint32*)real_attr.stack_ptr;
+        }
+        else if(stack) {
+            nt->stack = stack;
+            nt->flags = THD_OWN_STACK;
+        }
+        else {
+            nt->stack = (uint32*)malloc(real_attr.stack_size);
+            nt->flags = THD_OWN_STACK;
+
+            if(!nt->stack) {
+                thd_release_tid(tid);
+                slab_free(thd_slab, nt);
+                irq_restore(oldirq);
+                return NULL;
             }
+        }
 
-            nt->stack_size = real_attr.stack_size;
-
-            /* Populate the context */
-            params[0] = (uint32)routine;
-            params[1] = (uint32)param;
-            params[2] = 0;
-            params[3] = 0;
-            irq_create_context(&nt->context,
-                               ((uint32)nt->stack) + nt->stack_size,
-                               (uint32)thd_birth, params, 0);
-
-            nt->tid = tid;
-            nt->prio = real_attr.prio;
-            nt->flags = THD_DEFAULTS;
-            nt->state = STATE_READY;
-
-            if(!real_attr.label) {
-                strcpy(nt->label, "[un-named kernel thread]");
-            }
-            else {
-                strncpy(nt->label, real_attr.label, 255);
-                nt->label[255] = 0;
-            }
+        nt->stack_size = real_attr.stack_size;
+
+        /* Populate the context */
+        params[0] = (uint32)routine;
+        params[1] = (uint32)param;
+        params[2] = 0;
+        params[3] = 0;
+        irq_create_context(&nt->context,
+                           ((uint32)nt->stack) + nt->stack_size,
+                           (uint32)thd_birth, params, 0);
+
+        nt->tid = tid;
+        nt->prio = real_attr.prio;
+        nt->real_prio = real_attr.prio;
+        nt->state = STATE_READY;
+        nt->stats_stamp = timer_us_gettime64();
+
+        if(!real_attr.label) {
+            strcpy(nt->label, "[un-named kernel thread]");
+        }
+        else {
+            strncpy(nt->label, real_attr.label, 255);
+            nt->label[255] = 0;
+        }
 
-            if(thd_current)
-                strcpy(nt->pwd, thd_current->pwd);
-            else
-                strcpy(nt->pwd, "/");
+        if(thd_current)
+            strcpy(nt->pwd, thd_current->pwd);
+        else
+            strcpy(nt->pwd, "/");
 
-            _REENT_INIT_PTR((&(nt->thd_reent)));
+        _REENT_INIT_PTR((&(nt->thd_reent)));
 
-            /* Should we detach the thread? */
-            if(real_attr.create_detached)
-                nt->flags |= THD_DETACHED;
+        /* Should we detach the thread? */
+        if(real_attr.create_detached)
+            nt->flags |= THD_DETACHED;
 
-            /* Initialize thread-local storage. */
-            LIST_INIT(&nt->tls_list);
+        /* No priority inheritance mutexes held yet. */
+        LIST_INIT(&nt->pi_held);
 
-            /* Insert it into the thread list */
-            LIST_INSERT_HEAD(&thd_list, nt, t_list);
+        /* Insert it into the thread list */
+        LIST_INSERT_HEAD(&thd_list, nt, t_list);
 
-            /* Add it to our count */
-            ++thd_count;
+        /* Add it to our count */
+        ++thd_count;
 
-            /* Schedule it */
-            thd_add_to_runnable(nt, 0);
-        }
+        /* Schedule it */
+        thd_add_to_runnable(nt, 0);
     }
 
     irq_restore(oldirq);
@@ -441,7 +831,6 @@ kthread_t *thd_create(int detach, void *(*routine)(void *), void *param) {
    the execution chain. */
 int thd_destroy(kthread_t *thd) {
     int oldirq = 0;
-    kthread_tls_kv_t *i, *i2;
 
     /* Make sure there are no ints */
     oldirq = irq_disable();
@@ -450,31 +839,36 @@ int thd_destroy(kthread_t *thd) {
        and unblock them. */
     genwait_wake_all(thd);
 
+    /* Give up any priority inheritance mutexes it still holds, since they
+       would otherwise point at a thread structure that is about to be reused */
+    mutex_pi_release_all(thd);
+    assert(LIST_EMPTY(&thd->pi_held));
+
     /* De-schedule the thread if it's scheduled and free the
        thread structure */
     thd_remove_from_runnable(thd);
     LIST_REMOVE(thd, t_list);
+    thd_release_tid(thd->tid);
+
+    if(thd == thd_last_run)
+        thd_last_run = NULL;
 
     /* Clean up any thread-local data */
-    LIST_FOREACH(i, &thd->tls_list, kv_list) {
-        if(i->destructor) {
-            i->destructor(i->data);
-        }
-    }
+    kthread_tls_destroy(thd);
 
-    i = LIST_FIRST(&thd->tls_list);
+    if(thd->periodic.vblank)
+        --thd_vblank_users;
 
-    while(i != NULL) {
-        i2 = LIST_NEXT(i, kv_list);
-        free(i);
-        i = i2;
+    /* A stack that was passed in is ours to free, as it always has been, but
+       it's not the kind we can hand to another thread, so don't cache it. */
+    if(!(thd->flags & THD_OWN_STACK)) {
+        free(thd->stack);
+        thd->stack = NULL;
     }
 
-    /* Free its stack */
-    free(thd->stack);
-
-    /* Free the thread */
-    free(thd);
+    /* Keep the thread structure and its stack around for reuse, or free them
+       if the cache is full */
+    thd_cache_put(thd);
 
     /* Remove it from the count */
     --thd_count;
@@ -490,8 +884,19 @@ int thd_destroy(kthread_t *thd) {
 
 /* Set a thread's priority */
 int thd_set_prio(kthread_t *thd, prio_t prio) {
+    int old;
+
+    old = irq_disable();
+
     /* Set the new priority */
-    thd->prio = prio;
+    thd->real_prio = prio;
+
+    /* Figure out the priority the thread will actually run at (it may be
+       boosted by priority inheritance). If the thread is on the run queue,
+       this takes care of moving it to the list for its new priority. */
+    mutex_pi_update(thd);
+
+    irq_restore(old);
     return 0;
 }
 
@@ -514,8 +919,39 @@ int thd_set_prio(kthread_t *thd, prio_t prio) {
    to make sure the priorities are all straight before returning, but you
    don't want a full context switch inside the same priority group.
 */
-void thd_schedule(int front_of_line, uint64 now) {
-    int dontenq;
+/* Charge the thread that was running up until now with its CPU time, and the
+   thread that is about to run with the time it spent waiting in the run queue.
+   If this is an actual switch between two threads, count it against the one
+   that's giving up the CPU. */
+static void thd_account_switch(kthread_t *thd, int voluntary) {
+    kthread_t *prev = thd_last_run;
+    uint64 now = timer_us_gettime64();
+
+    if(prev) {
+        prev->stats.run_time += now - prev->stats_stamp;
+        prev->stats_stamp = now;
+
+        if(prev != thd) {
+            if(voluntary || prev->state != STATE_READY)
+                ++prev->stats.switches_vol;
+            else
+                ++prev->stats.switches_invol;
+        }
+    }
+
+    if(thd != prev) {
+        thd->stats.ready_time += now - thd->stats_stamp;
+        thd->stats_stamp = now;
+    }
+
+    thd_last_run = thd;
+}
+
+/* The guts of thd_schedule(). The voluntary flag is set when the current
+   thread is giving up the CPU itself (through thd_block_now()), as opposed to
+   being preempted. */
+static void thd_schedule_int(int front_of_line, uint64 now, int voluntary) {
+    int dontenq, lvl;
     kthread_t *thd;
 
     if(now == 0)
@@ -525,9 +961,9 @@ void thd_schedule(int front_of_line, uint64 now) {
        thread blocked itself somewhere) or if it's a zombie (below) */
     dontenq = !thd_current;
 
-    /* If there's only two thread left, it's the idle task and the reaper task:
-       exit the OS */
-    if(thd_count == 2) {
+    /* If the only threads left are the kernel's own (the idle task, the reaper
+       task, and the tasklet thread): exit the OS */
+    if(thd_count == thd_sys_count) {
         dbgio_printf("\nthd_schedule: idle tasks are the only things left; exiting\n");
         arch_exit();
     }
@@ -542,14 +978,11 @@ void thd_schedule(int front_of_line, uint64 now) {
     /* Look for timed out waits */
     genwait_check_timeouts(now);
 
-    /* Search downwards through the run queue for a runnable thread; if
-       we don't find a normal runnable thread, the idle process will
-       always be there at the bottom. */
-    TAILQ_FOREACH(thd, &run_queue, thdq) {
-        /* Is it runnable? If not, keep going */
-        if(thd->state == STATE_READY)
-            break;
-    }
+    /* Grab the first thread from the highest priority non-empty level of the
+       run queue; if we don't find a normal runnable thread, the idle process
+       will always be there at the bottom. */
+    lvl = rq_highest();
+    thd = lvl >= 0 ? TAILQ_FIRST(&run_queue[lvl]) : NULL;
 
     /* If we didn't already re-enqueue the thread and we are supposed to do so,
        do it now. */
@@ -572,6 +1005,7 @@ void thd_schedule(int front_of_line, uint64 now) {
     /* We should now have a runnable thread, so remove it from the
        run queue and switch to it. */
     thd_remove_from_runnable(thd);
+    thd_account_switch(thd, voluntary);
 
     thd_current = thd;
     _impure_ptr = &thd->thd_reent;
@@ -586,9 +1020,16 @@ void thd_schedule(int front_of_line, uint64 now) {
         }
     }
 
+    if(thd_mode == THD_MODE_TICKLESS)
+        thd_tickless_update(now);
+
     irq_set_context(&thd_current->context);
 }
 
+void thd_schedule(int front_of_line, uint64 now) {
+    thd_schedule_int(front_of_line, now, 0);
+}
+
 /* Temporary priority boosting function: call this from within an interrupt
    to boost the given thread to the front of the queue. This will cause the
    interrupt return to jump back to the new thread instead of the one that
@@ -612,9 +1053,14 @@ void thd_schedule_next(kthread_t *thd) {
     }
 
     thd_remove_from_runnable(thd);
+    thd_account_switch(thd, 0);
     thd_current = thd;
     _impure_ptr = &thd->thd_reent;
     thd_current->state = STATE_RUNNING;
+
+    if(thd_mode == THD_MODE_TICKLESS)
+        thd_tickless_update(timer_ms_gettime64());
+
     irq_set_context(&thd_current->context);
 }
 
@@ -625,7 +1071,7 @@ irq_context_t * thd_choose_new() {
     //printf("thd_choose_new() woken at %d\n", (uint32)now);
 
     /* Do any re-scheduling */
-    thd_schedule(0, now);
+    thd_schedule_int(0, now, 1);
 
     /* Return the new IRQ context back to the caller */
     return &thd_current->context;
@@ -636,7 +1082,8 @@ irq_context_t * thd_choose_new() {
 /* Timer function. Check to see if we were woken because of a timeout event
    or because of a pre-empt. For timeouts, just go take care of it and sleep
    again until our next context switch (if any). For pre-empts, re-schedule
-   threads, swap out contexts, and sleep. */
+   threads, swap out contexts, and sleep. In tickless mode, thd_schedule()
+   takes care of figuring out when (and if) we need to wake up again. */
 static void thd_timer_hnd(irq_context_t *context) {
     /* Get the system time */
     uint64 now = timer_ms_gettime64();
@@ -645,8 +1092,14 @@ static void thd_timer_hnd(irq_context_t *context) {
 
     //printf("timer woke at %d\n", (uint32)now);
 
-    thd_schedule(0, now);
-    timer_primary_wakeup(1000 / HZ);
+    if(thd_mode == THD_MODE_TICKLESS) {
+        thd_tickless_deadline = 0;
+        thd_schedule(0, now);
+    }
+    else {
+        thd_schedule(0, now);
+        timer_primary_wakeup(1000 / HZ);
+    }
 }
 
 /*****************************************************************************/
@@ -675,6 +1128,125 @@ void thd_sleep(int ms) {
     genwait_wait((void *)0xffffffff, "thd_sleep", ms, NULL);
 }
 
+int thd_set_periodic(kthread_t *thd, const kthread_periodic_t *params) {
+    int old;
+
+    if(params && !params->period && !params->vblank) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    old = irq_disable();
+
+    if(!thd)
+        thd = thd_current;
+
+    thd_periodic_set(thd, params);
+    irq_restore(old);
+
+    return 0;
+}
+
+/* Periodic threads sleep until an absolute release time, rather than for a
+   relative amount of time like thd_sleep(), so they don't drift. */
+int thd_wait_period(void) {
+    kthread_t *thd = thd_current;
+    kthread_periodic_t *p = &thd->periodic;
+    uint64 now, next;
+    int old, late, skipped = 0;
+
+    if(irq_inside_int()) {
+        errno = EPERM;
+        return -1;
+    }
+
+    if(!p->period && !p->vblank) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    old = irq_disable();
+    now = timer_us_gettime64();
+    late = p->deadline && now > thd->period_release + p->deadline;
+
+    if(p->vblank) {
+        /* Has the next release already happened? If so, we're late, and
+           there may be whole releases that we've missed entirely. */
+        if((int32)(thd_vblank_count - thd->period_vblank) >= 0) {
+            if(!p->deadline)
+                late = 1;
+
+            while((int32)(thd_vblank_count - thd->period_vblank) >=
+                  (int32)p->vblank) {
+                thd->period_vblank += p->vblank;
+                ++skipped;
+            }
+        }
+
+        while((int32)(thd_vblank_count - thd->period_vblank) < 0)
+            genwait_wait((void *)&thd_vblank_count, "thd_wait_period", 0,
+                         NULL);
+
+        thd->period_vblank += p->vblank;
+        thd->period_release = timer_us_gettime64();
+    }
+    else {
+        next = thd->period_release + p->period;
+
+        if(!p->deadline && now > next)
+            late = 1;
+
+        while(next + p->period <= now) {
+            next += p->period;
+            ++skipped;
+        }
+
+        thd->period_release = next;
+
+        /* The wait is in milliseconds, so round the release time up to make
+           sure we don't wake up early. */
+        next = (next + 999) / 1000;
+
+        while((now = timer_ms_gettime64()) < next)
+            genwait_wait(&thd->periodic, "thd_wait_period", (int)(next - now),
+                         NULL);
+    }
+
+    ++thd->stats.releases;
+    thd->stats.deadline_misses += late + skipped;
+    irq_restore(old);
+
+    return skipped;
+}
+
+void thd_periodic_vblank(void) {
+    kthread_t *thd, *best = NULL;
+
+    ++thd_vblank_count;
+
+    if(!thd_vblank_users)
+        return;
+
+    LIST_FOREACH(thd, &thd_list, t_list) {
+        if(thd->state != STATE_WAIT ||
+           thd->wait_obj != (void *)&thd_vblank_count ||
+           (int32)(thd_vblank_count - thd->period_vblank) < 0)
+            continue;
+
+        genwait_wake_thd((void *)&thd_vblank_count, thd, 0);
+
+        if(!best || thd->prio < best->prio)
+            best = thd;
+    }
+
+    /* Rather than leaving the released threads until the next timeslice,
+       switch straight over to the most important one if it should preempt
+       whatever is running now. */
+    if(best && thd_current && best->prio < thd_current->prio &&
+       (thd_mode == THD_MODE_PREEMPT || thd_mode == THD_MODE_TICKLESS))
+        thd_schedule_next(best);
+}
+
 /* Manually cause a re-schedule */
 void thd_pass() {
     /* Makes no sense inside int */
@@ -800,6 +1372,27 @@ void thd_set_pwd(kthread_t *thd, const char *pwd) {
     strncpy(thd->pwd, pwd, sizeof(thd->pwd) - 1);
 }
 
+int thd_get_stats(kthread_t *thd, kthread_stats_t *stats) {
+    int old;
+
+    if(!stats)
+        return -1;
+
+    old = irq_disable();
+
+    if(!thd)
+        thd = thd_current;
+
+    *stats = thd->stats;
+
+    /* Include the time in the current timeslice for the running thread. */
+    if(thd == thd_last_run && thd->state == STATE_RUNNING)
+        stats->run_time += timer_us_gettime64() - thd->stats_stamp;
+
+    irq_restore(old);
+    return 0;
+}
+
 int * thd_get_errno(kthread_t * thd) {
     return &thd->thd_errno;
 }
@@ -818,13 +1411,14 @@ int thd_set_mode(int mode) {
     if(thd_mode == mode)
         return thd_mode;
 
-    if(thd_mode == THD_MODE_COOP) {
+    thd_mode = mode;
+
+    if(old == THD_MODE_COOP || mode == THD_MODE_PREEMPT) {
         /* Schedule our first pre-emption wakeup */
+        thd_tickless_deadline = 0;
         timer_primary_wakeup(1000 / HZ);
     }
 
-    thd_mode = mode;
-
     return old;
 }
 
@@ -832,72 +1426,47 @@ int thd_get_mode(void) {
     return thd_mode;
 }
 
-/* Delete a TLS key. Note that currently this doesn't prevent you from reusing
-   the key after deletion. This seems ok, as the pthreads standard states that
-   using the key after deletion results in "undefined behavior".
-   XXXX: This should really be in tls.c, but we need the list of threads to go
-   through, so it ends up here instead. */
-int kthread_key_delete(kthread_key_t key) {
-    int old = irq_disable();
-    kthread_t *cur;
-    kthread_tls_kv_t *i;
-
-    /* Make sure the key is valid. */
-    if(key >= kthread_key_next() || key < 1) {
-        irq_restore(old);
-        errno = EINVAL;
-        return -1;
-    }
-
-    /* Make sure we can actually use free below. */
-    if(!malloc_irq_safe())  {
-        irq_restore(old);
-        errno = EPERM;
-        return -1;
-    }
-
-    /* Go through each thread searching for (and removing) the data. */
-    LIST_FOREACH(cur, &thd_list, t_list) {
-        LIST_FOREACH(i, &cur->tls_list, kv_list) {
-            if(i->key == key) {
-                LIST_REMOVE(i, kv_list);
-                free(i);
-                break;
-            }
-        }
-    }
-
-    kthread_key_delete_destructor(key);
-
-    irq_restore(old);
-    return 0;
-}
-
 /*****************************************************************************/
 /* Init/shutdown */
 
 /* Init */
 int thd_init(int mode) {
     kthread_t *kern, *reaper;
+    int i;
 
     /* Make sure we're not already running */
     if(thd_mode != THD_MODE_NONE)
         return -1;
 
+    if(!thd_slab) {
+        thd_slab = slab_cache_create("kthread", sizeof(kthread_t), 0, NULL);
+
+        if(!thd_slab)
+            return -1;
+    }
+
     /* Setup our mode as appropriate */
     thd_mode = mode;
 
-    /* Initialize handle counters */
-    tid_highest = 1;
+    /* Initialize the thread ID table (slot 0 is never handed out) */
+    tid_slots = NULL;
+    tid_slot_count = 0;
+    tid_slot_used = 1;
+    tid_free_head = tid_free_tail = tid_free_count = 0;
 
     /* Initialize the thread list */
     LIST_INIT(&thd_list);
 
     /* Initialize the run queue */
-    TAILQ_INIT(&run_queue);
+    for(i = 0; i < RQ_LEVELS; ++i)
+        TAILQ_INIT(&run_queue[i]);
+
+    memset(rq_bitmap, 0, sizeof(rq_bitmap));
+    memset(rq_summary, 0, sizeof(rq_summary));
 
     /* Start off with no "current" thread */
     thd_current = NULL;
+    thd_last_run = NULL;
 
     /* Init thread-local storage. */
     kthread_tls_init();
@@ -926,8 +1495,15 @@ int thd_init(int mode) {
     strcpy(reaper->label, "[reaper]");
     thd_set_prio(reaper, 1);
 
+    thd_sys_count = 2;
+
+    /* Set up the thread that runs deferred interrupt work */
+    if(!tasklet_init())
+        ++thd_sys_count;
+
     /* Main thread -- the kern thread */
     thd_current = kern;
+    thd_last_run = kern;
     irq_set_context(&kern->context);
 
     /* Initialize thread sync primitives */
@@ -943,6 +1519,14 @@ int thd_init(int mode) {
 
         printf("thd: pre-emption enabled, HZ=%d\n", HZ);
     }
+    else if(thd_mode == THD_MODE_TICKLESS) {
+        /* Schedule a wakeup to get things going; the scheduler will take it
+           from there. */
+        thd_tickless_arm(timer_ms_gettime64(), timer_ms_gettime64() + 1000 / HZ,
+                         1);
+
+        printf("thd: tickless pre-emption enabled, HZ=%d\n", HZ);
+    }
     else
         printf("thd: pre-emption disabled\n");
 
@@ -954,7 +1538,7 @@ void thd_shutdown() {
     kthread_t *n1, *n2;
 
     /* Disable pre-emption, if neccessary */
-    if(thd_mode == THD_MODE_PREEMPT) {
+    if(thd_mode == THD_MODE_PREEMPT || thd_mode == THD_MODE_TICKLESS) {
         timer_primary_set_callback(NULL);
     }
 
@@ -963,21 +1547,32 @@ void thd_shutdown() {
 
     while(n1 != NULL) {
         n2 = LIST_NEXT(n1, t_list);
-        free(n1->stack);
-        free(n1);
+        thd_free(n1);
         n1 = n2;
     }
 
+    /* Release anything sitting in the thread cache */
+    thd_cache_flush();
+
+    /* Tear down the thread ID table */
+    free(tid_slots);
+    tid_slots = NULL;
+    tid_slot_count = tid_slot_used = 0;
+
     sem_destroy(&thd_reap_sem);
 
     /* Shutdown thread sync primitives */
     genwait_shutdown();
 
+    tasklet_shutdown();
+
     kthread_tls_shutdown();
 
     /* Not running */
     thd_mode = THD_MODE_NONE;
     thd_count = 0;
+    thd_sys_count = 0;
+    thd_vblank_users = 0;
 
     // XXX _impure_ptr is borked
 }
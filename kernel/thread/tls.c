@@ -8,6 +8,7 @@
    1.3.0. */
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <errno.h>
 #include <malloc.h>
@@ -20,57 +21,47 @@
 static spinlock_t mutex = SPINLOCK_INITIALIZER;
 static kthread_key_t next_key = 1;
 
-typedef struct kthread_tls_dest {
-    /* List handle */
-    LIST_ENTRY(kthread_tls_dest) dest_list;
+typedef void (*tls_dtor_t)(void *);
 
-    /* The key */
-    kthread_key_t key;
-
-    /* Destructor for the key */
-    void (*destructor)(void *);
-} kthread_tls_dest_t;
-
-LIST_HEAD(kthread_tls_dest_list, kthread_tls_dest);
-
-static struct kthread_tls_dest_list dest_list;
+/* Destructors for each key, indexed by the key itself. Keys are never reused,
+   so this only ever needs to grow. The table is read with interrupts disabled,
+   and a new one is swapped in the same way, so that a thread exiting while a
+   key is being created never sees a table that has been freed. */
+static tls_dtor_t *dest_table;
+static int dest_size;
 
 /* What is the next key that will be given out? */
 kthread_key_t kthread_key_next() {
     return next_key;
 }
 
-typedef void (*destructor)(void *);
-
 /* Get the destructor for a given key. */
-static destructor kthread_key_get_destructor(kthread_key_t key) {
-    kthread_tls_dest_t *i;
+static tls_dtor_t kthread_key_get_destructor(kthread_key_t key) {
+    tls_dtor_t rv = NULL;
+    int old = irq_disable();
 
-    LIST_FOREACH(i, &dest_list, dest_list) {
-        if(i->key == key) {
-            return i->destructor;
-        }
-    }
+    if(key < dest_size)
+        rv = dest_table[key];
 
-    return NULL;
+    irq_restore(old);
+    return rv;
 }
 
-/* Delete the destructor for a given key. */
-void kthread_key_delete_destructor(kthread_key_t key) {
-    kthread_tls_dest_t *i;
+/* Find where the value for a given key is stored for a thread. Returns NULL if
+   no storage has been allocated for the key yet. */
+static void **kthread_tls_slot(kthread_t *thd, kthread_key_t key) {
+    if(key <= KTHREAD_TLS_INLINE)
+        return &thd->tls.data[key - 1];
+    else if(key - KTHREAD_TLS_INLINE <= thd->tls.overflow_size)
+        return &thd->tls.overflow[key - KTHREAD_TLS_INLINE - 1];
 
-    LIST_FOREACH(i, &dest_list, dest_list) {
-        if(i->key == key) {
-            LIST_REMOVE(i, dest_list);
-            free(i);
-            return;
-        }
-    }
+    return NULL;
 }
 
 /* Create a new TLS key. */
 int kthread_key_create(kthread_key_t *key, void (*destructor)(void *)) {
-    kthread_tls_dest_t *dest;
+    tls_dtor_t *nt, *ot;
+    int cnt, old;
 
     if(irq_inside_int() &&
        (spinlock_is_locked(&mutex) || !malloc_irq_safe()))  {
@@ -80,21 +71,39 @@ int kthread_key_create(kthread_key_t *key, void (*destructor)(void *)) {
 
     spinlock_lock(&mutex);
 
-    /* Store the destructor if need be. */
-    if(destructor) {
-        dest = (kthread_tls_dest_t *)malloc(sizeof(kthread_tls_dest_t));
+    /* Make room to store the destructor if need be. */
+    if(next_key >= dest_size) {
+        cnt = dest_size ? dest_size * 2 : KTHREAD_TLS_INLINE * 2;
 
-        if(!dest) {
+        while(cnt <= next_key)
+            cnt *= 2;
+
+        nt = (tls_dtor_t *)malloc(cnt * sizeof(tls_dtor_t));
+
+        if(!nt) {
             errno = ENOMEM;
             spinlock_unlock(&mutex);
             return -1;
         }
 
-        dest->key = next_key;
-        dest->destructor = destructor;
-        LIST_INSERT_HEAD(&dest_list, dest, dest_list);
+        if(dest_size)
+            memcpy(nt, dest_table, dest_size * sizeof(tls_dtor_t));
+
+        memset(nt + dest_size, 0, (cnt - dest_size) * sizeof(tls_dtor_t));
+
+        old = irq_disable();
+        ot = dest_table;
+        dest_table = nt;
+        dest_size = cnt;
+        irq_restore(old);
+
+        free(ot);
     }
 
+    old = irq_disable();
+    dest_table[next_key] = destructor;
+    irq_restore(old);
+
     *key = next_key++;
     spinlock_unlock(&mutex);
 
@@ -105,15 +114,15 @@ int kthread_key_create(kthread_key_t *key, void (*destructor)(void *)) {
    or there is no data there for the current thread. */
 void *kthread_getspecific(kthread_key_t key) {
     kthread_t *cur = thd_get_current();
-    kthread_tls_kv_t *i;
+    void **slot;
 
-    LIST_FOREACH(i, &cur->tls_list, kv_list) {
-        if(i->key == key) {
-            return i->data;
-        }
-    }
+    if(key < 1 || key >= next_key)
+        return NULL;
 
-    return NULL;
+    if(!(slot = kthread_tls_slot(cur, key)))
+        return NULL;
+
+    return *slot;
 }
 
 /* Set the value for a given TLS key. Returns -1 on failure. errno will be
@@ -122,7 +131,8 @@ void *kthread_getspecific(kthread_key_t key) {
    in progress already. */
 int kthread_setspecific(kthread_key_t key, const void *value) {
     kthread_t *cur = thd_get_current();
-    kthread_tls_kv_t *i;
+    void **slot, **nt, **ot;
+    int cnt, old;
 
     if(irq_inside_int() && spinlock_is_locked(&mutex)) {
         errno = EPERM;
@@ -133,52 +143,121 @@ int kthread_setspecific(kthread_key_t key, const void *value) {
 
     /* Make sure the key is valid. */
     if(key >= next_key || key < 1) {
+        spinlock_unlock(&mutex);
         errno = EINVAL;
         return -1;
     }
 
     spinlock_unlock(&mutex);
 
-    /* Check if we already have an entry for this key. */
-    LIST_FOREACH(i, &cur->tls_list, kv_list) {
-        if(i->key == key) {
-            i->data = (void *)value;
-            return 0;
+    /* If the key doesn't fit in what we already have, grow the overflow table
+       to fit it (and hopefully a few more). kthread_key_delete() may clear
+       entries in the table at any time with interrupts disabled, so the old
+       contents are copied and the new table swapped in the same way. */
+    if(!(slot = kthread_tls_slot(cur, key))) {
+        cnt = cur->tls.overflow_size ? cur->tls.overflow_size * 2 :
+            KTHREAD_TLS_INLINE;
+
+        if(cnt < key - KTHREAD_TLS_INLINE)
+            cnt = key - KTHREAD_TLS_INLINE;
+
+        nt = (void **)malloc(cnt * sizeof(void *));
+
+        if(!nt) {
+            errno = ENOMEM;
+            return -1;
         }
+
+        memset(nt + cur->tls.overflow_size, 0,
+               (cnt - cur->tls.overflow_size) * sizeof(void *));
+
+        old = irq_disable();
+
+        if(cur->tls.overflow_size)
+            memcpy(nt, cur->tls.overflow,
+                   cur->tls.overflow_size * sizeof(void *));
+
+        ot = cur->tls.overflow;
+        cur->tls.overflow = nt;
+        cur->tls.overflow_size = cnt;
+        irq_restore(old);
+
+        free(ot);
+        slot = kthread_tls_slot(cur, key);
     }
 
-    /* No entry, create a new one. */
-    i = (kthread_tls_kv_t *)malloc(sizeof(kthread_tls_kv_t));
+    *slot = (void *)value;
+
+    return 0;
+}
+
+/* Clear out the value for a key in one thread. */
+static int kthread_key_clear(kthread_t *thd, void *data) {
+    void **slot;
+
+    if((slot = kthread_tls_slot(thd, *(kthread_key_t *)data)))
+        *slot = NULL;
 
-    if(!i) {
-        errno = ENOMEM;
+    return 0;
+}
+
+/* Delete a TLS key. Note that currently this doesn't prevent you from reusing
+   the key after deletion. This seems ok, as the pthreads standard states that
+   using the key after deletion results in "undefined behavior". */
+int kthread_key_delete(kthread_key_t key) {
+    int old = irq_disable();
+
+    /* Make sure the key is valid. */
+    if(key >= next_key || key < 1) {
+        irq_restore(old);
+        errno = EINVAL;
         return -1;
     }
 
-    i->key = key;
-    i->data = (void *)value;
-    i->destructor = kthread_key_get_destructor(key);
-    LIST_INSERT_HEAD(&cur->tls_list, i, kv_list);
+    /* Go through each thread removing the data. */
+    thd_each(&kthread_key_clear, &key);
 
+    /* Forget the destructor too. */
+    if(key < dest_size)
+        dest_table[key] = NULL;
+
+    irq_restore(old);
     return 0;
 }
 
+/* Call the destructors for any values a thread has, and free up any storage it
+   had for them. */
+void kthread_tls_destroy(kthread_t *thd) {
+    kthread_key_t key;
+    tls_dtor_t d;
+    void **slot;
+
+    for(key = 1; key < next_key; ++key) {
+        if(!(slot = kthread_tls_slot(thd, key)))
+            break;
+
+        if(*slot && (d = kthread_key_get_destructor(key)))
+            d(*slot);
+    }
+
+    free(thd->tls.overflow);
+    thd->tls.overflow = NULL;
+    thd->tls.overflow_size = 0;
+}
+
 int kthread_tls_init() {
-    /* Initialize the destructor list. */
-    LIST_INIT(&dest_list);
+    /* Start off with no keys and no destructors. */
+    next_key = 1;
+    dest_table = NULL;
+    dest_size = 0;
 
     return 0;
 }
 
 void kthread_tls_shutdown() {
-    kthread_tls_dest_t *n1, *n2;
-
-    /* Tear down the destructor list. */
-    n1 = LIST_FIRST(&dest_list);
-
-    while(n1 != NULL) {
-        n2 = LIST_NEXT(n1, dest_list);
-        free(n1);
-        n1 = n2;
-    }
+    /* Tear down the destructor table. */
+    free(dest_table);
+    dest_table = NULL;
+    dest_size = 0;
+    next_key = 1;
 }
@@ -0,0 +1,447 @@
+/* KallistiOS ##version##
+
+   workqueue.c
+   Copyright (C) 2026 The KallistiOS Team
+*/
+
+/* Defines work queues: pools of worker threads that run queued work items */
+
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include <errno.h>
+
+#include <kos/thread.h>
+#include <kos/genwait.h>
+#include <kos/workqueue.h>
+#include <arch/irq.h>
+#include <arch/timer.h>
+
+/* Work item states */
+#define WORK_IDLE       0
+#define WORK_PENDING    1
+#define WORK_DELAYED    2
+
+/**************************************/
+
+/* Every work queue that exists. A work item only points at its queue while it
+   is waiting to be run, so that nothing is left pointing at a queue after it
+   has been destroyed. Finding out whether an item is running means looking
+   through all of them. Only changed with interrupts disabled. */
+static LIST_HEAD(wq_list, kos_workqueue) wq_list =
+    LIST_HEAD_INITIALIZER(wq_list);
+
+/* Which worker of the queue is the current thread? Returns -1 if it isn't one
+   of the queue's workers. Interrupts must be disabled. */
+static int wq_worker_index(workqueue_t *wq) {
+    kthread_t *cur = thd_get_current();
+    int i;
+
+    for(i = 0; i < wq->nthreads; ++i) {
+        if(wq->threads[i] == cur)
+            return i;
+    }
+
+    return -1;
+}
+
+/* Is the given work item being run by a worker right now? If self is set,
+   only count it if the current thread is the one running it. Interrupts must
+   be disabled. */
+static int wq_running(kos_work_t *work, int self) {
+    workqueue_t *wq;
+    int i;
+
+    LIST_FOREACH(wq, &wq_list, list) {
+        if(self) {
+            if((i = wq_worker_index(wq)) >= 0 && wq->current[i] == work)
+                return 1;
+
+            continue;
+        }
+
+        for(i = 0; i < wq->nthreads; ++i) {
+            if(wq->current[i] == work)
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Is the queue completely idle? Interrupts must be disabled. */
+static int wq_idle(workqueue_t *wq) {
+    int i;
+
+    if(!TAILQ_EMPTY(&wq->pending))
+        return 0;
+
+    for(i = 0; i < wq->nthreads; ++i) {
+        if(wq->current[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Move any delayed work that is due over to the pending list. Interrupts must
+   be disabled. */
+static void wq_run_timers(workqueue_t *wq, uint64 now) {
+    kos_work_t *w;
+
+    while((w = TAILQ_FIRST(&wq->delayed)) && w->when <= now) {
+        TAILQ_REMOVE(&wq->delayed, w, entry);
+        TAILQ_INSERT_TAIL(&wq->pending, w, entry);
+        w->state = WORK_PENDING;
+    }
+}
+
+static void *wq_worker(void *param) {
+    workqueue_t *wq = (workqueue_t *)param;
+    kos_work_t *w;
+    uint64 now;
+    int old, idx, timeout;
+
+    old = irq_disable();
+    idx = wq_worker_index(wq);
+
+    for(;;) {
+        now = timer_ms_gettime64();
+        wq_run_timers(wq, now);
+
+        if((w = TAILQ_FIRST(&wq->pending))) {
+            TAILQ_REMOVE(&wq->pending, w, entry);
+            w->state = WORK_IDLE;
+            w->wq = NULL;
+            wq->current[idx] = w;
+
+            irq_restore(old);
+            w->func(w);
+            old = irq_disable();
+
+            /* Don't touch the work item after this point, the work function
+               may well have freed it. Its address is still good enough for
+               waking up anyone waiting on it though. */
+            wq->current[idx] = NULL;
+            genwait_wake_all(w);
+
+            if(wq_idle(wq))
+                genwait_wake_all(&wq->current);
+
+            continue;
+        }
+
+        if(wq->shutdown)
+            break;
+
+        /* Sleep until there's something to do, or the next delayed work item
+           is due. */
+        if((w = TAILQ_FIRST(&wq->delayed))) {
+            timeout = (int)(w->when - now);
+
+            if(timeout < 1)
+                timeout = 1;
+        }
+        else {
+            timeout = 0;
+        }
+
+        genwait_wait(wq, "workqueue_worker", timeout, NULL);
+    }
+
+    irq_restore(old);
+    return NULL;
+}
+
+/**************************************/
+
+void work_init(kos_work_t *work, kos_work_func_t func, void *data) {
+    memset(work, 0, sizeof(kos_work_t));
+    work->func = func;
+    work->data = data;
+}
+
+workqueue_t *workqueue_create(const char *label, int threads, prio_t prio) {
+    workqueue_t *wq;
+    kthread_attr_t attr;
+    char name[64];
+    int i, old;
+
+    if(irq_inside_int()) {
+        errno = EPERM;
+        return NULL;
+    }
+
+    if(threads < 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if(!(wq = (workqueue_t *)malloc(sizeof(workqueue_t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset(wq, 0, sizeof(workqueue_t));
+    TAILQ_INIT(&wq->pending);
+    TAILQ_INIT(&wq->delayed);
+
+    wq->threads = (kthread_t **)calloc(threads, sizeof(kthread_t *));
+    wq->current = (kos_work_t **)calloc(threads, sizeof(kos_work_t *));
+
+    if(!wq->threads || !wq->current) {
+        free(wq->threads);
+        free(wq->current);
+        free(wq);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    snprintf(name, sizeof(name), "[workqueue %s]", label ? label : "");
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prio = prio;
+    attr.label = name;
+
+    /* Keep the workers from starting until they're all accounted for, since
+       each one needs to find itself in the thread list. */
+    old = irq_disable();
+    LIST_INSERT_HEAD(&wq_list, wq, list);
+
+    for(i = 0; i < threads; ++i) {
+        if(!(wq->threads[i] = thd_create_ex(&attr, wq_worker, wq)))
+            break;
+
+        wq->nthreads = i + 1;
+    }
+
+    irq_restore(old);
+
+    if(wq->nthreads != threads) {
+        workqueue_destroy(wq);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return wq;
+}
+
+int workqueue_destroy(workqueue_t *wq) {
+    kos_work_t *w;
+    int old, i;
+
+    if(irq_inside_int()) {
+        errno = EPERM;
+        return -1;
+    }
+
+    old = irq_disable();
+
+    if(wq_worker_index(wq) >= 0) {
+        irq_restore(old);
+        errno = EDEADLK;
+        return -1;
+    }
+
+    /* Drop any delayed work that isn't due yet. */
+    wq_run_timers(wq, timer_ms_gettime64());
+
+    while((w = TAILQ_FIRST(&wq->delayed))) {
+        TAILQ_REMOVE(&wq->delayed, w, entry);
+        w->state = WORK_IDLE;
+        w->wq = NULL;
+        genwait_wake_all(w);
+    }
+
+    /* Tell the workers to finish up and exit. */
+    wq->shutdown = 1;
+    genwait_wake_all(wq);
+    irq_restore(old);
+
+    for(i = 0; i < wq->nthreads; ++i)
+        thd_join(wq->threads[i], NULL);
+
+    old = irq_disable();
+    LIST_REMOVE(wq, list);
+    irq_restore(old);
+
+    free(wq->threads);
+    free(wq->current);
+    free(wq);
+
+    return 0;
+}
+
+int workqueue_submit_delayed(workqueue_t *wq, kos_work_t *work, int delay) {
+    kos_work_t *w;
+    int old;
+
+    if(delay < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    old = irq_disable();
+
+    if(wq->shutdown) {
+        irq_restore(old);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(work->state != WORK_IDLE) {
+        irq_restore(old);
+        errno = EBUSY;
+        return -1;
+    }
+
+    work->wq = wq;
+
+    if(!delay) {
+        work->state = WORK_PENDING;
+        TAILQ_INSERT_TAIL(&wq->pending, work, entry);
+    }
+    else {
+        /* Keep the delayed list sorted by due time. */
+        work->state = WORK_DELAYED;
+        work->when = timer_ms_gettime64() + delay;
+
+        TAILQ_FOREACH(w, &wq->delayed, entry) {
+            if(w->when > work->when)
+                break;
+        }
+
+        if(w)
+            TAILQ_INSERT_BEFORE(w, work, entry);
+        else
+            TAILQ_INSERT_TAIL(&wq->delayed, work, entry);
+
+        /* If this is the first thing due, a sleeping worker will need to
+           recalculate how long it sleeps for. */
+        if(TAILQ_FIRST(&wq->delayed) != work) {
+            irq_restore(old);
+            return 0;
+        }
+    }
+
+    genwait_wake_one(wq);
+    irq_restore(old);
+
+    return 0;
+}
+
+int workqueue_submit(workqueue_t *wq, kos_work_t *work) {
+    return workqueue_submit_delayed(wq, work, 0);
+}
+
+int workqueue_cancel(kos_work_t *work) {
+    workqueue_t *wq;
+    int old = irq_disable();
+
+    if(work->state == WORK_PENDING) {
+        TAILQ_REMOVE(&work->wq->pending, work, entry);
+    }
+    else if(work->state == WORK_DELAYED) {
+        TAILQ_REMOVE(&work->wq->delayed, work, entry);
+    }
+    else {
+        irq_restore(old);
+        errno = EALREADY;
+        return -1;
+    }
+
+    wq = work->wq;
+    work->state = WORK_IDLE;
+    work->wq = NULL;
+
+    /* Let anyone waiting on it know that it won't be running. */
+    genwait_wake_all(work);
+
+    if(wq_idle(wq))
+        genwait_wake_all(&wq->current);
+
+    irq_restore(old);
+    return 0;
+}
+
+int workqueue_wait(kos_work_t *work, int timeout) {
+    int old, rv = 0;
+    uint64 deadline = 0, now;
+
+    if(irq_inside_int()) {
+        errno = EPERM;
+        return -1;
+    }
+
+    if(timeout < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    old = irq_disable();
+
+    if(wq_running(work, 1)) {
+        irq_restore(old);
+        errno = EDEADLK;
+        return -1;
+    }
+
+    if(timeout)
+        deadline = timer_ms_gettime64() + timeout;
+
+    while(work->state != WORK_IDLE || wq_running(work, 0)) {
+        /* Only wait for whatever is left of the timeout, in case we get
+           woken up more than once. */
+        if(timeout) {
+            now = timer_ms_gettime64();
+
+            if(now >= deadline) {
+                errno = ETIMEDOUT;
+                rv = -1;
+                break;
+            }
+
+            timeout = (int)(deadline - now);
+        }
+
+        if(genwait_wait(work, "workqueue_wait", timeout, NULL) < 0) {
+            if(errno == EAGAIN)
+                errno = ETIMEDOUT;
+
+            rv = -1;
+            break;
+        }
+    }
+
+    irq_restore(old);
+    return rv;
+}
+
+int workqueue_flush(workqueue_t *wq) {
+    int old;
+
+    if(irq_inside_int()) {
+        errno = EPERM;
+        return -1;
+    }
+
+    old = irq_disable();
+
+    if(wq_worker_index(wq) >= 0) {
+        irq_restore(old);
+        errno = EDEADLK;
+        return -1;
+    }
+
+    /* Pick up anything that has come due, so that we wait for it too. */
+    wq_run_timers(wq, timer_ms_gettime64());
+
+    if(!TAILQ_EMPTY(&wq->pending))
+        genwait_wake_all(wq);
+
+    while(!wq_idle(wq))
+        genwait_wait(&wq->current, "workqueue_flush", 0, NULL);
+
+    irq_restore(old);
+    return 0;
+}